@@ -26,8 +26,10 @@ SOURCES += main.cpp \
     app.cpp \
     ..\..\..\wpmcpp\src\detectfile.cpp \
     ..\..\..\wpmcpp\src\downloader.cpp \
+    ..\..\..\wpmcpp\src\hashsumwriter.cpp \
     ..\..\..\wpmcpp\src\commandline.cpp \
     ..\..\..\wpmcpp\src\repositoryxmlhandler.cpp \
+    ..\..\..\wpmcpp\src\repositoryqueue.cpp \
     ..\..\..\wpmcpp\src\mysqlquery.cpp \
     ..\..\..\wpmcpp\src\wellknownprogramsthirdpartypm.cpp \
     ..\..\..\wpmcpp\src\abstractthirdpartypm.cpp \
@@ -36,6 +38,7 @@ SOURCES += main.cpp \
     ..\..\..\wpmcpp\src\controlpanelthirdpartypm.cpp \
     ..\..\..\wpmcpp\src\installoperation.cpp \
     ..\..\..\wpmcpp\src\dependency.cpp \
+    ..\..\..\wpmcpp\src\dependencyresolver.cpp \
     ..\..\..\wpmcpp\src\packageversionfile.cpp \
     ..\..\..\wpmcpp\src\dbrepository.cpp \
     ..\..\..\wpmcpp\src\license.cpp \
@@ -47,6 +50,7 @@ SOURCES += main.cpp \
     ..\..\..\wpmcpp\src\abstractrepository.cpp \
     ..\..\..\wpmcpp\src\version.cpp \
     ..\..\..\wpmcpp\src\installedpackages.cpp \
+    ..\..\..\wpmcpp\src\installedpackagessnapshot.cpp \
     ..\..\..\wpmcpp\src\windowsregistry.cpp \
     ..\..\..\wpmcpp\src\packageversion.cpp \
     ..\..\..\wpmcpp\src\wpmutils.cpp \
@@ -56,8 +60,10 @@ HEADERS += \
     app.h \
     ..\..\..\wpmcpp\src\detectfile.h \
     ..\..\..\wpmcpp\src\downloader.h \
+    ..\..\..\wpmcpp\src\hashsumwriter.h \
     ..\..\..\wpmcpp\src\commandline.h \
     ..\..\..\wpmcpp\src\repositoryxmlhandler.h \
+    ..\..\..\wpmcpp\src\repositoryqueue.h \
     ..\..\..\wpmcpp\src\mysqlquery.h \
     ..\..\..\wpmcpp\src\wellknownprogramsthirdpartypm.h \
     ..\..\..\wpmcpp\src\abstractthirdpartypm.h \
@@ -66,6 +72,7 @@ HEADERS += \
     ..\..\..\wpmcpp\src\controlpanelthirdpartypm.h \
     ..\..\..\wpmcpp\src\installoperation.h \
     ..\..\..\wpmcpp\src\dependency.h \
+    ..\..\..\wpmcpp\src\dependencyresolver.h \
     ..\..\..\wpmcpp\src\packageversionfile.h \
     ..\..\..\wpmcpp\src\dbrepository.h \
     ..\..\..\wpmcpp\src\license.h \
@@ -77,6 +84,7 @@ HEADERS += \
     ..\..\..\wpmcpp\src\abstractrepository.h \
     ..\..\..\wpmcpp\src\version.h \
     ..\..\..\wpmcpp\src\installedpackages.h \
+    ..\..\..\wpmcpp\src\installedpackagessnapshot.h \
     ..\..\..\wpmcpp\src\windowsregistry.h \
     ..\..\..\wpmcpp\src\packageversion.h \
     ..\..\..\wpmcpp\src\wpmutils.h \
@@ -32,14 +32,17 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/job.cpp \
     ../../wpmcpp/src/installoperation.cpp \
     ../../wpmcpp/src/dependency.cpp \
+    ../../wpmcpp/src/dependencyresolver.cpp \
     ../../wpmcpp/src/wpmutils.cpp \
     ../../wpmcpp/src/downloader.cpp \
+    ../../wpmcpp/src/hashsumwriter.cpp \
     ../../wpmcpp/src/license.cpp \
     ../../wpmcpp/src/windowsregistry.cpp \
     ../../wpmcpp/src/detectfile.cpp \
     app.cpp \
     ../../wpmcpp/src/commandline.cpp \
     ../../wpmcpp/src/installedpackages.cpp \
+    ../../wpmcpp/src/installedpackagessnapshot.cpp \
     ../../wpmcpp/src/installedpackageversion.cpp \
     ../../wpmcpp/src/clprogress.cpp \
     ../../wpmcpp/src/dbrepository.cpp \
@@ -50,6 +53,7 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.cpp \
     ../../wpmcpp/src/hrtimer.cpp \
     ../../wpmcpp/src/repositoryxmlhandler.cpp \
+    ../../wpmcpp/src/repositoryqueue.cpp \
     ../../wpmcpp/src/mysqlquery.cpp \
     ../../wpmcpp/src/installedpackagesthirdpartypm.cpp
 HEADERS += ../../wpmcpp/src/visiblejobs.h \
@@ -61,13 +65,16 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/job.h \
     ../../wpmcpp/src/installoperation.h \
     ../../wpmcpp/src/dependency.h \
+    ../../wpmcpp/src/dependencyresolver.h \
     ../../wpmcpp/src/wpmutils.h \
     ../../wpmcpp/src/downloader.h \
+    ../../wpmcpp/src/hashsumwriter.h \
     ../../wpmcpp/src/license.h \
     ../../wpmcpp/src/windowsregistry.h \
     ../../wpmcpp/src/detectfile.h \
     app.h \
     ../../wpmcpp/src/installedpackages.h \
+    ../../wpmcpp/src/installedpackagessnapshot.h \
     ../../wpmcpp/src/installedpackageversion.h \
     ../../wpmcpp/src/commandline.h \
     ../../wpmcpp/src/clprogress.h \
@@ -79,6 +86,7 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.h \
     ../../wpmcpp/src/hrtimer.h \
     ../../wpmcpp/src/repositoryxmlhandler.h \
+    ../../wpmcpp/src/repositoryqueue.h \
     ../../wpmcpp/src/mysqlquery.h \
     ../../wpmcpp/src/installedpackagesthirdpartypm.h \
     stable.h
@@ -5,6 +5,14 @@
 #include <QRegExp>
 #include <QScopedPointer>
 #include <QProcess>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QSignalSpy>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "app.h"
 #include "wpmutils.h"
@@ -15,6 +23,210 @@
 #include "abstractrepository.h"
 #include "dbrepository.h"
 #include "hrtimer.h"
+#include "repositoryxmlhandler.h"
+#include "repositoryqueue.h"
+#include "scandiskthirdpartypm.h"
+#include "hashsumwriter.h"
+#include "dependencyresolver.h"
+#include "filecache.h"
+
+#include <quazip.h>
+#include <quazipfile.h>
+
+/**
+ * @brief loads a repository from an XML file
+ * @param rep the package versions, packages and licenses will be stored here
+ * @param filename XML file
+ * @return error message
+ */
+static QString loadRepository(Repository* rep, const QString& filename)
+{
+    QString err;
+
+    QFile f(filename);
+    if (!f.open(QIODevice::ReadOnly))
+        err = f.errorString();
+
+    if (err.isEmpty()) {
+        RepositoryXMLHandler handler(rep, QUrl::fromLocalFile(filename));
+        QXmlStreamReader reader(&f);
+        if (!handler.parse(&reader))
+            err = handler.errorString();
+    }
+
+    return err;
+}
+
+/**
+ * @brief creates a directory tree. The sub-directories are named 0, 1, 2, ...
+ * @param dir root directory
+ * @param width number of sub-directories in each directory
+ * @param depth number of levels
+ */
+static void createDirectoryTree(const QString& dir, int width, int depth)
+{
+    if (depth > 0) {
+        QDir d(dir);
+        for (int i = 0; i < width; i++) {
+            QString name = QString::number(i);
+            d.mkdir(name);
+            createDirectoryTree(dir + "\\" + name, width, depth - 1);
+        }
+    }
+}
+
+/**
+ * @brief creates a file
+ * @param path full file name
+ * @param content file content
+ * @return SHA1 of the file or "" if the file could not be written
+ */
+static QString createFile(const QString& path, const QByteArray& content)
+{
+    QString r;
+    QFile f(path);
+    if (f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        bool ok = f.write(content) == content.size();
+        f.close();
+        if (ok)
+            r = WPMUtils::sha1(path);
+    }
+    return r;
+}
+
+/**
+ * @brief temporary directory with an empty database for one test
+ */
+class TestDatabase
+{
+public:
+    QTemporaryDir tempDir;
+
+    /** the database in tempDir */
+    DBRepository dbr;
+
+    /**
+     * @param name connection name
+     * @param err error message will be stored here
+     */
+    TestDatabase(const QString& name, QString* err)
+    {
+        *err = "";
+        if (!tempDir.isValid())
+            *err = "Cannot create a temporary directory";
+        else
+            *err = dbr.open(name, WPMUtils::normalizePath(tempDir.path()) +
+                    "\\test.db");
+    }
+};
+
+/**
+ * @brief uses a database in a temporary directory as DBRepository::getDefault()
+ *     during a test. The destructor also runs after a failed assertion: the
+ *     test packages are removed from InstalledPackages::getDefault() and the
+ *     Windows registry and the database is closed before the directory is
+ *     deleted.
+ */
+class DefaultDatabaseScope
+{
+public:
+    QTemporaryDir tempDir;
+
+    /** all installed versions of these packages are removed at the end */
+    QStringList packages;
+
+    /** restored at the end */
+    int maxParallelDownloads;
+
+    /**
+     * @param name connection name
+     * @param err error message will be stored here
+     */
+    DefaultDatabaseScope(const QString& name, QString* err)
+    {
+        *err = "";
+        maxParallelDownloads =
+                DBRepository::getDefault()->getMaxParallelDownloads();
+        if (!tempDir.isValid())
+            *err = "Cannot create a temporary directory";
+        else
+            *err = DBRepository::getDefault()->open(name,
+                    WPMUtils::normalizePath(tempDir.path()) + "\\test.db");
+    }
+
+    ~DefaultDatabaseScope()
+    {
+        InstalledPackages* ip = InstalledPackages::getDefault();
+        for (int i = 0; i < packages.count(); i++) {
+            QList<InstalledPackageVersion*> ipvs =
+                    ip->getByPackage(packages.at(i));
+            for (int j = 0; j < ipvs.count(); j++) {
+                ip->setPackageVersionPath(packages.at(i),
+                        ipvs.at(j)->version, "");
+            }
+            qDeleteAll(ipvs);
+        }
+        DBRepository::getDefault()->setMaxParallelDownloads(
+                maxParallelDownloads);
+        DBRepository::getDefault()->close();
+    }
+};
+
+/**
+ * @brief creates a ZIP file with entries in 2 levels of directories
+ * @param zipfile name of the ZIP file
+ * @param n number of entries
+ * @return true if the file was created
+ */
+static bool createZipFile(const QString& zipfile, int n)
+{
+    QuaZip zip(zipfile);
+    if (!zip.open(QuaZip::mdCreate))
+        return false;
+
+    QuaZipFile file(&zip);
+    for (int i = 0; i < n; i++) {
+        QString name = QString("dir%1/sub%2/file%3.txt").arg(i / 1000).
+                arg(i / 100 % 10).arg(i);
+        if (!file.open(QIODevice::WriteOnly, QuaZipNewInfo(name)))
+            return false;
+        file.write(QByteArray(100 + i % 1000, 'x'));
+        file.close();
+    }
+    zip.close();
+
+    return zip.getZipError() == 0;
+}
+
+/**
+ * @brief creates a package version with one <detect-file>
+ * @param package full package name
+ * @param path relative path for the detect file
+ * @param sha1 SHA1 for the detect file
+ * @return [ownership:caller] new package version
+ */
+static PackageVersion* createDetectFilePackageVersion(const QString& package,
+        const QString& path, const QString& sha1)
+{
+    PackageVersion* pv = new PackageVersion(package, Version(1, 0));
+    DetectFile* df = new DetectFile();
+    df->path = path;
+    df->sha1 = sha1;
+    pv->detectFiles.append(df);
+    return pv;
+}
+
+/**
+ * @param pv a package version
+ * @return <version> for the specified package version
+ */
+static QByteArray toXML(PackageVersion* pv)
+{
+    QByteArray r;
+    QXmlStreamWriter w(&r);
+    pv->toXML(&w);
+    return r;
+}
 
 void App::test()
 {
@@ -66,6 +278,66 @@ void App::test()
     a.setVersion("2.8.7.4.8.9");
     b.setVersion("2.8.6.4.8.8");
     QVERIFY(a > b);
+
+    a.setVersion("3.2");
+    QVERIFY(!a.setVersion(""));
+    QVERIFY(!a.setVersion(" "));
+    QVERIFY(!a.setVersion("1..2"));
+    QVERIFY(!a.setVersion("1.2."));
+    QVERIFY(!a.setVersion("1.2a"));
+    QVERIFY(!a.setVersion("1.2.3.4.5.x"));
+    QVERIFY(!a.setVersion("4294967296"));
+    QVERIFY(a.getVersionString() == "3.2");
+
+    QVERIFY(a.setVersion(" 7 . 8 "));
+    QVERIFY(a.getVersionString() == "7.8");
+
+    // the unused parts must not influence the comparison
+    a.setVersion("1.2.3.4");
+    a.setVersion("1");
+    QVERIFY(a == Version(1, 0));
+    a.setVersion("1.2.3.4.5.6");
+    a.setVersion("1.2");
+    QVERIFY(a == Version(1, 2));
+    a.setVersion("5.6.0.0.0.0");
+    a.normalize();
+    QVERIFY(a == Version(5, 6));
+    b.setVersion("1.2.3.4.5");
+    b = a;
+    QVERIFY(b == Version(5, 6));
+}
+
+void App::testVersionSortKey()
+{
+    Version a;
+    Version b;
+
+    a.setVersion("1.2");
+    b.setVersion("1.2.0.0.0");
+    QVERIFY(a.toSortKey() == b.toSortKey());
+    QVERIFY(a.toSortKey().length() == 8);
+
+    a.setVersion("0");
+    b.setVersion("0.0");
+    QVERIFY(a.toSortKey() == b.toSortKey());
+
+    const char* versions[] = {"0", "0.0.1", "0.1", "1", "1.0.0.0.1", "1.2",
+            "1.10", "2.8.6.4.8.8", "2.8.7.4.8.9", "9", "10", "255.1",
+            "256", "65536", "2147483647"};
+    int n = sizeof(versions) / sizeof(versions[0]);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            a.setVersion(versions[i]);
+            b.setVersion(versions[j]);
+            int r = a.compare(b);
+            QVERIFY((r < 0) == (a.toSortKey() < b.toSortKey()));
+            QVERIFY((r == 0) == (a.toSortKey() == b.toSortKey()));
+        }
+    }
+
+    // Version::EMPTY is -1.-1 and sorts before all other versions
+    a.setVersion("0");
+    QVERIFY(Version::EMPTY.toSortKey() < a.toSortKey());
 }
 
 void App::testInstalledPackages()
@@ -129,6 +401,162 @@ void App::testInstalledPackages()
     QVERIFY(ip->isInstalled(d));
 }
 
+/**
+ * @param i index of a package
+ * @return installation directory for the package with the specified index.
+ *     Every directory is nested in the directory for the package (i - 1) / 10
+ */
+static QString getNestedDir(int i)
+{
+    QString r = "C:\\NpackdTest\\D" + QString::number(i);
+    while (i > 0) {
+        i = (i - 1) / 10;
+        r.insert(13, "\\D" + QString::number(i));
+    }
+    return r;
+}
+
+void App::testFindOwner()
+{
+    std::unique_ptr<InstalledPackages> ip(new InstalledPackages());
+
+    const int N = 3000;
+    for (int i = 0; i < N; i++) {
+        QString err = ip->setPackageVersionPath("P" + QString::number(i),
+                Version(1), getNestedDir(i), false);
+        QVERIFY(err == "");
+    }
+
+    for (int i = 0; i < N; i++) {
+        std::unique_ptr<InstalledPackageVersion> ipv(ip->findOwner(
+                getNestedDir(i) + "\\file.txt"));
+        QVERIFY(ipv.get() != nullptr);
+        QCOMPARE(ipv->package, "P" + QString::number(i));
+    }
+
+    // case and separators are ignored
+    std::unique_ptr<InstalledPackageVersion> ipv(ip->findOwner(
+            getNestedDir(2345).toUpper().replace('\\', '/') + "/"));
+    QVERIFY(ipv.get() != nullptr);
+    QCOMPARE(ipv->package, QString("P2345"));
+
+    ipv.reset(ip->findOwner("C:\\NpackdTest"));
+    QVERIFY(ipv.get() == nullptr);
+
+    ipv.reset(ip->findOwner("D:\\Other\\D0\\file.txt"));
+    QVERIFY(ipv.get() == nullptr);
+
+    // the parent directory becomes the owner after an uninstallation
+    QString err = ip->setPackageVersionPath("P2345", Version(1), "", false);
+    QVERIFY(err == "");
+    ipv.reset(ip->findOwner(getNestedDir(2345) + "\\file.txt"));
+    QVERIFY(ipv.get() != nullptr);
+    QCOMPARE(ipv->package, QString("P234"));
+}
+
+void App::testInstalledPackagesSnapshot()
+{
+    InstalledPackages ip;
+    QString err = ip.setPackageVersionPath("test", Version(1, 2),
+            "C:\\test", false);
+    QVERIFY(err == "");
+    err = ip.setPackageVersionPath("test", Version(1, 3), "C:\\test2", false);
+    QVERIFY(err == "");
+
+    QSharedPointer<const InstalledPackagesSnapshot> s = ip.getSnapshot();
+    QVERIFY(s == ip.getSnapshot());
+    QVERIFY(s->isInstalled("test", Version(1, 2)));
+    QVERIFY(s->getPath("test", Version(1, 3)) == "C:\\test2");
+    QVERIFY(s->getNewestInstalled("test")->version == Version(1, 3));
+    QVERIFY(s->getByPackage("test").count() == 2);
+    QVERIFY(s->getByPackage("tes").count() == 0);
+    QVERIFY(s->getAll().count() == 2);
+    QVERIFY(s->getPackages().count() == 1);
+
+    Dependency d;
+    d.package = "test";
+    d.setVersions("[1.3, 2)");
+    QVERIFY(s->isInstalled(d));
+
+    // the snapshot does not change
+    err = ip.setPackageVersionPath("test", Version(1, 3), "", false);
+    QVERIFY(err == "");
+    QVERIFY(s->isInstalled(d));
+    QVERIFY(!ip.isInstalled(d));
+
+    QSharedPointer<const InstalledPackagesSnapshot> s2 = ip.getSnapshot();
+    QVERIFY(s2 != s);
+    QVERIFY(!s2->isInstalled(d));
+    QVERIFY(s2->getNewestInstalled("test")->version == Version(1, 2));
+
+    ip.clear();
+    QVERIFY(s2->isInstalled("test", Version(1, 2)));
+    QVERIFY(ip.getSnapshot()->getAll().count() == 0);
+}
+
+/**
+ * @brief checks the status of package versions
+ * @param ip installed packages
+ * @param n number of packages P0, P1, ...
+ * @param count number of checks
+ * @return number of installed package versions found
+ */
+static int readInstalledPackages(InstalledPackages* ip, int n, int count)
+{
+    int r = 0;
+    for (int i = 0; i < count; i++) {
+        if (ip->isInstalled("P" + QString::number(i % n), Version(1)))
+            r++;
+    }
+    return r;
+}
+
+void App::benchmarkInstalledPackagesReaders_data()
+{
+    QTest::addColumn<int>("readers");
+    QTest::newRow("1") << 1;
+    QTest::newRow("4") << 4;
+    QTest::newRow("16") << 16;
+}
+
+void App::benchmarkInstalledPackagesReaders()
+{
+    QFETCH(int, readers);
+
+    const int N = 1000;
+    InstalledPackages ip;
+    for (int i = 0; i < N; i++) {
+        QString err = ip.setPackageVersionPath("P" + QString::number(i),
+                Version(1), "C:\\NpackdTest\\P" + QString::number(i), false);
+        QVERIFY(err == "");
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(readers);
+
+    QBENCHMARK {
+        QList<QFuture<int> > futures;
+        for (int i = 0; i < readers; i++) {
+            futures.append(QtConcurrent::run(&pool, readInstalledPackages,
+                    &ip, N, 100000));
+        }
+
+        // the same changes as in InstalledPackages::refresh()
+        ip.clear();
+        QString err;
+        for (int i = 0; i < N && err.isEmpty(); i++) {
+            err = ip.setPackageVersionPath("P" + QString::number(i),
+                    Version(1), "C:\\NpackdTest\\P" + QString::number(i),
+                    false);
+        }
+
+        for (int i = 0; i < futures.count(); i++) {
+            QVERIFY(futures.at(i).result() <= 100000);
+        }
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+}
+
 void App::testCommandLine()
 {
     QString err;
@@ -141,3 +569,1305 @@ void App::testCommandLine()
     QVERIFY2(params.at(0) == "C:\\Program Files (x86)\\InstallShield Installation Information\\{96D0B6C6-5A72-4B47-8583-A87E55F5FE81}\\setup.exe",
             qPrintable(params.at(0)));
 }
+
+void App::testJobProgress()
+{
+    Job* top = new Job("top");
+    QSignalSpy spy(top, SIGNAL(changed(Job*)));
+
+    Job* sub = top->newSubJob(0.5, "sub");
+    Job* leaf = sub->newSubJob(0.5, "leaf");
+
+    const int N = 50000;
+    for (int i = 1; i <= N; i++) {
+        leaf->setProgress(0.999 * i / N);
+        leaf->setTitle("Step " + QString::number(i));
+    }
+
+    // the changes are reported at a limited rate
+    QVERIFY2(spy.count() < 1000, qPrintable(QString::number(spy.count())));
+
+    // small changes are stored, but not propagated to the parent jobs
+    QVERIFY(fabs(leaf->getProgress() - 0.999) < 0.000001);
+    QVERIFY(fabs(top->getProgress() - 0.25) < 0.01);
+
+    // a held back change is reported later even if nothing else happens
+    leaf->setTitle("Almost done");
+    leaf->setTitle("Waiting");
+    int held = spy.count();
+    QTest::qWait(300);
+    QVERIFY(spy.count() > held);
+    QVERIFY(qvariant_cast<Job*>(spy.last().at(0)) == leaf);
+
+    // held back changes in different jobs are all reported
+    leaf->setTitle("Still waiting");
+    held = spy.count();
+    sub->setTitle("sub 2");
+    leaf->setTitle("Waiting again");
+    QTest::qWait(300);
+    QSet<Job*> reported;
+    for (int i = held; i < spy.count(); i++)
+        reported.insert(qvariant_cast<Job*>(spy.at(i).at(0)));
+    QVERIFY(reported.contains(sub));
+    QVERIFY(reported.contains(leaf));
+
+    // the completion is reported immediately
+    leaf->completeWithProgress();
+    QVERIFY(spy.count() > 0);
+    QVERIFY(qvariant_cast<Job*>(spy.last().at(0)) == leaf);
+    QVERIFY(leaf->getProgress() == 1);
+
+    int before = spy.count();
+    top->cancel();
+    QVERIFY(spy.count() > before);
+    QVERIFY(leaf->isCancelled());
+
+    delete top;
+}
+
+void App::benchmarkJobProgress()
+{
+    QBENCHMARK {
+        Job* top = new Job("top");
+        Job* leaf = top;
+        for (int i = 0; i < 4; i++) {
+            leaf = leaf->newSubJob(1, "level " + QString::number(i));
+        }
+
+        const int N = 50000;
+        for (int i = 1; i <= N; i++) {
+            leaf->setProgress(((double) i) / N);
+            leaf->setTitle("file" + QString::number(i) + ".txt");
+        }
+        leaf->complete();
+
+        QVERIFY(top->getProgress() > 0.99);
+        delete top;
+    }
+}
+
+void App::testPackageVersionBinary()
+{
+    Repository rep;
+    QString err = loadRepository(&rep, QFINDTESTDATA("Rep.xml"));
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(rep.packageVersions.count() > 0);
+
+    for (int i = 0; i < rep.packageVersions.count(); i++) {
+        PackageVersion* pv = rep.packageVersions.at(i);
+
+        QByteArray data;
+        pv->toBinary(&data);
+        QVERIFY(static_cast<quint8>(data.at(0)) ==
+                PackageVersion::BINARY_FORMAT_VERSION);
+
+        QScopedPointer<PackageVersion> pv2(
+                PackageVersion::fromBinary(data, &err));
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QVERIFY(!pv2.isNull());
+        QCOMPARE(toXML(pv2.data()), toXML(pv));
+
+        // truncated data
+        QScopedPointer<PackageVersion> pv3(
+                PackageVersion::fromBinary(data.left(data.length() - 1),
+                &err));
+        QVERIFY(!err.isEmpty());
+        QVERIFY(pv3.isNull());
+    }
+
+    QByteArray unknown;
+    unknown.append(static_cast<char>(PackageVersion::BINARY_FORMAT_VERSION + 1));
+    QScopedPointer<PackageVersion> pv(PackageVersion::fromBinary(unknown, &err));
+    QVERIFY(!err.isEmpty());
+    QVERIFY(pv.isNull());
+}
+
+void App::benchmarkPackageVersionBinary()
+{
+    Repository rep;
+    QString err = loadRepository(&rep, QFINDTESTDATA("Rep.xml"));
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    QList<QByteArray> data;
+    for (int i = 0; i < rep.packageVersions.count(); i++) {
+        QByteArray d;
+        rep.packageVersions.at(i)->toBinary(&d);
+        data.append(d);
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < data.count(); i++) {
+            delete PackageVersion::fromBinary(data.at(i), &err);
+        }
+    }
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+}
+
+void App::benchmarkScanDisk()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString dir = WPMUtils::normalizePath(tempDir.path());
+
+    createDirectoryTree(dir, 10, 5);
+
+    QString target = dir + "\\3\\1\\4\\1\\5";
+    QVERIFY(QDir(target).mkdir("bin"));
+    QFile f(target + "\\bin\\test.exe");
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write("test");
+    f.close();
+    QString sha1 = WPMUtils::sha1(f.fileName());
+
+    // candidates that are never found
+    QList<PackageVersion*> pvs;
+    for (int i = 0; i < 1000; i++) {
+        pvs.append(createDetectFilePackageVersion(
+                QString("test.Missing%1").arg(i),
+                QString("file%1.exe").arg(i), sha1));
+    }
+    pvs.append(createDetectFilePackageVersion("test.Found",
+            "bin\\test.exe", sha1));
+
+    ScanDiskThirdPartyPM pm;
+    QList<InstalledPackageVersion*> installed;
+    QBENCHMARK_ONCE {
+        Job* job = new Job();
+        QSet<PackageVersion*> found;
+        pm.scanDirectory(job, dir, pvs, QStringList(), &installed, found);
+        QVERIFY(job->getErrorMessage().isEmpty());
+        delete job;
+    }
+
+    QVERIFY(installed.count() == 1);
+    QVERIFY(installed.at(0)->package == "test.Found");
+    QVERIFY(installed.at(0)->directory == target);
+
+    qDeleteAll(installed);
+    qDeleteAll(pvs);
+}
+
+void App::testScanDiskParallel()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString dir = WPMUtils::normalizePath(tempDir.path());
+
+    createDirectoryTree(dir, 4, 3);
+
+    // test.A can be detected in 2 directories. Only the first one in the
+    // order of the sequential scan is reported.
+    QString a = createFile(dir + "\\1\\2\\a.exe", "a");
+    createFile(dir + "\\3\\a.exe", "a");
+
+    // test.B is in a sub-directory of test.C and is not reported
+    QString c = createFile(dir + "\\2\\c.exe", "c");
+    QString b = createFile(dir + "\\2\\0\\b.exe", "b");
+
+    // test.A was already found in 1\2. The scan continues in the
+    // sub-directories of 3.
+    QString d = createFile(dir + "\\3\\1\\d.exe", "d");
+
+    // test.E and test.F are in the same directory. Only test.E is reported
+    // as e.exe comes first.
+    QString e = createFile(dir + "\\0\\3\\1\\e.exe", "e");
+    QString f = createFile(dir + "\\0\\3\\1\\f.exe", "f");
+
+    QList<PackageVersion*> pvs;
+    pvs.append(createDetectFilePackageVersion("test.A", "a.exe", a));
+    pvs.append(createDetectFilePackageVersion("test.B", "b.exe", b));
+    pvs.append(createDetectFilePackageVersion("test.C", "c.exe", c));
+    pvs.append(createDetectFilePackageVersion("test.D", "d.exe", d));
+    pvs.append(createDetectFilePackageVersion("test.F", "f.exe", f));
+    pvs.append(createDetectFilePackageVersion("test.E", "e.exe", e));
+    pvs.append(createDetectFilePackageVersion("test.Missing", "a.exe", b));
+
+    ScanDiskThirdPartyPM pm;
+
+    QList<InstalledPackageVersion*> sequential;
+    QSet<PackageVersion*> found;
+    Job* job = new Job();
+    pm.scanDirectory(job, dir, pvs, QStringList(), &sequential, found, 1);
+    QVERIFY(job->getErrorMessage().isEmpty());
+    delete job;
+
+    QVERIFY(sequential.count() == 4);
+    QVERIFY(sequential.at(0)->package == "test.E");
+    QVERIFY(sequential.at(0)->directory == dir + "\\0\\3\\1");
+    QVERIFY(sequential.at(1)->package == "test.A");
+    QVERIFY(sequential.at(1)->directory == dir + "\\1\\2");
+    QVERIFY(sequential.at(2)->package == "test.C");
+    QVERIFY(sequential.at(3)->package == "test.D");
+    QVERIFY(sequential.at(3)->directory == dir + "\\3\\1");
+    QVERIFY(found.count() == 4);
+
+    // package versions that were already found (e.g. on another drive) are
+    // not reported again
+    for (int threads = 1; threads <= 4; threads *= 4) {
+        QList<InstalledPackageVersion*> again;
+        job = new Job();
+        pm.scanDirectory(job, dir, pvs, QStringList(), &again, found,
+                threads);
+        QVERIFY(job->getErrorMessage().isEmpty());
+        delete job;
+        QVERIFY(again.count() == 0);
+    }
+
+    for (int threads = 2; threads <= 8; threads *= 2) {
+        QList<InstalledPackageVersion*> parallel;
+        QSet<PackageVersion*> parallelFound;
+        job = new Job();
+        pm.scanDirectory(job, dir, pvs, QStringList(), &parallel,
+                parallelFound, threads);
+        QVERIFY(job->getErrorMessage().isEmpty());
+        QVERIFY(fabs(job->getProgress() - 1) < 0.000001);
+        delete job;
+
+        QVERIFY(parallel.count() == sequential.count());
+        for (int i = 0; i < parallel.count(); i++) {
+            QVERIFY(parallel.at(i)->package == sequential.at(i)->package);
+            QVERIFY(parallel.at(i)->version == sequential.at(i)->version);
+            QVERIFY(parallel.at(i)->directory == sequential.at(i)->directory);
+        }
+        qDeleteAll(parallel);
+    }
+
+    // a cancelled scan does not report anything
+    for (int threads = 1; threads <= 4; threads *= 4) {
+        QList<InstalledPackageVersion*> cancelled;
+        QSet<PackageVersion*> cancelledFound;
+        job = new Job();
+        job->cancel();
+        pm.scanDirectory(job, dir, pvs, QStringList(), &cancelled,
+                cancelledFound, threads);
+        delete job;
+        QVERIFY(cancelled.count() == 0);
+    }
+
+    qDeleteAll(sequential);
+    qDeleteAll(pvs);
+}
+
+/**
+ * @brief creates an operation
+ * @param install true = install, false = uninstall
+ * @param package full package name. The version is always 1.0.
+ * @param where installation directory or ""
+ * @return [ownership:caller] new operation
+ */
+static InstallOperation* newOperation(bool install, const QString& package,
+        const QString& where)
+{
+    InstallOperation* op = new InstallOperation();
+    op->install = install;
+    op->package = package;
+    op->version = Version(1, 0);
+    op->where = where;
+    return op;
+}
+
+/**
+ * @brief processes operations and frees them
+ * @param rep repository
+ * @param ops operations
+ * @return error message
+ */
+static QString processOperations(AbstractRepository* rep,
+        const QList<InstallOperation*>& ops)
+{
+    Job* job = new Job();
+    rep->process(job, ops, WPMUtils::CLOSE_WINDOW, false, false);
+    QString err = job->getErrorMessage();
+    delete job;
+    qDeleteAll(ops);
+    return err;
+}
+
+void App::testProcess()
+{
+    // process() reads the package versions from the default database
+    QString err;
+    DefaultDatabaseScope scope("testProcess", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QString dir = WPMUtils::normalizePath(scope.tempDir.path());
+    QVERIFY(QDir(dir).mkdir("src"));
+    DBRepository* dbr = DBRepository::getDefault();
+
+    // one download at a time instead of PackageVersion::HTTP_CONNECTIONS
+    dbr->setMaxParallelDownloads(1);
+    QCOMPARE(dbr->getMaxParallelDownloads(), 1);
+
+    // the binary of the last package version has a wrong hash sum
+    QStringList packages;
+    for (int i = 0; i < 4; i++) {
+        QString file = dir + QString("\\src\\file%1.exe").arg(i);
+        QString sha1 = createFile(file,
+                QByteArray(100000 * (i + 1), (char) ('a' + i)));
+        QVERIFY(!sha1.isEmpty());
+
+        packages.append(QString("org.example.Process%1").arg(i));
+        scope.packages.append(packages.at(i));
+        PackageVersion pv(packages.at(i), Version(1, 0));
+        pv.type = 1;
+        pv.download = QUrl::fromLocalFile(file);
+        pv.sha1 = i == 3 ? "0000000000000000000000000000000000000000" : sha1;
+        err = dbr->savePackageVersion(&pv, true);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+    InstalledPackages* ip = InstalledPackages::getDefault();
+
+    // every package is installed as soon as its own binary is ready
+    QList<InstallOperation*> ops;
+    for (int i = 0; i < 3; i++)
+        ops.append(newOperation(true, packages.at(i),
+                dir + "\\install" + QString::number(i)));
+    err = processOperations(dbr, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(ip->isInstalled(packages.at(i), Version(1, 0)));
+        QFileInfo fi(dir + QString("\\install%1\\file%1.exe").arg(i));
+        QCOMPARE(fi.size(), (qint64) (100000 * (i + 1)));
+    }
+
+    // a package is only removed after all downloads succeeded
+    ops.clear();
+    ops.append(newOperation(false, packages.at(0), ""));
+    ops.append(newOperation(true, packages.at(3), dir + "\\install3"));
+    err = processOperations(dbr, ops);
+    QVERIFY(!err.isEmpty());
+    QVERIFY(ip->isInstalled(packages.at(0), Version(1, 0)));
+    QVERIFY(QFileInfo(dir + "\\install0\\file0.exe").exists());
+    QVERIFY(!ip->isInstalled(packages.at(3), Version(1, 0)));
+    QVERIFY(!QFileInfo(dir + "\\install3").exists());
+
+    ops.clear();
+    for (int i = 0; i < 3; i++)
+        ops.append(newOperation(false, packages.at(i), ""));
+    err = processOperations(dbr, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(!ip->isInstalled(packages.at(i), Version(1, 0)));
+        QVERIFY(!QFileInfo(dir + "\\install" + QString::number(i)).exists());
+    }
+}
+
+void App::testHashSumWriter()
+{
+    QByteArray data;
+    for (int i = 0; i < 100000; i++)
+        data.append((char) (i % 251));
+
+    QTemporaryFile f;
+    QVERIFY(f.open());
+
+    HashSumWriter writer(&f, true, QCryptographicHash::Sha1);
+    for (int i = 0; i < data.size(); i += 7000) {
+        QString err = writer.write(data.constData() + i,
+                qMin(7000, data.size() - i));
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+    f.close();
+
+    QString expected = QCryptographicHash::hash(data,
+            QCryptographicHash::Sha1).toHex().toLower();
+    QVERIFY(writer.getHashSum() == expected);
+    QVERIFY(WPMUtils::sha1(f.fileName()) == expected);
+
+    // no hash sum, no file
+    HashSumWriter empty(0, false, QCryptographicHash::Sha1);
+    QVERIFY(empty.write(data.constData(), data.size()).isEmpty());
+    QVERIFY(empty.getHashSum().isEmpty());
+}
+
+void App::testFileCache()
+{
+    QTemporaryDir dir;
+    QString cacheDir = QDir::toNativeSeparators(dir.path()) + "\\cache";
+    QString tmp = QDir::toNativeSeparators(dir.path()) + "\\download.tmp";
+
+    QString err;
+    {
+        FileCache cache(cacheDir, 2500);
+        err = cache.load();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QVERIFY(cache.count() == 0);
+
+        for (int i = 0; i < 3; i++) {
+            QVERIFY(!createFile(tmp, QByteArray(1000, 'x')).isEmpty());
+            err = cache.store(QString("http://www.example.com/%1.png").
+                    arg(i), tmp, ".png", QString("etag%1").arg(i), "");
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+            QVERIFY(!QFile::exists(tmp));
+            QTest::qSleep(20);
+        }
+
+        // the least recently used file was removed
+        QVERIFY(cache.count() == 2);
+        QVERIFY(cache.getSize() == 2000);
+        QVERIFY(cache.find("http://www.example.com/0.png") == 0);
+
+        const FileCache::Entry* e = cache.find(
+                "http://www.example.com/1.png");
+        QVERIFY(e != 0);
+        QVERIFY(e->eTag == "etag1");
+        QVERIFY(e->file == FileCache::getFileName(
+                "http://www.example.com/1.png") + ".png");
+        QVERIFY(QFile::exists(cacheDir + "\\" + e->file));
+        QTest::qSleep(20);
+
+        // "1.png" was used more recently than "2.png"
+        QVERIFY(!createFile(tmp, QByteArray(1000, 'x')).isEmpty());
+        err = cache.store("http://www.example.com/3.png", tmp, ".png",
+                "", "");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QVERIFY(cache.find("http://www.example.com/1.png") != 0);
+        QVERIFY(cache.find("http://www.example.com/2.png") == 0);
+
+        // files that are not in the index and older than the index
+        QVERIFY(!createFile(cacheDir + "\\unknown.png",
+                QByteArray(10, 'x')).isEmpty());
+        QTest::qSleep(50);
+
+        err = cache.save();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+
+    // a download in progress and a file stored by another instance after
+    // the index was written
+    QTest::qSleep(50);
+    QVERIFY(!createFile(cacheDir + "\\1234_1.tmp",
+            QByteArray(10, 'x')).isEmpty());
+    QVERIFY(!createFile(cacheDir + "\\other.png",
+            QByteArray(10, 'x')).isEmpty());
+
+    FileCache cache(cacheDir, 2500);
+    err = cache.load();
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(cache.count() == 2);
+    QVERIFY(cache.getSize() == 2000);
+    QVERIFY(!QFile::exists(cacheDir + "\\unknown.png"));
+    QVERIFY(QFile::exists(cacheDir + "\\1234_1.tmp"));
+    QVERIFY(QFile::exists(cacheDir + "\\other.png"));
+
+    const FileCache::Entry* e = cache.find("http://www.example.com/1.png");
+    QVERIFY(e != 0);
+    QVERIFY(e->eTag == "etag1");
+    QVERIFY(e->validated.isValid());
+    QVERIFY(cache.find("http://www.example.com/3.png") != 0);
+}
+
+void App::testDownloadNotModified()
+{
+    QTemporaryDir dir;
+    QString source = QDir::toNativeSeparators(dir.path()) + "\\image.png";
+    QVERIFY(!createFile(source, QByteArray(100, 'x')).isEmpty());
+
+    QTemporaryFile f;
+    QVERIFY(f.open());
+
+    Job* job = new Job();
+    Downloader::Request request(QUrl::fromLocalFile(source));
+    request.file = &f;
+    Downloader::Response response = Downloader::download(job, request);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    QVERIFY(!response.notModified);
+    QVERIFY(!response.lastModified.isEmpty());
+    QVERIFY(f.size() == 100);
+    delete job;
+
+    // the file was not changed
+    QVERIFY(f.resize(0));
+    QVERIFY(f.seek(0));
+    job = new Job();
+    request.ifModifiedSince = response.lastModified;
+    Downloader::Response response2 = Downloader::download(job, request);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    QVERIFY(job->isCompleted());
+    QVERIFY(response2.notModified);
+    QVERIFY(f.size() == 0);
+    delete job;
+
+    // the file was changed
+    job = new Job();
+    request.ifModifiedSince = "Sun, 06 Nov 1994 08:49:37 GMT";
+    Downloader::Response response3 = Downloader::download(job, request);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    QVERIFY(!response3.notModified);
+    QVERIFY(f.size() == 100);
+    delete job;
+}
+
+/**
+ * @brief searches for packages without an index the same way as
+ *     DBRepository::findPackages
+ * @param packages all packages
+ * @param query search query
+ * @return names of the found packages sorted alphabetically
+ */
+static QStringList findPackagesSlow(const QList<Package*>& packages,
+        const QString& query)
+{
+    QStringList keywords = query.toLower().simplified().split(" ",
+            QString::SkipEmptyParts);
+
+    QStringList r;
+    for (int i = 0; i < packages.count(); i++) {
+        Package* p = packages.at(i);
+        QString fulltext = (p->title + " " + p->description + " " +
+                p->name).toLower();
+        bool found = true;
+        for (int j = 0; j < keywords.count(); j++) {
+            QString kw = keywords.at(j);
+            if (kw.length() > 1 && !fulltext.contains(kw)) {
+                found = false;
+                break;
+            }
+        }
+        if (found)
+            r.append(p->name);
+    }
+    r.sort();
+
+    return r;
+}
+
+void App::testFindPackages()
+{
+    QString err;
+    TestDatabase t("testFindPackages", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    QList<Package*> packages;
+    Package* p = new Package("org.example.Notepad", "Notepad++");
+    p->description = "Text editor";
+    packages.append(p);
+    p = new Package("com.foo.Editor", "Super Editor");
+    p->description = "Edit text files with Notepad compatibility";
+    packages.append(p);
+    p = new Package("net.bar.Paint", "Paint");
+    p->description = "Image editing with internationalization";
+    packages.append(p);
+
+    for (int i = 0; i < packages.count(); i++) {
+        err = dbr.savePackage(packages.at(i), true);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+
+    QStringList queries;
+    queries << "notepad" << "edit" << "ditin" << "TEXT  edit" << "paint" <<
+            "foo.ed" << "nternationalizatio" << "internationalizationx" <<
+            "s e" << "xyz" << "";
+    for (int i = 0; i < queries.count(); i++) {
+        QStringList found = dbr.findPackages(Package::NOT_INSTALLED,
+                Package::NOT_INSTALLED, queries.at(i), -1, -1, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        found.sort();
+        QVERIFY2(found == findPackagesSlow(packages, queries.at(i)),
+                qPrintable(queries.at(i)));
+    }
+
+    // matches in the title are sorted first
+    QStringList found = dbr.findPackages(Package::NOT_INSTALLED,
+            Package::NOT_INSTALLED, "edit", -1, -1, &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(found, QStringList() << "com.foo.Editor" <<
+            "org.example.Notepad" << "net.bar.Paint");
+
+    // the index is updated if a package changes
+    packages.at(0)->title = "Writer";
+    err = dbr.savePackage(packages.at(0), true);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    found = dbr.findPackages(Package::NOT_INSTALLED,
+            Package::NOT_INSTALLED, "++", -1, -1, &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(found.isEmpty());
+    found = dbr.findPackages(Package::NOT_INSTALLED,
+            Package::NOT_INSTALLED, "writer", -1, -1, &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(found, QStringList() << "org.example.Notepad");
+
+    qDeleteAll(packages);
+}
+
+void App::benchmarkFindPackages()
+{
+    QString err;
+    TestDatabase t("benchmarkFindPackages", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    QSqlDatabase db = QSqlDatabase::database("benchmarkFindPackages");
+    db.exec("BEGIN TRANSACTION");
+    for (int i = 0; i < 20000; i++) {
+        QString n = QString::number(i);
+        Package p("org.example.Program" + n, "Program " + n);
+        p.description = "Tool number " + n + " for editing text files. "
+                "Version " + QString::number(i % 97) + " for " +
+                QString::number(i % 13) + " platforms";
+        err = dbr.savePackage(&p, true);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+    db.exec("COMMIT");
+
+    QStringList found;
+    QBENCHMARK {
+        found = dbr.findPackages(Package::NOT_INSTALLED,
+                Package::NOT_INSTALLED, "program 1234", -1, -1, &err);
+    }
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(found.count(), 12);
+}
+
+void App::testPackageVersionSummaries()
+{
+    QString err;
+    TestDatabase t("testPackageVersionSummaries", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    // package i has the versions 1.0 ... (i % 3 + 1).0. The version 2.0 has
+    // no download URL.
+    QStringList names;
+    int expected = 0;
+    for (int i = 0; i < 120 && err.isEmpty(); i++) {
+        QString name = "org.example.S" + QString::number(i);
+        names.append(name);
+        for (int v = 1; v <= i % 3 + 1 && err.isEmpty(); v++) {
+            PackageVersion pv(name, Version(v, 0));
+            if (v != 2)
+                pv.download = QUrl("http://example.org/" + name + "-" +
+                        QString::number(v) + ".zip");
+            err = dbr.savePackageVersion(&pv, true);
+            expected++;
+        }
+    }
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    // more than one block of names including unknown packages
+    for (int i = 0; i < 30; i++) {
+        names.append("org.example.Unknown" + QString::number(i));
+    }
+
+    QList<PackageVersion*> pvs = dbr.getPackageVersionSummaries(names, &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(pvs.count(), expected);
+
+    QSet<QString> seen;
+    for (int i = 0; i < pvs.count(); i++) {
+        PackageVersion* pv = pvs.at(i);
+        if (i == 0 || pvs.at(i - 1)->package != pv->package) {
+            // the versions of a package follow each other
+            QVERIFY(!seen.contains(pv->package));
+            seen.insert(pv->package);
+        } else {
+            QVERIFY(pvs.at(i - 1)->version.compare(pv->version) > 0);
+        }
+
+        QCOMPARE(pv->download.isValid(), pv->version != Version(2, 0));
+    }
+    QCOMPARE(seen.count(), 120);
+
+    qDeleteAll(pvs);
+}
+
+void App::testPackageVersionContent()
+{
+    QString err;
+    TestDatabase t("testPackageVersionContent", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    PackageVersion pv("org.example.Content", Version(1, 2));
+    pv.download = QUrl("http://example.org/content.zip");
+    pv.cmdFiles.append("bin\\content.exe");
+    err = dbr.savePackageVersion(&pv, true);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    // older versions of Npackd parse CONTENT as XML
+    QSqlDatabase db = QSqlDatabase::database("testPackageVersionContent");
+    QSqlQuery q = db.exec("SELECT CONTENT, CONTENT_BIN FROM PACKAGE_VERSION");
+    QVERIFY(q.next());
+    QVERIFY(q.value(0).toByteArray().startsWith('<'));
+    QVERIFY(!q.value(1).isNull());
+    q.finish();
+
+    // a row written by an older version of Npackd
+    db.exec("UPDATE PACKAGE_VERSION SET CONTENT_BIN = NULL");
+    QScopedPointer<PackageVersion> found(dbr.findPackageVersion_(
+            "org.example.Content", Version(1, 2), &err));
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(found);
+    QCOMPARE(found->download, pv.download);
+    QCOMPARE(found->cmdFiles, pv.cmdFiles);
+}
+
+/**
+ * @brief creates a repository with one version 1.0 for each package
+ * @param packages package names
+ * @param titles package titles
+ * @param tag will be added to the download URLs
+ * @return closed temporary file or 0 if it cannot be created
+ */
+static QTemporaryFile* createRepositoryFile(const QStringList& packages,
+        const QStringList& titles, const QString& tag)
+{
+    QByteArray r;
+    r.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<root>\n"
+            "<spec-version>3</spec-version>\n");
+    for (int i = 0; i < packages.count(); i++) {
+        r.append("<package name=\"" + packages.at(i).toUtf8() + "\">\n"
+                "<title>" + titles.at(i).toUtf8() + "</title>\n"
+                "</package>\n");
+        r.append("<version name=\"1.0\" package=\"" +
+                packages.at(i).toUtf8() + "\" type=\"one-file\">\n"
+                "<url>http://www.example.com/" + tag.toUtf8() + "/" +
+                packages.at(i).toUtf8() + ".exe</url>\n"
+                "</version>\n");
+    }
+    r.append("</root>\n");
+
+    QTemporaryFile* f = new QTemporaryFile();
+    if (!f->open() || f->write(r) != r.length()) {
+        delete f;
+        f = 0;
+    } else {
+        f->close();
+    }
+    return f;
+}
+
+/**
+ * @brief title of a package in the database
+ * @param dbr database
+ * @param package package name
+ * @return title or an empty string if the package does not exist
+ */
+static QString packageTitle(DBRepository* dbr, const QString& package)
+{
+    QString r;
+    Package* p = dbr->findPackage_(package);
+    if (p)
+        r = p->title;
+    delete p;
+    return r;
+}
+
+/**
+ * @brief download URL of the version 1.0 of a package in the database
+ * @param dbr database
+ * @param package package name
+ * @return URL or an empty string if the package version does not exist
+ */
+static QString versionURL(DBRepository* dbr, const QString& package)
+{
+    QString err;
+    QString r;
+    PackageVersion* pv = dbr->findPackageVersion_(package, Version(1, 0),
+            &err);
+    if (pv)
+        r = pv->download.toString();
+    delete pv;
+    return r;
+}
+
+void App::testUpdateRepositories()
+{
+    QString err;
+    TestDatabase t("testUpdateRepositories", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    QList<QUrl*> urls;
+    urls.append(new QUrl("file:///C:/repository1.xml"));
+    urls.append(new QUrl("file:///C:/repository2.xml"));
+    err = dbr.saveRepositories(QStringList() <<
+            urls.at(0)->toString(QUrl::FullyEncoded) <<
+            urls.at(1)->toString(QUrl::FullyEncoded));
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    const QString a("org.example.A"), b("org.example.B"),
+            d("org.example.D"), s("org.example.S");
+
+    // 1. the package S is defined in both repositories. The first one wins.
+    QList<QTemporaryFile*> files;
+    files.append(createRepositoryFile(QStringList() << a << s,
+            QStringList() << "A" << "S from 1", "rep1"));
+    files.append(createRepositoryFile(QStringList() << b << s << d,
+            QStringList() << "B" << "S from 2" << "D", "rep2"));
+    QVERIFY(files.at(0) && files.at(1));
+
+    QSet<QString> packages;
+    Job* job = new Job();
+    dbr.updateRepositories(job, urls, files, &packages);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    delete job;
+
+    QCOMPARE(packageTitle(&dbr, a), QString("A"));
+    QCOMPARE(packageTitle(&dbr, b), QString("B"));
+    QCOMPARE(packageTitle(&dbr, d), QString("D"));
+    QCOMPARE(packageTitle(&dbr, s), QString("S from 1"));
+    QCOMPARE(versionURL(&dbr, s),
+            QString("http://www.example.com/rep1/org.example.S.exe"));
+    QCOMPARE(versionURL(&dbr, d),
+            QString("http://www.example.com/rep2/org.example.D.exe"));
+
+    // a detected package
+    dbr.currentRepository = DBRepository::DETECTION_REPOSITORY;
+    Package detected("org.example.Detected", "Detected");
+    err = dbr.savePackage(&detected, true);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    PackageVersion detectedVersion("org.example.Detected", Version(1, 0));
+    err = dbr.savePackageVersion(&detectedVersion, true);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(packageTitle(&dbr, "org.example.Detected"), QString("Detected"));
+
+    // 2. the first repository did not change. B changed and D was removed
+    // from the second one.
+    delete files.takeLast();
+    files.append(createRepositoryFile(QStringList() << b << s,
+            QStringList() << "B changed" << "S from 2", "rep2b"));
+    QVERIFY(files.at(1));
+
+    packages.clear();
+    job = new Job();
+    dbr.updateRepositories(job, urls, files, &packages);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    delete job;
+
+    QCOMPARE(packageTitle(&dbr, a), QString("A"));
+    QCOMPARE(packageTitle(&dbr, b), QString("B changed"));
+    QCOMPARE(versionURL(&dbr, b),
+            QString("http://www.example.com/rep2b/org.example.B.exe"));
+    QCOMPARE(packageTitle(&dbr, d), QString());
+    QCOMPARE(versionURL(&dbr, d), QString());
+    QCOMPARE(packageTitle(&dbr, s), QString("S from 1"));
+    QCOMPARE(versionURL(&dbr, s),
+            QString("http://www.example.com/rep1/org.example.S.exe"));
+    QCOMPARE(packageTitle(&dbr, "org.example.Detected"), QString());
+    QCOMPARE(versionURL(&dbr, "org.example.Detected"), QString());
+    QVERIFY(packages.contains(b));
+    QVERIFY(packages.contains(d));
+    QVERIFY(packages.contains("org.example.Detected"));
+
+    // 3. S was removed from the first repository. The unchanged second
+    // repository has to be reloaded for S to reappear.
+    delete files.takeFirst();
+    files.prepend(createRepositoryFile(QStringList() << a,
+            QStringList() << "A", "rep1"));
+    QVERIFY(files.at(0));
+
+    packages.clear();
+    job = new Job();
+    dbr.updateRepositories(job, urls, files, &packages);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    delete job;
+
+    QCOMPARE(packageTitle(&dbr, a), QString("A"));
+    QCOMPARE(packageTitle(&dbr, b), QString("B changed"));
+    QCOMPARE(packageTitle(&dbr, s), QString("S from 2"));
+    QCOMPARE(versionURL(&dbr, s),
+            QString("http://www.example.com/rep2b/org.example.S.exe"));
+    QVERIFY(packages.contains(s));
+
+    qDeleteAll(files);
+    qDeleteAll(urls);
+}
+
+/**
+ * @brief saves package versions in a repository
+ * @param rep target repository
+ * @param n number of package versions
+ * @return error message from the first failed save
+ */
+static QString savePackageVersions(AbstractRepository* rep, int n)
+{
+    QString err;
+    for (int i = 0; i < n && err.isEmpty(); i++) {
+        PackageVersion pv("org.example.Test", Version(1, i));
+        err = rep->savePackageVersion(&pv, false);
+    }
+    return err;
+}
+
+/**
+ * @brief saves package versions in a queue and closes it
+ * @param queue target queue
+ * @param n number of package versions
+ * @return error message from the first failed save
+ */
+static QString fillRepositoryQueue(RepositoryQueue* queue, int n)
+{
+    QString err = savePackageVersions(queue, n);
+    queue->close();
+    return err;
+}
+
+void App::testRepositoryQueue()
+{
+    // all objects arrive in the same order although the queue is small
+    RepositoryQueue queue(10);
+    QFuture<QString> future = QtConcurrent::run(fillRepositoryQueue, &queue,
+            5000);
+    Repository rep;
+    QString err = queue.writeTo(&rep);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY2(future.result().isEmpty(), qPrintable(future.result()));
+    QCOMPARE(rep.packageVersions.count(), 5000);
+    for (int i = 0; i < rep.packageVersions.count(); i++) {
+        QVERIFY(rep.packageVersions.at(i)->version == Version(1, i));
+    }
+
+    // a blocked parser is released by abort()
+    RepositoryQueue queue2(10);
+    QFuture<QString> future2 = QtConcurrent::run(savePackageVersions,
+            static_cast<AbstractRepository*>(&queue2), 5000);
+    queue2.abort("Cancelled");
+    QCOMPARE(future2.result(), QString("Cancelled"));
+}
+
+/**
+ * @brief adds a dependency on the versions [1, 3) of a package
+ * @param pv package version
+ * @param package full package name
+ */
+static void addDependency(PackageVersion* pv, const QString& package)
+{
+    Dependency* d = new Dependency();
+    d->package = package;
+    d->setVersions("[1, 3)");
+    pv->dependencies.append(d);
+}
+
+/**
+ * @brief saves a generated dependency graph. The package Pi depends on
+ *     P((i-1)/2) and P((i-1)/3). Each package has the versions 1 and 2. The
+ *     version 2 also depends on a package that does not exist and cannot be
+ *     installed.
+ * @param dbr target repository
+ * @param n number of packages
+ * @return error message
+ */
+static QString saveDependencyGraph(DBRepository* dbr, int n)
+{
+    QString err;
+    for (int i = 0; i < n && err.isEmpty(); i++) {
+        QString name = "org.example.P" + QString::number(i);
+        Package p(name, name);
+        err = dbr->savePackage(&p, true);
+
+        for (int v = 1; v <= 2 && err.isEmpty(); v++) {
+            PackageVersion pv(name, Version(v, 0));
+            pv.download = QUrl("http://example.org/" + name + "-" +
+                    QString::number(v) + ".zip");
+            if (i > 0) {
+                addDependency(&pv, "org.example.P" + QString::number((i - 1) / 2));
+                if ((i - 1) / 3 != (i - 1) / 2)
+                    addDependency(&pv, "org.example.P" +
+                            QString::number((i - 1) / 3));
+            }
+            if (v == 2)
+                addDependency(&pv, "org.example.Missing");
+            err = dbr->savePackageVersion(&pv, true);
+        }
+    }
+    return err;
+}
+
+void App::testDependencyResolver()
+{
+    QString err;
+    TestDatabase t("testDependencyResolver", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    err = saveDependencyGraph(&dbr, 20);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    // P19 needs P0, P1, P2, P4, P6 and P9
+    PackageVersion app("org.example.App", Version(1, 0));
+    addDependency(&app, "org.example.P19");
+
+    InstalledPackages installed;
+    QList<InstallOperation*> ops;
+    QList<PackageVersion*> avoid;
+    DependencyResolver resolver(&dbr, &installed);
+    err = resolver.planInstallation(&app, ops, avoid, "");
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    QSet<QString> expected;
+    expected << "org.example.P0" << "org.example.P1" << "org.example.P2" <<
+            "org.example.P4" << "org.example.P6" << "org.example.P9" <<
+            "org.example.P19";
+    QCOMPARE(ops.count(), expected.count() + 1);
+    for (int i = 0; i < ops.count() - 1; i++) {
+        InstallOperation* op = ops.at(i);
+        QVERIFY(op->install);
+        QVERIFY(expected.contains(op->package));
+        QVERIFY(op->version == Version(1, 0));
+        QVERIFY(installed.isInstalled(op->package, op->version));
+    }
+    QCOMPARE(ops.last()->package, QString("org.example.App"));
+    QVERIFY(ops.at(ops.count() - 2)->package == "org.example.P19");
+
+    qDeleteAll(ops);
+    qDeleteAll(avoid);
+}
+
+void App::benchmarkDependencyResolver()
+{
+    QString err;
+    TestDatabase t("benchmarkDependencyResolver", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository& dbr = t.dbr;
+
+    QSqlDatabase db = QSqlDatabase::database("benchmarkDependencyResolver");
+    db.exec("BEGIN TRANSACTION");
+    err = saveDependencyGraph(&dbr, 3000);
+    db.exec("COMMIT");
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    PackageVersion app("org.example.App", Version(1, 0));
+    for (int i = 2950; i < 3000; i++) {
+        addDependency(&app, "org.example.P" + QString::number(i));
+    }
+
+    QBENCHMARK {
+        InstalledPackages installed;
+        QList<InstallOperation*> ops;
+        QList<PackageVersion*> avoid;
+        DependencyResolver resolver(&dbr, &installed);
+        err = resolver.planInstallation(&app, ops, avoid, "");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QVERIFY(ops.count() > 50);
+        qDeleteAll(ops);
+        qDeleteAll(avoid);
+    }
+}
+
+void App::testPlanUninstallation()
+{
+    // planUninstallation() reads the dependencies from the default database
+    QString err;
+    DefaultDatabaseScope scope("testPlanUninstallation", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    DBRepository* dbr = DBRepository::getDefault();
+
+    // A needs B in [1, 3). B 1, 2 and 3 are installed.
+    PackageVersion a("org.example.A", Version(1, 0));
+    addDependency(&a, "org.example.B");
+    err = dbr->savePackageVersion(&a, true);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    InstalledPackages installed;
+    err = installed.setPackageVersionPath("org.example.A", Version(1, 0),
+            "C:\\NpackdTest\\A", false);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    for (int i = 1; i <= 3; i++) {
+        err = installed.setPackageVersionPath("org.example.B", Version(i, 0),
+                "C:\\NpackdTest\\B" + QString::number(i), false);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+
+    // B 2 still satisfies the dependency
+    PackageVersion b1("org.example.B", Version(1, 0));
+    QList<InstallOperation*> ops;
+    err = b1.planUninstallation(installed, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(ops.count(), 1);
+    QVERIFY(!ops.at(0)->install);
+    QCOMPARE(ops.at(0)->package, QString("org.example.B"));
+    QVERIFY(ops.at(0)->version == Version(1, 0));
+    QVERIFY(installed.isInstalled("org.example.A", Version(1, 0)));
+    qDeleteAll(ops);
+    ops.clear();
+
+    // B 3 does not satisfy the dependency. A is removed first.
+    PackageVersion b2("org.example.B", Version(2, 0));
+    err = b2.planUninstallation(installed, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(ops.count(), 2);
+    QCOMPARE(ops.at(0)->package, QString("org.example.A"));
+    QVERIFY(!ops.at(0)->install);
+    QCOMPARE(ops.at(1)->package, QString("org.example.B"));
+    QVERIFY(ops.at(1)->version == Version(2, 0));
+    QVERIFY(!installed.isInstalled("org.example.A", Version(1, 0)));
+    QVERIFY(installed.isInstalled("org.example.B", Version(3, 0)));
+    qDeleteAll(ops);
+}
+
+/**
+ * @brief creates a repository XML
+ * @param n number of package versions. One package is created for 10
+ *     package versions.
+ * @return XML
+ */
+static QByteArray createRepositoryXML(int n)
+{
+    QByteArray r;
+    r.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<root>\n"
+            "<spec-version>3</spec-version>\n");
+    for (int i = 0; i < n / 10; i++) {
+        QByteArray id = QByteArray::number(i);
+        r.append("<package name=\"org.example.Program" + id + "\">\n"
+                "<title>Program " + id + "</title>\n"
+                "<description>Tool number " + id + " for editing text files"
+                "</description>\n"
+                "<category>Development/Tools</category>\n"
+                "<link rel=\"homepage\" href=\"http://www.example.com/" + id +
+                "\"/>\n"
+                "</package>\n");
+    }
+    for (int i = 0; i < n; i++) {
+        QByteArray id = QByteArray::number(i);
+        r.append("<version name=\"1." + id + "\" "
+                "package=\"org.example.Program" + QByteArray::number(i / 10) +
+                "\" type=\"one-file\">\n"
+                "<important-file path=\"program.exe\" title=\"Program\"/>\n"
+                "<cmd-file path=\"bin\\program.exe\"/>\n"
+                "<file path=\".Npackd\\Install.bat\">echo &quot;" + id +
+                "&quot;</file>\n"
+                "<url>http://www.example.com/program-" + id + ".exe</url>\n"
+                "<sha1>a94a8fe5ccb19ba61c4c8bd73f6f21ae0f0b4f1d</sha1>\n"
+                "<dependency package=\"com.microsoft.Windows\" "
+                "versions=\"[6.1, 100)\"/>\n"
+                "</version>\n");
+    }
+    r.append("</root>\n");
+    return r;
+}
+
+void App::benchmarkRepositoryXMLHandler()
+{
+    QByteArray xml = createRepositoryXML(20000);
+
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        Repository rep;
+        timer.start();
+        RepositoryXMLHandler handler(&rep, QUrl());
+        QXmlStreamReader reader(xml);
+        QVERIFY2(handler.parse(&reader), qPrintable(handler.errorString()));
+        elapsed = timer.elapsed();
+        QCOMPARE(rep.packageVersions.count(), 20000);
+        QCOMPARE(rep.packages.count(), 2000);
+    }
+
+    qDebug() << "Throughput:" <<
+            xml.length() / 1048576.0 * 1000 / qMax(elapsed, Q_INT64_C(1)) <<
+            "MB/s";
+}
+
+/**
+ * @brief adds the rows for the Version benchmarks
+ */
+static void addVersionBenchmarkRows()
+{
+    QTest::addColumn<QString>("version");
+
+    QTest::newRow("2 parts") << QString("1.22");
+    QTest::newRow("4 parts") << QString("1.22.3.4567");
+    QTest::newRow("6 parts") << QString("1.22.3.4567.0.0");
+}
+
+void App::benchmarkVersionParse_data()
+{
+    addVersionBenchmarkRows();
+}
+
+void App::benchmarkVersionParse()
+{
+    QFETCH(QString, version);
+
+    Version v;
+    QBENCHMARK {
+        for (int i = 0; i < 100000; i++) {
+            v.setVersion(version);
+        }
+    }
+}
+
+void App::benchmarkVersionCompare_data()
+{
+    addVersionBenchmarkRows();
+}
+
+void App::benchmarkVersionCompare()
+{
+    QFETCH(QString, version);
+
+    Version a;
+    a.setVersion(version);
+    Version b = a;
+    b.prepend(0);
+
+    int r = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 100000; i++) {
+            r += a.compare(b);
+        }
+    }
+    QVERIFY(r > 0);
+}
+
+void App::benchmarkVersionNormalize_data()
+{
+    addVersionBenchmarkRows();
+}
+
+void App::benchmarkVersionNormalize()
+{
+    QFETCH(QString, version);
+
+    Version a;
+    a.setVersion(version);
+
+    QBENCHMARK {
+        for (int i = 0; i < 100000; i++) {
+            Version v = a;
+            v.normalize();
+        }
+    }
+}
+
+void App::benchmarkUnzip_data()
+{
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("ideal thread count") << 0;
+}
+
+void App::benchmarkUnzip()
+{
+    QFETCH(int, threads);
+
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString dir = WPMUtils::normalizePath(tempDir.path());
+
+    QString zipfile = dir + "\\test.zip";
+    QVERIFY(createZipFile(zipfile, 50000));
+
+    QString odir = dir + "\\out";
+    QBENCHMARK_ONCE {
+        Job* job = new Job();
+        WPMUtils::unzip(job, zipfile, odir, threads);
+        QVERIFY2(job->getErrorMessage().isEmpty(),
+                qPrintable(job->getErrorMessage()));
+        delete job;
+    }
+
+    QVERIFY(QFileInfo(odir + "\\dir0\\sub0\\file0.txt").size() == 100);
+    QVERIFY(QFileInfo(odir + "\\dir49\\sub9\\file49999.txt").size() ==
+            100 + 999);
+    QVERIFY(QDir(odir + "\\dir49\\sub9").entryList(QDir::Files).count() ==
+            100);
+}
@@ -26,15 +26,159 @@ private slots:
      */
     void test();
 
+    /**
+     * Tests for Version::toSortKey
+     */
+    void testVersionSortKey();
+
     /**
      * Tests for InstalledPackages
      */
     void testInstalledPackages();
 
+    /**
+     * Tests for InstalledPackages::findOwner
+     */
+    void testFindOwner();
+
+    /**
+     * Tests for InstalledPackagesSnapshot
+     */
+    void testInstalledPackagesSnapshot();
+
+    /**
+     * Benchmark for InstalledPackages with many concurrent readers during a
+     * refresh
+     */
+    void benchmarkInstalledPackagesReaders_data();
+    void benchmarkInstalledPackagesReaders();
+
     /**
      * Tests for CommandLine
      */
     void testCommandLine();
+
+    /**
+     * Tests for the progress reporting in Job
+     */
+    void testJobProgress();
+
+    /**
+     * Benchmark for Job::setProgress and Job::setTitle with 50000 steps in a
+     * job tree with 5 levels
+     */
+    void benchmarkJobProgress();
+
+    /**
+     * Tests for PackageVersion::toBinary and PackageVersion::fromBinary
+     */
+    void testPackageVersionBinary();
+
+    /**
+     * Benchmark for PackageVersion::fromBinary
+     */
+    void benchmarkPackageVersionBinary();
+
+    /**
+     * Benchmark for ScanDiskThirdPartyPM on a directory tree with 111110
+     * directories
+     */
+    void benchmarkScanDisk();
+
+    /**
+     * Tests for the parallel scan in ScanDiskThirdPartyPM
+     */
+    void testScanDiskParallel();
+
+    /**
+     * Tests for AbstractRepository::process
+     */
+    void testProcess();
+
+    /**
+     * Tests for HashSumWriter
+     */
+    void testHashSumWriter();
+
+    /**
+     * Tests for FileCache
+     */
+    void testFileCache();
+
+    /**
+     * Tests for conditional requests in Downloader::download
+     */
+    void testDownloadNotModified();
+
+    /**
+     * Tests for the full text search in DBRepository::findPackages
+     */
+    void testFindPackages();
+
+    /**
+     * Benchmark for DBRepository::findPackages with 20000 packages
+     */
+    void benchmarkFindPackages();
+
+    /**
+     * Tests for DBRepository::getPackageVersionSummaries
+     */
+    void testPackageVersionSummaries();
+
+    /**
+     * Tests for PACKAGE_VERSION.CONTENT and CONTENT_BIN
+     */
+    void testPackageVersionContent();
+
+    /**
+     * Tests for DBRepository::updateRepositories
+     */
+    void testUpdateRepositories();
+
+    /**
+     * Tests for RepositoryQueue
+     */
+    void testRepositoryQueue();
+
+    /**
+     * Tests for DependencyResolver
+     */
+    void testDependencyResolver();
+
+    /**
+     * Benchmark for DependencyResolver with a generated dependency graph of
+     * 3000 packages
+     */
+    void benchmarkDependencyResolver();
+
+    /**
+     * Tests for PackageVersion::planUninstallation with a dependency that is
+     * satisfied by several installed versions
+     */
+    void testPlanUninstallation();
+
+    /**
+     * Benchmark for RepositoryXMLHandler with 20000 package versions. The
+     * throughput is printed in MB/s.
+     */
+    void benchmarkRepositoryXMLHandler();
+
+    /**
+     * Benchmarks for Version::setVersion, Version::compare and
+     * Version::normalize with 100000 calls each
+     */
+    void benchmarkVersionParse_data();
+    void benchmarkVersionParse();
+    void benchmarkVersionCompare_data();
+    void benchmarkVersionCompare();
+    void benchmarkVersionNormalize_data();
+    void benchmarkVersionNormalize();
+
+    /**
+     * Benchmark for WPMUtils::unzip with a ZIP file with 50000 entries
+     */
+    void benchmarkUnzip_data();
+    void benchmarkUnzip();
 };
 
 #endif // APP_H
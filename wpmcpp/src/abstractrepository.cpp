@@ -1,4 +1,9 @@
 #include <QDebug>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "abstractrepository.h"
 #include "wpmutils.h"
@@ -6,6 +11,332 @@
 #include "installedpackages.h"
 #include "downloader.h"
 
+/**
+ * @brief PackageVersion::download_ for a thread from a thread pool. Calls
+ *     CoInitialize/CoUninitialize.
+ * @param pv package version
+ * @param job job
+ * @param where a non-existing directory for the package
+ * @param interactive true = allow the interaction with the user
+ * @return see PackageVersion::download_
+ */
+static QString downloadWithCoInitialize(PackageVersion* pv, Job* job,
+        const QString& where, bool interactive)
+{
+    CoInitialize(NULL);
+    QString binary = pv->download_(job, where, interactive);
+    CoUninitialize();
+    return binary;
+}
+
+/**
+ * @brief downloads, checks and extracts package binaries in a thread pool
+ *     (see PackageVersion::download_)
+ */
+class PackageDownloads
+{
+    Job* job;
+    QThreadPool pool;
+
+    /** sub-jobs for the downloads or 0 if nothing is downloaded */
+    QList<Job*> subs;
+
+    /** number of started downloads */
+    int n;
+
+    /** protects binaries, finished and nFinished */
+    mutable QMutex mutex;
+
+    /** signalled each time a download is finished */
+    QWaitCondition downloadFinished;
+
+    /** results of PackageVersion::download_ */
+    QStringList binaries;
+
+    /** true = the download is finished or was never started */
+    QList<bool> finished;
+
+    /** number of finished downloads */
+    int nFinished;
+
+    /** started in start() */
+    QElapsedTimer timer;
+
+    /**
+     * @brief downloads one binary and signals downloadFinished
+     * @param downloads the downloads
+     * @param index index of the package version
+     * @param pv package version
+     * @param where a non-existing directory for the package
+     * @param interactive true = allow the interaction with the user
+     */
+    static void download(PackageDownloads* downloads, int index,
+            PackageVersion* pv, const QString& where, bool interactive);
+
+    /**
+     * @param index index of a package version or -1 for all downloads
+     * @return true if the download(s) are finished or were never started.
+     *     The mutex should be locked.
+     */
+    bool isFinishedLocked(int index) const;
+public:
+    /**
+     * @param job job for all downloads. The progress is only updated in
+     *     update().
+     * @param threads maximum number of parallel downloads
+     */
+    PackageDownloads(Job* job, int threads);
+
+    /**
+     * @brief starts the downloads. This method can only be called once.
+     * @param pvs package versions. The objects should not be freed before
+     *     waitForAll() is called.
+     * @param dirs directories for the package versions. Package versions with
+     *     an empty directory are not downloaded.
+     * @param interactive true = allow the interaction with the user
+     */
+    void start(const QList<PackageVersion*>& pvs, const QStringList& dirs,
+            bool interactive);
+
+    /**
+     * @brief updates the progress of the job. Cancels all downloads if one of
+     *     them failed.
+     * @return number of finished downloads
+     */
+    int update();
+
+    /**
+     * @return number of started downloads
+     */
+    int count() const;
+
+    /**
+     * @return finished downloads per second since start()
+     */
+    double getRate() const;
+
+    /**
+     * @return job for all downloads
+     */
+    Job* getJob() const;
+
+    /**
+     * @brief waits until a download is finished. The thread sleeps until
+     *     one of the downloads signals its end or the time is over.
+     * @param index index of a package version or -1 for all downloads
+     * @param time maximum time to wait in milliseconds
+     * @return true if the download(s) are finished
+     */
+    bool waitFor(int index, unsigned long time);
+
+    /**
+     * @param index index of a package version
+     * @return name of the downloaded binary relative to the directory or ""
+     *     if the download is not finished or nothing was downloaded
+     */
+    QString getBinary(int index) const;
+
+    /**
+     * @brief waits for all downloads and completes the job
+     */
+    void waitForAll();
+};
+
+PackageDownloads::PackageDownloads(Job* job, int threads): job(job), n(0),
+        nFinished(0)
+{
+    pool.setMaxThreadCount(threads);
+}
+
+void PackageDownloads::download(PackageDownloads* downloads, int index,
+        PackageVersion* pv, const QString& where, bool interactive)
+{
+    QString binary = downloadWithCoInitialize(pv, downloads->subs.at(index),
+            where, interactive);
+
+    downloads->mutex.lock();
+    downloads->binaries[index] = binary;
+    downloads->finished[index] = true;
+    downloads->nFinished++;
+    downloads->mutex.unlock();
+
+    downloads->downloadFinished.wakeAll();
+}
+
+bool PackageDownloads::isFinishedLocked(int index) const
+{
+    if (index < 0)
+        return nFinished == n;
+    else
+        return index >= finished.count() || finished.at(index);
+}
+
+void PackageDownloads::start(const QList<PackageVersion*>& pvs,
+        const QStringList& dirs, bool interactive)
+{
+    for (int i = 0; i < dirs.count(); i++) {
+        if (!dirs.at(i).isEmpty())
+            n++;
+    }
+
+    // all sub-jobs are created before the first download starts
+    mutex.lock();
+    for (int i = 0; i < pvs.count(); i++) {
+        PackageVersion* pv = pvs.at(i);
+        Job* sub = 0;
+        if (!dirs.at(i).isEmpty()) {
+            sub = job->newSubJob(1.0 / n,
+                    QObject::tr("Downloading %1").arg(pv->toString()),
+                    false, true);
+        }
+        subs.append(sub);
+        binaries.append("");
+        finished.append(sub == 0);
+    }
+    mutex.unlock();
+
+    timer.start();
+    for (int i = 0; i < pvs.count(); i++) {
+        if (subs.at(i)) {
+            QtConcurrent::run(&pool, &PackageDownloads::download, this, i,
+                    pvs.at(i), dirs.at(i), interactive);
+        }
+    }
+}
+
+int PackageDownloads::update()
+{
+    // the other downloads are stopped if one of them failed
+    bool failed = !job->shouldProceed();
+
+    bool cancelled = false;
+    double progress = 0;
+    for (int i = 0; i < subs.count(); i++) {
+        Job* sub = subs.at(i);
+        if (sub) {
+            if (failed)
+                sub->cancel();
+            if (sub->isCancelled())
+                cancelled = true;
+            progress += sub->getProgress() / n;
+        }
+    }
+
+    // cancelling one download cancels all of them
+    if (cancelled)
+        job->cancel();
+
+    if (!failed)
+        job->setProgress(progress);
+
+    mutex.lock();
+    int r = nFinished;
+    mutex.unlock();
+
+    return r;
+}
+
+int PackageDownloads::count() const
+{
+    return n;
+}
+
+double PackageDownloads::getRate() const
+{
+    mutex.lock();
+    int f = nFinished;
+    mutex.unlock();
+
+    qint64 ms = timer.isValid() ? timer.elapsed() : 0;
+    return ms > 0 ? f * 1000.0 / ms : 0;
+}
+
+Job* PackageDownloads::getJob() const
+{
+    return job;
+}
+
+bool PackageDownloads::waitFor(int index, unsigned long time)
+{
+    mutex.lock();
+    bool r = isFinishedLocked(index);
+    if (!r) {
+        downloadFinished.wait(&mutex, time);
+        r = isFinishedLocked(index);
+    }
+    mutex.unlock();
+    return r;
+}
+
+QString PackageDownloads::getBinary(int index) const
+{
+    QString r;
+    mutex.lock();
+    if (index < subs.count() && subs.at(index) && finished.at(index))
+        r = QFileInfo(binaries.at(index)).fileName();
+    mutex.unlock();
+    return r;
+}
+
+void PackageDownloads::waitForAll()
+{
+    // the time limit is only used to update the progress regularly
+    while (!waitFor(-1, 500)) {
+        update();
+    }
+    pool.waitForDone();
+    update();
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+}
+
+/**
+ * @param count number of items
+ * @param timer measures the time since the first item was started
+ * @return formatted number of items per second
+ */
+static QString formatRate(int count, const QElapsedTimer& timer)
+{
+    qint64 ms = timer.isValid() ? timer.elapsed() : 0;
+    return QString::number(ms > 0 ? count * 1000.0 / ms : 0, 'f', 2);
+}
+
+/**
+ * @brief updates the progress and the title of the job in
+ *     AbstractRepository::process
+ * @param job job
+ * @param initialTitle initial title of the job
+ * @param downloads running downloads
+ * @param processed number of installed or removed packages
+ * @param n number of operations
+ * @param processTimer started with the first installation or removal
+ */
+static void updateProcessJob(Job* job, const QString& initialTitle,
+        PackageDownloads& downloads, int processed, int n,
+        const QElapsedTimer& processTimer)
+{
+    int downloaded = downloads.update();
+    Job* downloadJob = downloads.getJob();
+    if (downloadJob->isCancelled())
+        job->cancel();
+
+    job->setTitle(initialTitle + " / " +
+            QObject::tr("%1 of %2 downloaded (%3/s), %4 of %5 installed or removed (%6/s)").
+            arg(downloaded).arg(downloads.count()).
+            arg(QString::number(downloads.getRate(), 'f', 2)).
+            arg(processed).arg(n).arg(formatRate(processed, processTimer)));
+
+    if (job->shouldProceed()) {
+        double progress = 0.7 * downloadJob->getProgress() +
+                0.29 * processed / n;
+        if (progress > job->getProgress())
+            job->setProgress(progress);
+    }
+}
+
 QStringList AbstractRepository::getRepositoryURLs(HKEY hk, const QString& path,
         QString* err, bool* keyExists)
 {
@@ -430,16 +761,12 @@ void AbstractRepository::process(Job *job,
 
     // 70% for downloading the binaries
     if (job->shouldProceed()) {
-        // downloading packages
+        // the directories are created before the downloads start so that
+        // parallel downloads never use the same directory
         for (int i = 0; i < install.count(); i++) {
             InstallOperation* op = install.at(i);
             PackageVersion* pv = pvs.at(i);
             if (op->install) {
-                QString txt = QObject::tr("Downloading %1").arg(
-                        pv->toString());
-
-                Job* sub = job->newSubJob(0.7 / n, txt, true, true);
-
                 // dir is not the final installation directory. It can be
                 // changed later during the installation.
                 QString dir = op->where;
@@ -449,23 +776,20 @@ void AbstractRepository::process(Job *job,
                 dir = WPMUtils::findNonExistingFile(dir, "");
 
                 if (d.exists(dir)) {
-                    sub->setErrorMessage(
+                    job->setErrorMessage(
                             QObject::tr("Directory %1 already exists").
                             arg(dir));
                     dirs.append("");
-                    binaries.append("");
+                } else if (!d.mkpath(dir)) {
+                    job->setErrorMessage(
+                            QObject::tr("Cannot create directory: %0").
+                            arg(dir));
+                    dirs.append("");
                 } else {
                     dirs.append(dir);
-
-                    QString binary = pv->download_(sub, dir, interactive);
-                    binaries.append(QFileInfo(binary).fileName());
-                    if (sub->isCancelled())
-                        job->cancel();
                 }
             } else {
                 dirs.append("");
-                binaries.append("");
-                job->setProgress(job->getProgress() + 0.7 / n);
             }
 
             if (!job->shouldProceed())
@@ -473,34 +797,78 @@ void AbstractRepository::process(Job *job,
         }
     }
 
-    // 10% for stopping the packages
+    QString initialTitle = job->getTitle();
+
+    // downloading, checking and extracting the binaries runs in parallel.
+    // Every package is installed as soon as its binary is ready.
+    Job* downloadJob = job->newSubJob(0.7, QObject::tr("Downloading"),
+            false, true);
+    PackageDownloads downloads(downloadJob, maxParallelDownloads);
+    if (job->shouldProceed())
+        downloads.start(pvs, dirs, interactive);
+
+    // packages are only stopped and uninstalled after all downloads
+    // succeeded. A failed download should never remove a package without
+    // installing its replacement.
+    bool stopped = false;
+
+    int processed = 0;
+
+    // started with the first installation or removal
+    QElapsedTimer processTimer;
+
+    // 29% for stopping and removing/installing the packages
     if (job->shouldProceed()) {
+        // installing/removing packages in the planned order
         for (int i = 0; i < install.count(); i++) {
             InstallOperation* op = install.at(i);
             PackageVersion* pv = pvs.at(i);
-            if (!op->install) {
-                Job* sub = job->newSubJob(0.1 / n,
-                        QObject::tr("Stopping the package %1 of %2").
-                        arg(i + 1).arg(n));
-                pv->stop(sub, programCloseType, printScriptOutput);
-                if (!sub->getErrorMessage().isEmpty()) {
-                    job->setErrorMessage(sub->getErrorMessage());
-                    break;
+
+            if (op->install) {
+                while (job->shouldProceed() && !downloads.waitFor(i, 500)) {
+                    updateProcessJob(job, initialTitle, downloads,
+                            processed, n, processTimer);
                 }
+                binaries.append(downloads.getBinary(i));
+                updateProcessJob(job, initialTitle, downloads, processed, n,
+                        processTimer);
             } else {
-                job->setProgress(job->getProgress() + 0.1 / n);
+                binaries.append("");
+                if (!stopped) {
+                    while (job->shouldProceed() &&
+                            !downloads.waitFor(-1, 500)) {
+                        updateProcessJob(job, initialTitle, downloads,
+                                processed, n, processTimer);
+                    }
+                    updateProcessJob(job, initialTitle, downloads, processed,
+                            n, processTimer);
+
+                    // all following packages to be removed are stopped
+                    // together
+                    for (int j = i; j < install.count(); j++) {
+                        if (!job->shouldProceed())
+                            break;
+
+                        if (!install.at(j)->install) {
+                            Job* sub = job->newSubJob(0,
+                                    QObject::tr("Stopping the package %1 of %2").
+                                    arg(j + 1).arg(n), false, false);
+                            pvs.at(j)->stop(sub, programCloseType,
+                                    printScriptOutput);
+                            if (!sub->getErrorMessage().isEmpty())
+                                job->setErrorMessage(sub->getErrorMessage());
+                        }
+                    }
+                    stopped = true;
+                }
             }
-        }
-    }
 
-    int processed = 0;
+            if (!job->shouldProceed())
+                break;
+
+            if (!processTimer.isValid())
+                processTimer.start();
 
-    // 19% for removing/installing the packages
-    if (job->shouldProceed()) {
-        // installing/removing packages
-        for (int i = 0; i < install.count(); i++) {
-            InstallOperation* op = install.at(i);
-            PackageVersion* pv = pvs.at(i);
             QString txt;
             if (op->install)
                 txt = QString(QObject::tr("Installing %1")).arg(
@@ -509,7 +877,7 @@ void AbstractRepository::process(Job *job,
                 txt = QString(QObject::tr("Uninstalling %1")).arg(
                         pv->toString());
 
-            Job* sub = job->newSubJob(0.19 / n, txt, true, true);
+            Job* sub = job->newSubJob(0.29 / n, txt, false, true);
             if (op->install) {
                 QString dir = dirs.at(i);
                 QString binary = binaries.at(i);
@@ -577,9 +945,19 @@ void AbstractRepository::process(Job *job,
                 break;
 
             processed = i + 1;
+            updateProcessJob(job, initialTitle, downloads, processed, n,
+                    processTimer);
         }
     }
 
+    // the remaining downloads are not necessary if we should not proceed
+    if (!job->shouldProceed())
+        downloadJob->cancel();
+    downloads.waitForAll();
+    if (downloadJob->isCancelled())
+        job->cancel();
+    job->setTitle(initialTitle);
+
     // removing the binaries if we should not proceed
     if (!job->shouldProceed()) {
         for (int i = processed; i < dirs.count(); i++) {
@@ -978,8 +1356,19 @@ PackageVersion* AbstractRepository::findNewestInstallablePackageVersion_(
     return r;
 }
 
-AbstractRepository::AbstractRepository()
+AbstractRepository::AbstractRepository():
+        maxParallelDownloads(PackageVersion::HTTP_CONNECTIONS)
+{
+}
+
+int AbstractRepository::getMaxParallelDownloads() const
+{
+    return maxParallelDownloads;
+}
+
+void AbstractRepository::setMaxParallelDownloads(int n)
 {
+    maxParallelDownloads = qMax(1, n);
 }
 
 AbstractRepository::~AbstractRepository()
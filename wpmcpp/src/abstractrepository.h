@@ -14,6 +14,9 @@
 class AbstractRepository
 {
 private:
+    /** maximum number of binaries downloaded in parallel by process() */
+    int maxParallelDownloads;
+
     /**
      * @param hk root key
      * @param path registry path
@@ -58,6 +61,19 @@ public:
      */
     AbstractRepository();
 
+    /**
+     * @return maximum number of package binaries downloaded in parallel by
+     *     process(). The default value is PackageVersion::HTTP_CONNECTIONS.
+     */
+    int getMaxParallelDownloads() const;
+
+    /**
+     * @brief changes the maximum number of package binaries downloaded in
+     *     parallel by process()
+     * @param n new value. Values less than 1 are treated as 1.
+     */
+    void setMaxParallelDownloads(int n);
+
     virtual ~AbstractRepository();
 
     /**
@@ -136,8 +152,8 @@ public:
      * @return found package version or 0. The returned object should be
      *     destroyed later.
      */
-    PackageVersion* findNewestInstallablePackageVersion_(const QString& package,
-                                                         QString *err) const;
+    virtual PackageVersion* findNewestInstallablePackageVersion_(
+            const QString& package, QString *err) const;
 
     /**
      * @param err error message will be stored here
@@ -154,7 +170,11 @@ public:
     QString updateNpackdCLEnvVar();
 
     /**
-     * @brief processes the given operations
+     * @brief processes the given operations. The binaries are downloaded,
+     *     checked and extracted in parallel. The operations are performed in
+     *     the specified order. A package is installed as soon as its binary
+     *     is ready and all previous operations are finished. Packages are
+     *     only stopped and removed after all downloads succeeded.
      * @param job job
      * @param install operations that should be performed
      * @param programCloseType how to close running applications
@@ -277,9 +297,9 @@ public:
      *     dependency by
      *     being installed. Returned object should be destroyed later.
      */
-    PackageVersion* findBestMatchToInstall(const Dependency& dep,
-                                           const QList<PackageVersion*>& avoid,
-                                           QString *err);
+    virtual PackageVersion* findBestMatchToInstall(const Dependency& dep,
+                                                   const QList<PackageVersion*>& avoid,
+                                                   QString *err);
 
     /**
      * @param dep a dependency
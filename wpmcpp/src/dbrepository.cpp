@@ -16,6 +16,8 @@
 #include <QtConcurrent/QtConcurrentRun>
 #include <QFuture>
 #include <QSqlResult>
+#include <QSet>
+#include <QCryptographicHash>
 
 #include "package.h"
 #include "repository.h"
@@ -25,6 +27,7 @@
 #include "hrtimer.h"
 #include "mysqlquery.h"
 #include "repositoryxmlhandler.h"
+#include "repositoryqueue.h"
 #include "downloader.h"
 
 static bool packageVersionLessThan3(const PackageVersion* a,
@@ -38,6 +41,105 @@ static bool packageVersionLessThan3(const PackageVersion* a,
     return r > 0;
 }
 
+/**
+ * Suffixes of the words in the full text search index (WORD_SUFFIX.SUFFIX)
+ * are stored with at most this number of characters.
+ */
+static const int MAX_SUFFIX_LENGTH = 16;
+
+/**
+ * @brief splits a text in lower case words. The keywords in a search query
+ *     are split the same way.
+ * @param txt a text
+ * @return words
+ */
+static QStringList splitWords(const QString& txt)
+{
+    return txt.toLower().simplified().split(QStringLiteral(" "),
+            QString::SkipEmptyParts);
+}
+
+/**
+ * @brief creates an SQL condition for one keyword of a search query that
+ *     matches the same packages as "FULLTEXT LIKE '%keyword%'", but uses the
+ *     full text search index (tables WORD_SUFFIX and PACKAGE_WORD).
+ *     PACKAGE.FULLTEXT only contains lower case words separated by white
+ *     space. A keyword without white space is contained in such a text if and
+ *     only if it is the beginning of a suffix of one of the words.
+ * @param keyword lower case keyword without white space
+ * @param titleOnly true = only match words from the package title and the
+ *     short package name. The result is not exact for long keywords and
+ *     should only be used for ranking.
+ * @param params the values for the parameters in the condition will be
+ *     appended here
+ * @return SQL condition for the PACKAGE table or an empty string
+ */
+static QString keywordCondition(const QString& keyword, bool titleOnly,
+        QList<QVariant>* params)
+{
+    QString r;
+
+    // % and _ are wildcards for LIKE and may match across words
+    bool wildcards = keyword.contains('%') || keyword.contains('_');
+
+    if (!wildcards) {
+        QString n = QString::number(params->count());
+        r = QStringLiteral("PACKAGE.NAME IN (SELECT PACKAGE FROM PACKAGE_WORD "
+                "WHERE ");
+        if (titleOnly)
+            r += QStringLiteral("FIELD = 0 AND ");
+        r += QStringLiteral("WORD IN (SELECT WORD FROM WORD_SUFFIX WHERE "
+                "SUFFIX >= :SUFFIX_FROM") + n +
+                QStringLiteral(" AND SUFFIX < :SUFFIX_TO") + n +
+                QStringLiteral("))");
+
+        // all suffixes starting with the keyword are between these 2 values
+        QString from = keyword.left(MAX_SUFFIX_LENGTH);
+        uint last = 0x10FFFF;
+        params->append(from);
+        params->append(from + QString::fromUcs4(&last, 1));
+    }
+
+    if (!titleOnly && (wildcards || keyword.length() > MAX_SUFFIX_LENGTH)) {
+        if (!r.isEmpty())
+            r += QStringLiteral(" AND ");
+        r += QStringLiteral("FULLTEXT LIKE :FULLTEXT") +
+                QString::number(params->count());
+        params->append(QStringLiteral("%") + keyword + QStringLiteral("%"));
+    }
+
+    return r;
+}
+
+/**
+ * @brief creates an ORDER BY clause that sorts the packages with the keywords
+ *     in the title or in the short name first and by title
+ * @param keywords lower case keywords without white space
+ * @param params the values for the parameters in the clause will be appended
+ *     here
+ * @return ORDER BY clause without the keywords "ORDER BY"
+ */
+static QString keywordsOrderBy(const QStringList& keywords,
+        QList<QVariant>* params)
+{
+    QString rank;
+    for (int i = 0; i < keywords.count(); i++) {
+        QString c = keywordCondition(keywords.at(i), true, params);
+        if (!c.isEmpty()) {
+            if (!rank.isEmpty())
+                rank += QStringLiteral(" + ");
+            rank += QStringLiteral("(") + c + QStringLiteral(")");
+        }
+    }
+
+    QString r;
+    if (!rank.isEmpty())
+        r = rank + QStringLiteral(" DESC, ");
+    r += QStringLiteral("TITLE");
+
+    return r;
+}
+
 DBRepository DBRepository::def;
 
 DBRepository::DBRepository()
@@ -49,20 +151,41 @@ DBRepository::DBRepository()
     insertLinkQuery = 0;
     deleteLinkQuery = 0;
     replacePackageQuery = 0;
-    selectCategoryQuery = 0;
     insertInstalledQuery = 0;
 }
 
 DBRepository::~DBRepository()
+{
+    deleteQueries();
+}
+
+void DBRepository::deleteQueries()
 {
     delete insertInstalledQuery;
-    delete selectCategoryQuery;
+    insertInstalledQuery = 0;
     delete deleteLinkQuery;
+    deleteLinkQuery = 0;
     delete insertLinkQuery;
+    insertLinkQuery = 0;
     delete insertPackageQuery;
+    insertPackageQuery = 0;
     delete replacePackageQuery;
+    replacePackageQuery = 0;
     delete replacePackageVersionQuery;
+    replacePackageVersionQuery = 0;
     delete insertPackageVersionQuery;
+    insertPackageVersionQuery = 0;
+    qDeleteAll(deleteDetailsQueries);
+    deleteDetailsQueries.clear();
+
+    insertCmdFileQuery.reset();
+    deleteCmdFilesQuery.reset();
+    insertDependencyQuery.reset();
+    deletePackageWordsQuery.reset();
+    insertPackageWordQuery.reset();
+    insertWordQuery.reset();
+    selectWordQuery.reset();
+    insertWordSuffixQuery.reset();
 }
 
 QString DBRepository::saveInstalled(const QList<InstalledPackageVersion *> installed)
@@ -79,6 +202,7 @@ QString DBRepository::saveInstalled(const QList<InstalledPackageVersion *> insta
         if (!insertInstalledQuery->prepare(insertSQL)) {
             err = getErrorString(*insertInstalledQuery);
             delete insertInstalledQuery;
+            insertInstalledQuery = 0;
             return err;
         }
     }
@@ -162,8 +286,8 @@ QString DBRepository::saveLicense(License* p, bool replace)
     else
         sql += QStringLiteral("IGNORE");
     sql += QStringLiteral(" INTO LICENSE "
-            "(NAME, TITLE, DESCRIPTION, URL)"
-            "VALUES(:NAME, :TITLE, :DESCRIPTION, :URL)");
+            "(NAME, TITLE, DESCRIPTION, URL, REPOSITORY)"
+            "VALUES(:NAME, :TITLE, :DESCRIPTION, :URL, :REPOSITORY)");
     if (!q.prepare(sql))
         err = getErrorString(q);
 
@@ -377,8 +501,7 @@ PackageVersion* DBRepository::findPackageVersion_(
     PackageVersion* r = 0;
 
     MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT NAME, "
-            "PACKAGE, CONTENT, MSIGUID FROM PACKAGE_VERSION "
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
             "WHERE NAME = :NAME AND PACKAGE = :PACKAGE")))
         *err = getErrorString(q);
 
@@ -389,8 +512,11 @@ PackageVersion* DBRepository::findPackageVersion_(
             *err = getErrorString(q);
     }
 
-    if (err->isEmpty() && q.next()) {
-        r = PackageVersion::parse(q.value(2).toByteArray(), err);
+    if (err->isEmpty()) {
+        QList<PackageVersion*> pvs = readPackageVersions(q, err);
+        if (err->isEmpty() && pvs.count() > 0)
+            r = pvs.takeFirst();
+        qDeleteAll(pvs);
     }
 
     return r;
@@ -403,9 +529,11 @@ QList<PackageVersion*> DBRepository::getPackageVersions_(const QString& package,
 
     QList<PackageVersion*> r;
 
+    // the index on PACKAGE and VERSION_KEY returns the versions already
+    // sorted from the newest to the oldest
     MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT CONTENT FROM PACKAGE_VERSION "
-            "WHERE PACKAGE = :PACKAGE")))
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
+            "WHERE PACKAGE = :PACKAGE ORDER BY VERSION_KEY DESC")))
         *err = getErrorString(q);
 
     if (err->isEmpty()) {
@@ -415,16 +543,138 @@ QList<PackageVersion*> DBRepository::getPackageVersions_(const QString& package,
         }
     }
 
-    while (err->isEmpty() && q.next()) {
-        PackageVersion* pv = PackageVersion::parse(q.value(0).toByteArray(),
-                err, false);
-        if (err->isEmpty())
+    if (err->isEmpty())
+        r = readPackageVersions(q, err);
+
+    return r;
+}
+
+QList<PackageVersion*> DBRepository::getPackageVersionSummaries(
+        const QStringList& packages, QString *err) const
+{
+    *err = QStringLiteral("");
+
+    QList<PackageVersion*> r;
+
+    int start = 0;
+    int c = packages.count();
+    const int block = 100;
+
+    QString sql = QStringLiteral("SELECT PACKAGE, NAME, URL "
+            "FROM PACKAGE_VERSION WHERE PACKAGE IN (:PACKAGE0");
+    for (int i = 1; i < block; i++) {
+        sql = sql + QStringLiteral(", :PACKAGE") + QString::number(i);
+    }
+    sql += QStringLiteral(") ORDER BY PACKAGE, VERSION_KEY DESC");
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    while (err->isEmpty() && start < c) {
+        // the parameters not bound here are NULL and do not match anything
+        for (int i = 0; i < block; i++) {
+            q.bindValue(QStringLiteral(":PACKAGE") + QString::number(i),
+                    start + i < c ? QVariant(packages.at(start + i)) :
+                    QVariant(QVariant::String));
+        }
+
+        if (!q.exec())
+            *err = getErrorString(q);
+
+        if (!err->isEmpty())
+            break;
+
+        // all versions of a package are in the same block
+        while (q.next()) {
+            Version v;
+            if (!v.setVersion(q.value(1).toString()))
+                continue;
+
+            PackageVersion* pv = new PackageVersion(q.value(0).toString(), v);
+            QString url = q.value(2).toString();
+            if (!url.isEmpty())
+                pv->download = QUrl(url);
             r.append(pv);
+        }
+
+        start += block;
     }
 
-    // qDebug() << vs.count();
+    return r;
+}
 
-    qSort(r.begin(), r.end(), packageVersionLessThan3);
+PackageVersion* DBRepository::findNewestInstallablePackageVersion_(
+        const QString &package, QString* err) const
+{
+    *err = QStringLiteral("");
+
+    PackageVersion* r = 0;
+
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
+            "WHERE PACKAGE = :PACKAGE AND URL <> '' "
+            "ORDER BY VERSION_KEY DESC LIMIT 1")))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(QStringLiteral(":PACKAGE"), package);
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty()) {
+        QList<PackageVersion*> pvs = readPackageVersions(q, err);
+        if (err->isEmpty() && pvs.count() > 0 &&
+                pvs.at(0)->download.isValid())
+            r = pvs.takeFirst();
+        qDeleteAll(pvs);
+    }
+
+    return r;
+}
+
+PackageVersion* DBRepository::findBestMatchToInstall(const Dependency& dep,
+        const QList<PackageVersion*>& avoid, QString* err)
+{
+    *err = QStringLiteral("");
+
+    PackageVersion* r = 0;
+
+    // only the versions in the range are read from the index
+    MySQLQuery q(db);
+    QString sql = QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
+            "WHERE PACKAGE = :PACKAGE AND URL <> '' AND VERSION_KEY ");
+    sql += dep.minIncluded ? QStringLiteral(">=") : QStringLiteral(">");
+    sql += QStringLiteral(" :MIN AND VERSION_KEY ");
+    sql += dep.maxIncluded ? QStringLiteral("<=") : QStringLiteral("<");
+    sql += QStringLiteral(" :MAX ORDER BY VERSION_KEY DESC");
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(QStringLiteral(":PACKAGE"), dep.package);
+        q.bindValue(QStringLiteral(":MIN"), dep.min.toSortKey());
+        q.bindValue(QStringLiteral(":MAX"), dep.max.toSortKey());
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    QList<PackageVersion*> pvs;
+    if (err->isEmpty())
+        pvs = readPackageVersions(q, err);
+
+    if (err->isEmpty()) {
+        for (int i = 0; i < pvs.count(); i++) {
+            PackageVersion* pv = pvs.at(i);
+            if (dep.test(pv->version) && pv->download.isValid() &&
+                    PackageVersion::indexOf(avoid, pv) < 0) {
+                r = pvs.takeAt(i);
+                break;
+            }
+        }
+    }
+    qDeleteAll(pvs);
 
     return r;
 }
@@ -437,7 +687,7 @@ QList<PackageVersion *> DBRepository::getPackageVersionsWithDetectFiles(
     QList<PackageVersion*> r;
 
     MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT CONTENT FROM PACKAGE_VERSION "
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
             "WHERE DETECT_FILE_COUNT > 0")))
         *err = getErrorString(q);
 
@@ -447,12 +697,8 @@ QList<PackageVersion *> DBRepository::getPackageVersionsWithDetectFiles(
         }
     }
 
-    while (err->isEmpty() && q.next()) {
-        PackageVersion* pv = PackageVersion::parse(q.value(0).toByteArray(),
-                err);
-        if (err->isEmpty())
-            r.append(pv);
-    }
+    if (err->isEmpty())
+        r = readPackageVersions(q, err);
 
     // qDebug() << vs.count();
 
@@ -461,6 +707,54 @@ QList<PackageVersion *> DBRepository::getPackageVersionsWithDetectFiles(
     return r;
 }
 
+QMultiHash<QString, InstalledPackageVersion*>
+        DBRepository::findInstalledDependents(
+        const QList<InstalledPackageVersion*>& installed, QString *err) const
+{
+    *err = QStringLiteral("");
+
+    QMultiHash<QString, InstalledPackageVersion*> r;
+
+    // "package/version" => installed package version. DEPENDENCY.VERSION
+    // is normalized.
+    QHash<QString, InstalledPackageVersion*> ids;
+    for (int i = 0; i < installed.count(); i++) {
+        InstalledPackageVersion* ipv = installed.at(i);
+        Version v = ipv->version;
+        v.normalize();
+        ids.insert(PackageVersion::getStringId(ipv->package, v), ipv);
+    }
+
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral(
+            "SELECT DEPENDENCY, PACKAGE, VERSION FROM DEPENDENCY")))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty()) {
+        // a package version may depend on the same package more than once
+        QSet<QString> added;
+        while (q.next()) {
+            QString id = q.value(1).toString() + QLatin1Char('/') +
+                    q.value(2).toString();
+            InstalledPackageVersion* ipv = ids.value(id);
+            if (ipv) {
+                QString dependency = q.value(0).toString();
+                if (!added.contains(dependency + QLatin1Char(' ') + id)) {
+                    added.insert(dependency + QLatin1Char(' ') + id);
+                    r.insert(dependency, ipv->clone());
+                }
+            }
+        }
+    }
+
+    return r;
+}
+
 QList<PackageVersion *> DBRepository::findPackageVersionsWithCmdFile(
         const QString &name, QString *err) const
 {
@@ -469,7 +763,7 @@ QList<PackageVersion *> DBRepository::findPackageVersionsWithCmdFile(
     QList<PackageVersion*> r;
 
     MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT CONTENT FROM PACKAGE_VERSION PV "
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION PV "
             "WHERE EXISTS (SELECT 1 FROM CMD_FILE WHERE "
             "PACKAGE = PV.PACKAGE AND "
             "VERSION = PV.NAME AND "
@@ -483,12 +777,8 @@ QList<PackageVersion *> DBRepository::findPackageVersionsWithCmdFile(
         }
     }
 
-    while (err->isEmpty() && q.next()) {
-        PackageVersion* pv = PackageVersion::parse(q.value(0).toByteArray(),
-                err);
-        if (err->isEmpty())
-            r.append(pv);
-    }
+    if (err->isEmpty())
+        r = readPackageVersions(q, err);
 
     // qDebug() << vs.count();
 
@@ -571,21 +861,22 @@ QStringList DBRepository::findBetterPackages(const QString& title, QString* err)
             "and name not like 'control-panel.%'");
     QList<QVariant> params;
 
+    QStringList used;
     for (int i = 0; i < keywords.count(); i++) {
         QString kw = keywords.at(i);
         if (kw.length() > 1) {
             if (!where.isEmpty())
                 where += QStringLiteral(" AND ");
-            where += QStringLiteral("FULLTEXT LIKE :FULLTEXT") +
-                    QString::number(i);
-            params.append(QStringLiteral("%") + kw.toLower() +
-                    QStringLiteral("%"));
+            where += keywordCondition(kw, false, &params);
+            used.append(kw);
         }
     }
 
+    QString orderBy = keywordsOrderBy(used, &params);
+
     qDebug() << "searching for" << keywords.join(' ');
 
-    return findPackagesWhere(where, params, err);
+    return findPackagesWhere(where, orderBy, params, err);
 }
 
 QStringList DBRepository::findPackages(Package::Status minStatus,
@@ -597,19 +888,16 @@ QStringList DBRepository::findPackages(Package::Status minStatus,
     QString where;
     QList<QVariant> params;
 
-    QStringList keywords = query.toLower().simplified().split(
-            QStringLiteral(" "),
-            QString::SkipEmptyParts);
+    QStringList keywords = splitWords(query);
 
+    QStringList used;
     for (int i = 0; i < keywords.count(); i++) {
         QString kw = keywords.at(i);
         if (kw.length() > 1) {
             if (!where.isEmpty())
                 where += QStringLiteral(" AND ");
-            where += QStringLiteral("FULLTEXT LIKE :FULLTEXT") +
-                    QString::number(i);
-            params.append(QStringLiteral("%") + kw.toLower() +
-                    QStringLiteral("%"));
+            where += keywordCondition(kw, false, &params);
+            used.append(kw);
         }
     }
     if (minStatus < maxStatus) {
@@ -647,9 +935,11 @@ QStringList DBRepository::findPackages(Package::Status minStatus,
     if (!where.isEmpty())
         where = QStringLiteral("WHERE ") + where;
 
+    QString orderBy = keywordsOrderBy(used, &params);
+
     // qDebug() << "DBRepository::findPackages.1";
 
-    return findPackagesWhere(where, params, err);
+    return findPackagesWhere(where, orderBy, params, err);
 }
 
 QStringList DBRepository::getCategories(const QStringList& ids, QString* err)
@@ -687,16 +977,12 @@ QList<QStringList> DBRepository::findCategories(Package::Status minStatus,
     QString where;
     QList<QVariant> params;
 
-    QStringList keywords = query.toLower().simplified().split(
-            QStringLiteral(" "),
-            QString::SkipEmptyParts);
+    QStringList keywords = splitWords(query);
 
     for (int i = 0; i < keywords.count(); i++) {
         if (!where.isEmpty())
             where += QStringLiteral(" AND ");
-        where += QStringLiteral("FULLTEXT LIKE :FULLTEXT") + QString::number(i);
-        params.append(QStringLiteral("%") + keywords.at(i).toLower() +
-                QStringLiteral("%"));
+        where += keywordCondition(keywords.at(i), false, &params);
     }
     if (maxStatus > minStatus) {
         if (!where.isEmpty())
@@ -769,6 +1055,7 @@ QList<QStringList> DBRepository::findCategories(Package::Status minStatus,
 }
 
 QStringList DBRepository::findPackagesWhere(const QString& where,
+        const QString& orderBy,
         const QList<QVariant>& params,
         QString *err) const
 {
@@ -782,7 +1069,7 @@ QStringList DBRepository::findPackagesWhere(const QString& where,
     if (!where.isEmpty())
         sql += QStringLiteral(" ") + where;
 
-    sql += QStringLiteral(" ORDER BY TITLE");
+    sql += QStringLiteral(" ORDER BY ") + orderBy;
 
     if (!q.prepare(sql))
         *err = getErrorString(q);
@@ -805,38 +1092,57 @@ QStringList DBRepository::findPackagesWhere(const QString& where,
     return r;
 }
 
-int DBRepository::insertCategory(int parent, int level,
-        const QString& category, QString* err)
+/**
+ * @param parent ID of the parent category
+ * @param level level of the category
+ * @param name name of the category
+ * @return key for DBRepository::categoryIDs
+ */
+static QString categoryKey(int parent, int level, const QString& name)
 {
-    *err = QStringLiteral("");
+    return QString::number(parent) + QLatin1Char('/') +
+            QString::number(level) + QLatin1Char('/') + name;
+}
 
-    if (!selectCategoryQuery) {
-        selectCategoryQuery = new MySQLQuery(db);
+QString DBRepository::readCategoryIDs()
+{
+    QString err;
 
-        QString sql = QStringLiteral(
-                "SELECT ID FROM CATEGORY WHERE PARENT = :PARENT AND "
-                "LEVEL = :LEVEL AND NAME = :NAME");
+    categoryIDs.clear();
 
-        if (!selectCategoryQuery->prepare(sql)) {
-            *err = getErrorString(*selectCategoryQuery);
-            delete selectCategoryQuery;
-            return -1;
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral(
+            "SELECT ID, NAME, PARENT, LEVEL FROM CATEGORY")))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        if (!q.exec())
+            err = getErrorString(q);
+        else {
+            while (q.next()) {
+                categoryIDs.insert(categoryKey(q.value(2).toInt(),
+                        q.value(3).toInt(), q.value(1).toString()),
+                        q.value(0).toInt());
+            }
         }
     }
 
-    if (err->isEmpty()) {
-        selectCategoryQuery->bindValue(QStringLiteral(":NAME"), category);
-        selectCategoryQuery->bindValue(QStringLiteral(":PARENT"), parent);
-        selectCategoryQuery->bindValue(QStringLiteral(":LEVEL"), level);
-        if (!selectCategoryQuery->exec())
-            *err = getErrorString(*selectCategoryQuery);
-    }
+    return err;
+}
+
+int DBRepository::insertCategory(int parent, int level,
+        const QString& category, QString* err)
+{
+    *err = QStringLiteral("");
+
+    if (categoryIDs.isEmpty())
+        *err = readCategoryIDs();
 
     int id = -1;
     if (err->isEmpty()) {
-        if (selectCategoryQuery->next())
-            id = selectCategoryQuery->value(0).toInt();
-        else {
+        QString key = categoryKey(parent, level, category);
+        id = categoryIDs.value(key, -1);
+        if (id < 0) {
             MySQLQuery q(db);
             QString sql = QStringLiteral("INSERT INTO CATEGORY "
                     "(ID, NAME, PARENT, LEVEL) "
@@ -850,14 +1156,14 @@ int DBRepository::insertCategory(int parent, int level,
                 q.bindValue(QStringLiteral(":LEVEL"), level);
                 if (!q.exec())
                     *err = getErrorString(q);
-                else
+                else {
                     id = q.lastInsertId().toInt();
+                    categoryIDs.insert(key, id);
+                }
             }
         }
     }
 
-    selectCategoryQuery->finish();
-
     return id;
 }
 
@@ -1115,78 +1421,285 @@ QString DBRepository::savePackage(Package *p, bool replace)
             err = saveLinks(p);
     }
 
+    if (err.isEmpty()) {
+        if (!exists)
+            err = savePackageWords(p->name, p->title, p->description,
+                    p->getShortName());
+    }
+
     return err;
 }
 
-QList<Package*> DBRepository::findPackagesByShortName(const QString &name)
+QString DBRepository::savePackageWords(const QString& package,
+        const QString& title, const QString& description,
+        const QString& shortName)
 {
     QString err;
 
-    QList<Package*> r;
+    if (!deletePackageWordsQuery) {
+        deletePackageWordsQuery.reset(new MySQLQuery(db));
+        insertPackageWordQuery.reset(new MySQLQuery(db));
 
-    MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT NAME, TITLE, URL, ICON, "
-            "DESCRIPTION, LICENSE, CATEGORY0, "
-            "CATEGORY1, CATEGORY2, CATEGORY3, CATEGORY4 "
-            "FROM PACKAGE WHERE SHORT_NAME = :SHORT_NAME "
-            "LIMIT 1")))
-        err = getErrorString(q);
+        if (!deletePackageWordsQuery->prepare(QStringLiteral(
+                "DELETE FROM PACKAGE_WORD WHERE PACKAGE = :PACKAGE")))
+            err = getErrorString(*deletePackageWordsQuery);
+        if (err.isEmpty() && !insertPackageWordQuery->prepare(QStringLiteral(
+                "INSERT INTO PACKAGE_WORD(PACKAGE, WORD, FIELD) "
+                "VALUES (:PACKAGE, :WORD, :FIELD)")))
+            err = getErrorString(*insertPackageWordQuery);
 
-    if (err.isEmpty()) {
-        q.bindValue(QStringLiteral(":SHORT_NAME"), name);
-        if (!q.exec())
-            err = getErrorString(q);
+        if (!err.isEmpty()) {
+            deletePackageWordsQuery.reset(0);
+            insertPackageWordQuery.reset(0);
+            return err;
+        }
     }
 
-    while (err.isEmpty() && q.next()) {
-        Package* p = new Package(q.value(0).toString(), q.value(1).toString());
-        p->url = q.value(2).toString();
-        p->setIcon(q.value(3).toString());
-        p->description = q.value(4).toString();
-        p->license = q.value(5).toString();
-
-        QString path = getCategoryPath(
-                q.value(6).toInt(),
-                q.value(7).toInt(),
-                q.value(8).toInt(),
-                q.value(9).toInt(),
-                q.value(10).toInt());
-        if (!path.isEmpty())
-            p->categories.append(path);
+    // word => 0 for the title and the short name, 1 for the description and
+    // the full package name
+    QHash<QString, int> fields;
+    QStringList ws = splitWords(title + QStringLiteral(" ") + shortName);
+    for (int i = 0; i < ws.count(); i++) {
+        fields.insert(ws.at(i), 0);
+    }
+    ws = splitWords(description + QStringLiteral(" ") + package);
+    for (int i = 0; i < ws.count(); i++) {
+        if (!fields.contains(ws.at(i)))
+            fields.insert(ws.at(i), 1);
+    }
 
-        if (err.isEmpty())
-            err = readLinks(p);
+    MySQLQuery* q = deletePackageWordsQuery.get();
+    q->bindValue(QStringLiteral(":PACKAGE"), package);
+    if (!q->exec())
+        err = getErrorString(*q);
+    q->finish();
 
-        r.append(p);
+    q = insertPackageWordQuery.get();
+    QHashIterator<QString, int> it(fields);
+    while (err.isEmpty() && it.hasNext()) {
+        it.next();
+        int word = insertWord(it.key(), &err);
+        if (err.isEmpty()) {
+            q->bindValue(QStringLiteral(":PACKAGE"), package);
+            q->bindValue(QStringLiteral(":WORD"), word);
+            q->bindValue(QStringLiteral(":FIELD"), it.value());
+            if (!q->exec())
+                err = getErrorString(*q);
+        }
     }
+    q->finish();
 
-    return r;
+    return err;
 }
 
-QString DBRepository::readLinks(Package* p)
+int DBRepository::insertWord(const QString& word, QString* err)
 {
-    QString err;
+    *err = QStringLiteral("");
 
-    QList<Package*> r;
+    int id = words.value(word, -1);
+    if (id >= 0)
+        return id;
+
+    if (!insertWordQuery) {
+        insertWordQuery.reset(new MySQLQuery(db));
+        selectWordQuery.reset(new MySQLQuery(db));
+        insertWordSuffixQuery.reset(new MySQLQuery(db));
+
+        if (!insertWordQuery->prepare(QStringLiteral(
+                "INSERT OR IGNORE INTO WORD(ID, WORD) VALUES (NULL, :WORD)")))
+            *err = getErrorString(*insertWordQuery);
+        if (err->isEmpty() && !selectWordQuery->prepare(QStringLiteral(
+                "SELECT ID FROM WORD WHERE WORD = :WORD")))
+            *err = getErrorString(*selectWordQuery);
+        if (err->isEmpty() && !insertWordSuffixQuery->prepare(QStringLiteral(
+                "INSERT INTO WORD_SUFFIX(SUFFIX, WORD) "
+                "VALUES (:SUFFIX, :WORD)")))
+            *err = getErrorString(*insertWordSuffixQuery);
+
+        if (!err->isEmpty()) {
+            insertWordQuery.reset(0);
+            selectWordQuery.reset(0);
+            insertWordSuffixQuery.reset(0);
+            return -1;
+        }
+    }
 
-    MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT REL, HREF "
-            "FROM LINK WHERE PACKAGE = :PACKAGE "
-            "ORDER BY INDEX_")))
-        err = getErrorString(q);
+    bool inserted = false;
+    MySQLQuery* q = insertWordQuery.get();
+    q->bindValue(QStringLiteral(":WORD"), word);
+    if (!q->exec())
+        *err = getErrorString(*q);
+    else if (q->numRowsAffected() > 0) {
+        id = q->lastInsertId().toInt();
+        inserted = true;
+    }
+    q->finish();
 
-    if (err.isEmpty()) {
-        q.bindValue(QStringLiteral(":PACKAGE"), p->name);
-        if (!q.exec())
-            err = getErrorString(q);
+    // the word was already stored, but is not in the cache
+    if (err->isEmpty() && !inserted) {
+        q = selectWordQuery.get();
+        q->bindValue(QStringLiteral(":WORD"), word);
+        if (!q->exec())
+            *err = getErrorString(*q);
+        else if (q->next())
+            id = q->value(0).toInt();
+        else
+            *err = QObject::tr("Cannot find the word %1").arg(word);
+        q->finish();
     }
 
-    while (err.isEmpty() && q.next()) {
-        p->links.insert(q.value(0).toString(), q.value(1).toString());
+    if (err->isEmpty() && inserted) {
+        QSet<QString> suffixes;
+        for (int i = 0; i < word.length(); i++) {
+            // a suffix cannot start in the middle of a surrogate pair
+            if (!word.at(i).isLowSurrogate())
+                suffixes.insert(word.mid(i, MAX_SUFFIX_LENGTH));
+        }
+
+        q = insertWordSuffixQuery.get();
+        QSetIterator<QString> it(suffixes);
+        while (it.hasNext()) {
+            q->bindValue(QStringLiteral(":SUFFIX"), it.next());
+            q->bindValue(QStringLiteral(":WORD"), id);
+            if (!q->exec()) {
+                *err = getErrorString(*q);
+                break;
+            }
+        }
+        q->finish();
     }
 
-    return err;
-}
+    if (err->isEmpty())
+        words.insert(word, id);
+
+    return id;
+}
+
+QString DBRepository::rebuildWordIndex()
+{
+    QString err;
+
+    words.clear();
+
+    // the whole content is read first so that no query is open while the
+    // index is written
+    QList<QStringList> packages;
+    MySQLQuery q(db);
+    if (!q.exec(QStringLiteral(
+            "SELECT NAME, TITLE, DESCRIPTION, SHORT_NAME FROM PACKAGE")))
+        err = getErrorString(q);
+    else {
+        while (q.next()) {
+            QStringList sl;
+            sl.append(q.value(0).toString());
+            sl.append(q.value(1).toString());
+            sl.append(q.value(2).toString());
+            sl.append(q.value(3).toString());
+            packages.append(sl);
+        }
+    }
+    q.finish();
+
+    bool transactionStarted = false;
+    if (err.isEmpty()) {
+        err = exec(QStringLiteral("BEGIN TRANSACTION"));
+        transactionStarted = err.isEmpty();
+    }
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM PACKAGE_WORD"));
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM WORD_SUFFIX"));
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM WORD"));
+
+    for (int i = 0; i < packages.count(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        const QStringList& sl = packages.at(i);
+        err = savePackageWords(sl.at(0), sl.at(1), sl.at(2), sl.at(3));
+    }
+
+    if (err.isEmpty())
+        err = exec(QStringLiteral("COMMIT"));
+    else if (transactionStarted)
+        exec(QStringLiteral("ROLLBACK"));
+
+    if (!err.isEmpty())
+        words.clear();
+
+    return err;
+}
+
+QList<Package*> DBRepository::findPackagesByShortName(const QString &name)
+{
+    QString err;
+
+    QList<Package*> r;
+
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral("SELECT NAME, TITLE, URL, ICON, "
+            "DESCRIPTION, LICENSE, CATEGORY0, "
+            "CATEGORY1, CATEGORY2, CATEGORY3, CATEGORY4 "
+            "FROM PACKAGE WHERE SHORT_NAME = :SHORT_NAME "
+            "LIMIT 1")))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":SHORT_NAME"), name);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
+
+    while (err.isEmpty() && q.next()) {
+        Package* p = new Package(q.value(0).toString(), q.value(1).toString());
+        p->url = q.value(2).toString();
+        p->setIcon(q.value(3).toString());
+        p->description = q.value(4).toString();
+        p->license = q.value(5).toString();
+
+        QString path = getCategoryPath(
+                q.value(6).toInt(),
+                q.value(7).toInt(),
+                q.value(8).toInt(),
+                q.value(9).toInt(),
+                q.value(10).toInt());
+        if (!path.isEmpty())
+            p->categories.append(path);
+
+        if (err.isEmpty())
+            err = readLinks(p);
+
+        r.append(p);
+    }
+
+    return r;
+}
+
+QString DBRepository::readLinks(Package* p)
+{
+    QString err;
+
+    QList<Package*> r;
+
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral("SELECT REL, HREF "
+            "FROM LINK WHERE PACKAGE = :PACKAGE "
+            "ORDER BY INDEX_")))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":PACKAGE"), p->name);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
+
+    while (err.isEmpty() && q.next()) {
+        p->links.insert(q.value(0).toString(), q.value(1).toString());
+    }
+
+    return err;
+}
 
 QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
 {
@@ -1199,10 +1712,12 @@ QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
 
         QString sql = QStringLiteral(" INTO PACKAGE_VERSION "
                 "(NAME, PACKAGE, URL, "
-                "CONTENT, MSIGUID, DETECT_FILE_COUNT)"
+                "CONTENT, CONTENT_BIN, MSIGUID, DETECT_FILE_COUNT, TYPE, "
+                "HASH_SUM_TYPE, HASH_SUM, REPOSITORY, VERSION_KEY)"
                 "VALUES(:NAME, :PACKAGE, "
-                ":URL, :CONTENT, :MSIGUID, "
-                ":DETECT_FILE_COUNT)");
+                ":URL, :CONTENT, :CONTENT_BIN, :MSIGUID, "
+                ":DETECT_FILE_COUNT, :TYPE, :HASH_SUM_TYPE, :HASH_SUM, "
+                ":REPOSITORY, :VERSION_KEY)");
 
         if (!replacePackageVersionQuery->prepare(
                 QStringLiteral("INSERT OR REPLACE ") + sql)) {
@@ -1245,12 +1760,23 @@ QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
         q->bindValue(QStringLiteral(":MSIGUID"), p->msiGUID);
         q->bindValue(QStringLiteral(":DETECT_FILE_COUNT"),
                 p->detectFiles.count());
+        q->bindValue(QStringLiteral(":TYPE"), p->type);
+        q->bindValue(QStringLiteral(":HASH_SUM_TYPE"),
+                p->hashSumType == QCryptographicHash::Sha1 ? 0 : 1);
+        q->bindValue(QStringLiteral(":HASH_SUM"), p->sha1);
+        q->bindValue(QStringLiteral(":VERSION_KEY"), v.toSortKey());
 
+        // older versions of Npackd read the XML from CONTENT
         QByteArray file;
         file.reserve(1024);
         QXmlStreamWriter w(&file);
         p->toXML(&w);
         q->bindValue(QStringLiteral(":CONTENT"), QVariant(file));
+
+        QByteArray bin;
+        bin.reserve(512);
+        p->toBinary(&bin);
+        q->bindValue(QStringLiteral(":CONTENT_BIN"), QVariant(bin));
         if (!q->exec())
             err = getErrorString(*q);
         modified = q->numRowsAffected() > 0;
@@ -1287,9 +1813,133 @@ QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
         q->finish();
     }
 
+    // save <dependency>, <detect-file>, <important-file> and <file> entries
+    if (err.isEmpty() && modified) {
+        err = deletePackageVersionDetails(p->package, p->version);
+        if (err.isEmpty())
+            err = savePackageVersionDetails(p);
+    }
+
+    return err;
+}
+
+QString DBRepository::deletePackageVersionDetails(const QString& package,
+        const Version& version)
+{
+    QString err;
+
+    if (deleteDetailsQueries.isEmpty()) {
+        QStringList tables;
+        tables << QStringLiteral("DEPENDENCY");
+        for (int i = 0; i < tables.count(); i++) {
+            MySQLQuery* q = new MySQLQuery(db);
+            deleteDetailsQueries.append(q);
+            if (!q->prepare(QStringLiteral("DELETE FROM ") + tables.at(i) +
+                    QStringLiteral(" WHERE PACKAGE=:PACKAGE AND "
+                    "VERSION=:VERSION"))) {
+                err = getErrorString(*q);
+                qDeleteAll(deleteDetailsQueries);
+                deleteDetailsQueries.clear();
+                return err;
+            }
+        }
+    }
+
+    Version v(version);
+    v.normalize();
+    for (int i = 0; i < deleteDetailsQueries.count(); i++) {
+        MySQLQuery* q = deleteDetailsQueries.at(i);
+        q->bindValue(QStringLiteral(":PACKAGE"), package);
+        q->bindValue(QStringLiteral(":VERSION"), v.getVersionString());
+        if (!q->exec())
+            err = getErrorString(*q);
+        q->finish();
+
+        if (!err.isEmpty())
+            break;
+    }
+
+    return err;
+}
+
+QString DBRepository::savePackageVersionDetails(PackageVersion* p)
+{
+    QString err;
+
+    if (!insertDependencyQuery) {
+        insertDependencyQuery.reset(new MySQLQuery(db));
+
+        if (!insertDependencyQuery->prepare(QStringLiteral(
+                "INSERT INTO DEPENDENCY(PACKAGE, VERSION, INDEX_, "
+                "DEPENDENCY, MIN_INCLUDED, MIN_, MAX_INCLUDED, MAX_, VAR) "
+                "VALUES (:PACKAGE, :VERSION, :INDEX_, :DEPENDENCY, "
+                ":MIN_INCLUDED, :MIN_, :MAX_INCLUDED, :MAX_, :VAR)")))
+            err = getErrorString(*insertDependencyQuery);
+
+        if (!err.isEmpty()) {
+            insertDependencyQuery.reset(0);
+            return err;
+        }
+    }
+
+    Version v = p->version;
+    v.normalize();
+    QString version = v.getVersionString();
+
+    MySQLQuery* q = insertDependencyQuery.get();
+    for (int i = 0; i < p->dependencies.count(); i++) {
+        Dependency* d = p->dependencies.at(i);
+        q->bindValue(QStringLiteral(":PACKAGE"), p->package);
+        q->bindValue(QStringLiteral(":VERSION"), version);
+        q->bindValue(QStringLiteral(":INDEX_"), i);
+        q->bindValue(QStringLiteral(":DEPENDENCY"), d->package);
+        q->bindValue(QStringLiteral(":MIN_INCLUDED"), d->minIncluded ? 1 : 0);
+        q->bindValue(QStringLiteral(":MIN_"), d->min.getVersionString());
+        q->bindValue(QStringLiteral(":MAX_INCLUDED"), d->maxIncluded ? 1 : 0);
+        q->bindValue(QStringLiteral(":MAX_"), d->max.getVersionString());
+        q->bindValue(QStringLiteral(":VAR"), d->var);
+        if (!q->exec()) {
+            err = getErrorString(*q);
+            break;
+        }
+    }
+    q->finish();
+
     return err;
 }
 
+QList<PackageVersion*> DBRepository::readPackageVersions(MySQLQuery& q,
+        QString* err) const
+{
+    *err = QStringLiteral("");
+
+    QList<PackageVersion*> r;
+
+    while (err->isEmpty() && q.next()) {
+        PackageVersion* pv;
+        if (!q.value(0).isNull()) {
+            pv = PackageVersion::fromBinary(q.value(0).toByteArray(), err);
+        } else {
+            // the row was written by an older version of Npackd
+            QByteArray content = q.value(1).toByteArray();
+            if (content.startsWith('<'))
+                pv = PackageVersion::parse(content, err, false);
+            else
+                pv = PackageVersion::fromBinary(content, err);
+        }
+
+        if (pv)
+            r.append(pv);
+    }
+
+    if (!err->isEmpty()) {
+        qDeleteAll(r);
+        r.clear();
+    }
+
+    return r;
+}
+
 PackageVersion *DBRepository::findPackageVersionByMSIGUID_(
         const QString &guid, QString* err) const
 {
@@ -1298,9 +1948,8 @@ PackageVersion *DBRepository::findPackageVersionByMSIGUID_(
     PackageVersion* r = 0;
 
     MySQLQuery q(db);
-    if (!q.prepare(QStringLiteral("SELECT NAME, "
-            "PACKAGE, CONTENT FROM PACKAGE_VERSION "
-            "WHERE MSIGUID = :MSIGUID")))
+    if (!q.prepare(QStringLiteral("SELECT CONTENT_BIN, CONTENT FROM PACKAGE_VERSION "
+            "WHERE MSIGUID = :MSIGUID LIMIT 1")))
         *err = getErrorString(q);
 
     if (err->isEmpty()) {
@@ -1310,9 +1959,10 @@ PackageVersion *DBRepository::findPackageVersionByMSIGUID_(
     }
 
     if (err->isEmpty()) {
-        if (q.next()) {
-            r = PackageVersion::parse(q.value(2).toByteArray(), err);
-        }
+        QList<PackageVersion*> pvs = readPackageVersions(q, err);
+        if (err->isEmpty() && pvs.count() > 0)
+            r = pvs.takeFirst();
+        qDeleteAll(pvs);
     }
 
     return r;
@@ -1323,6 +1973,8 @@ QString DBRepository::clear()
     Job* job = new Job(QObject::tr("Clearing the repository database"));
 
     this->categories.clear();
+    this->words.clear();
+    this->categoryIDs.clear();
 
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.1,
@@ -1335,7 +1987,7 @@ QString DBRepository::clear()
     }
 
     if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.6,
+        Job* sub = job->newSubJob(0.48,
                 QObject::tr("Clearing the package versions table"));
         QString err = exec(QStringLiteral("DELETE FROM PACKAGE_VERSION"));
         if (!err.isEmpty())
@@ -1374,6 +2026,16 @@ QString DBRepository::clear()
             sub->completeWithProgress();
     }
 
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.1,
+                QObject::tr("Clearing the package version details"));
+        QString err = exec(QStringLiteral("DELETE FROM DEPENDENCY"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    }
+
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.02,
                 QObject::tr("Clearing the categories table"));
@@ -1396,6 +2058,30 @@ QString DBRepository::clear()
         }
     }
 
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Clearing the repositories table"));
+        QString err = exec(QStringLiteral("DELETE FROM REPOSITORY"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Clearing the full text search index"));
+        QString err = exec(QStringLiteral("DELETE FROM PACKAGE_WORD"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral("DELETE FROM WORD_SUFFIX"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral("DELETE FROM WORD"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    }
+
     job->complete();
 
     delete job;
@@ -1403,84 +2089,60 @@ QString DBRepository::clear()
     return QStringLiteral("");
 }
 
-void DBRepository::load(Job* job, bool useCache, bool interactive)
+/**
+ * @brief downloads the repositories in parallel
+ * @param job job
+ * @param urls repository URLs
+ * @param useCache true = the HTTP cache will be used
+ * @param interactive true = allow the interaction with the user
+ * @return [ownership:caller] downloaded files in the order of the URLs. An
+ *     entry is 0 if the corresponding download failed.
+ */
+static QList<QTemporaryFile*> downloadRepositories(Job* job,
+        const QList<QUrl*>& urls, bool useCache, bool interactive)
 {
-    QString err;
-    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(&err);
-    if (urls.count() > 0) {
-        QStringList reps;
-        for (int i = 0; i < urls.size(); i++) {
-            reps.append(urls.at(i)->toString(QUrl::FullyEncoded));
-        }
-
-        err = saveRepositories(reps);
-        if (!err.isEmpty())
-            job->setErrorMessage(
-                    QObject::tr("Error saving the list of repositories in the database: %1").arg(
-                    err));
-
-        QList<QFuture<QTemporaryFile*> > files;
-        for (int i = 0; i < urls.count(); i++) {
-            QUrl* url = urls.at(i);
-            Job* s = job->newSubJob(0.1,
-                    QObject::tr("Downloading %1").
-                    arg(url->toDisplayString()), false, true);
-
-            Downloader::Request request = *url;
-            request.useCache = useCache;
-            request.interactive = interactive;
-            QFuture<QTemporaryFile*> future = QtConcurrent::run(
-                    Downloader::downloadToTemporary, s, request);
-            files.append(future);
-        }
-
-        for (int i = 0; i < urls.count(); i++) {
-            files[i].waitForFinished();
-
-            job->setProgress((i + 1.0) / urls.count() * 0.5);
-        }
-
-        for (int i = 0; i < urls.count(); i++) {
-            if (!job->shouldProceed())
-                break;
-
-            QTemporaryFile* tf = files.at(i).result();
-            Job* s = job->newSubJob(0.49 / urls.count(), QString(
-                    QObject::tr("Repository %1 of %2")).arg(i + 1).
-                    arg(urls.count()));
-            this->currentRepository = i;
-            // this is currently unnecessary clearRepository(i);
-            loadOne(s, tf, *urls.at(i));
-            if (!s->getErrorMessage().isEmpty()) {
-                job->setErrorMessage(QString(
-                        QObject::tr("Error loading the repository %1: %2")).arg(
-                        urls.at(i)->toString()).arg(
-                        s->getErrorMessage()));
-                break;
-            }
-        }
+    QList<QFuture<QTemporaryFile*> > files;
+    for (int i = 0; i < urls.count(); i++) {
+        QUrl* url = urls.at(i);
+        Job* s = job->newSubJob(0.1,
+                QObject::tr("Downloading %1").
+                arg(url->toDisplayString()), false, true);
 
-        for (int i = 0; i < urls.count(); i++) {
-            if (!job->shouldProceed())
-                break;
-
-            QTemporaryFile* tf = files.at(i).result();
-            delete tf;
-        }
-    } else {
-        job->setErrorMessage(QObject::tr("No repositories defined"));
-        job->setProgress(1);
+        Downloader::Request request = *url;
+        request.useCache = useCache;
+        request.interactive = interactive;
+        QFuture<QTemporaryFile*> future = QtConcurrent::run(
+                Downloader::downloadToTemporary, s, request);
+        files.append(future);
     }
 
-    // qDebug() << "Repository::load.3";
+    QList<QTemporaryFile*> r;
+    for (int i = 0; i < urls.count(); i++) {
+        files[i].waitForFinished();
+        r.append(files.at(i).result());
 
-    qDeleteAll(urls);
-    urls.clear();
+        job->setProgress((i + 1.0) / urls.count());
+    }
 
     job->complete();
+
+    return r;
 }
 
-void DBRepository::loadOne(Job* job, QFile* f, const QUrl& url) {
+/**
+ * @brief parses a downloaded repository into a queue. This function does not
+ *     access the database and can be called from any thread. The queue is
+ *     closed or aborted at the end.
+ * @param job job
+ * @param f the repository in XML or ZIP format
+ * @param url URL of the repository. Relative URLs are resolved against it.
+ * @param queue the parsed packages, package versions and licenses will be
+ *     stored here
+ */
+static void parseRepository(Job* job, QFile* f, const QUrl& url,
+        RepositoryQueue* queue)
+{
+    QFile* xml = f;
     QTemporaryDir* dir = 0;
     if (job->shouldProceed()) {
         if (f->open(QFile::ReadOnly) &&
@@ -1500,7 +2162,7 @@ void DBRepository::loadOne(Job* job, QFile* f, const QUrl& url) {
                 } else {
                     QString repfn = dir->path() + QStringLiteral("\\Rep.xml");
                     if (QFile::exists(repfn)) {
-                        f = new QFile(repfn);
+                        xml = new QFile(repfn);
                     } else {
                         job->setErrorMessage(QObject::tr(
                                 "Rep.xml is missing in a repository in ZIP format"));
@@ -1513,141 +2175,974 @@ void DBRepository::loadOne(Job* job, QFile* f, const QUrl& url) {
 
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.9, QObject::tr("Parsing XML"));
-        RepositoryXMLHandler handler(this, url);
-        QXmlSimpleReader reader;
-        reader.setContentHandler(&handler);
-        reader.setErrorHandler(&handler);
-        QXmlInputSource inputSource(f);
-        if (!reader.parse(inputSource))
+        RepositoryXMLHandler handler(queue, url);
+        QXmlStreamReader reader(xml);
+        if (!xml->open(QFile::ReadOnly))
+            job->setErrorMessage(xml->errorString());
+        else if (!handler.parse(&reader))
             job->setErrorMessage(handler.errorString());
         else {
             sub->completeWithProgress();
             job->setProgress(1);
         }
+        xml->close();
     }
 
+    if (xml != f)
+        delete xml;
     delete dir;
 
+    if (job->getErrorMessage().isEmpty())
+        queue->close();
+    else
+        queue->abort(job->getErrorMessage());
+
     job->complete();
 }
 
-void DBRepository::updateF5(Job* job, bool interactive)
+void DBRepository::load(Job* job, bool useCache, bool interactive)
 {
-    bool transactionStarted = false;
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.01,
-                QObject::tr("Starting an SQL transaction (tempdb)"));
-        QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
+    QString err;
+    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(&err);
+    if (urls.count() > 0) {
+        QStringList reps;
+        for (int i = 0; i < urls.size(); i++) {
+            reps.append(urls.at(i)->toString(QUrl::FullyEncoded));
+        }
+
+        err = saveRepositories(reps);
+        if (!err.isEmpty())
+            job->setErrorMessage(
+                    QObject::tr("Error saving the list of repositories in the database: %1").arg(
+                    err));
+
+        Job* sub = job->newSubJob(0.5,
+                QObject::tr("Downloading the remote repositories"),
+                true, true);
+        QList<QTemporaryFile*> files = downloadRepositories(sub, urls,
+                useCache, interactive);
+
+        // all repositories are parsed in parallel, but only this thread
+        // writes to the database. The parsers wait if their queues are full.
+        QList<Job*> parseJobs;
+        QList<RepositoryQueue*> queues;
+        QList<QFuture<void> > parsed;
+        if (job->shouldProceed()) {
+            for (int i = 0; i < urls.count(); i++) {
+                Job* s = job->newSubJob(0.1,
+                        QObject::tr("Parsing %1").
+                        arg(urls.at(i)->toDisplayString()), false, false);
+                parseJobs.append(s);
+                RepositoryQueue* queue = new RepositoryQueue();
+                queues.append(queue);
+                parsed.append(QtConcurrent::run(parseRepository, s,
+                        static_cast<QFile*>(files.at(i)), *urls.at(i),
+                        queue));
+            }
+        }
+
+        // the repositories are stored in the order of their URLs so that
+        // the first repository defining a package wins
+        for (int i = 0; i < parsed.count(); i++) {
+            RepositoryQueue* queue = queues.at(i);
+
+            if (job->shouldProceed()) {
+                Job* s = job->newSubJob(0.49 / urls.count(), QString(
+                        QObject::tr("Repository %1 of %2")).arg(i + 1).
+                        arg(urls.count()));
+                this->currentRepository = i;
+                // this is currently unnecessary clearRepository(i);
+                QString e = queue->writeTo(this);
+                parsed[i].waitForFinished();
+                if (!parseJobs.at(i)->getErrorMessage().isEmpty())
+                    e = parseJobs.at(i)->getErrorMessage();
+                if (!e.isEmpty()) {
+                    job->setErrorMessage(QString(
+                            QObject::tr("Error loading the repository %1: %2")).arg(
+                            urls.at(i)->toString()).arg(e));
+                } else {
+                    s->completeWithProgress();
+                }
+            } else {
+                // the parser may be waiting for the writer
+                queue->abort(job->getErrorMessage());
+                parsed[i].waitForFinished();
+            }
+
+            // the SHA-1 is used by the next incremental update
+            if (job->shouldProceed()) {
+                setRepositorySHA1(reps.at(i),
+                        WPMUtils::sha1(files.at(i)->fileName()), &err);
+                if (!err.isEmpty())
+                    job->setErrorMessage(err);
+            }
+        }
+        qDeleteAll(queues);
+
+        qDeleteAll(files);
+    } else {
+        job->setErrorMessage(QObject::tr("No repositories defined"));
+        job->setProgress(1);
+    }
+
+    // qDebug() << "Repository::load.3";
+
+    qDeleteAll(urls);
+    urls.clear();
+
+    job->complete();
+}
+
+void DBRepository::loadOne(Job* job, QFile* f, const QUrl& url) {
+    if (job->shouldProceed()) {
+        // the parser runs in another thread and this thread writes the data
+        Job* sub = job->newSubJob(1, QObject::tr("Parsing the repository"),
+                true, false);
+        RepositoryQueue queue;
+        QFuture<void> parsed = QtConcurrent::run(parseRepository, sub, f,
+                url, &queue);
+        QString err = queue.writeTo(this);
+        parsed.waitForFinished();
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+        else if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    job->complete();
+}
+
+void DBRepository::updateF5(Job* job, bool interactive)
+{
+    bool transactionStarted = false;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Starting an SQL transaction (tempdb)"));
+        QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else {
+            sub->completeWithProgress();
+            transactionStarted = true;
+        }
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Clearing the database"));
+        QString err = clear();
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.27,
+                QObject::tr("Downloading the remote repositories and filling the local database (tempdb)"));
+        load(sub, true, interactive);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.4,
+                QObject::tr("Refreshing the installation status (tempdb)"));
+        InstalledPackages ip(*InstalledPackages::getDefault());
+        ip.refresh(this, sub);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.06,
+                QObject::tr("Updating the status for installed packages in the database (tempdb)"));
+        updateStatusForInstalled(sub);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.05,
+                QObject::tr("Removing packages without versions"));
+        QString err = exec(QStringLiteral(
+                "DELETE FROM PACKAGE WHERE STATUS=0 AND NOT EXISTS "
+                "(SELECT 1 FROM PACKAGE_VERSION "
+                "WHERE PACKAGE = PACKAGE.NAME AND URL <>'')"));
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        QList<InstalledPackageVersion*> installed =
+                InstalledPackages::getDefault()->getAll();
+        QString err = saveInstalled(installed);
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            job->setProgress(0.85);
+
+        qDeleteAll(installed);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.05,
+                QObject::tr("Commiting the SQL transaction (tempdb)"));
+        QString err = exec(QStringLiteral("COMMIT"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    } else {
+        if (transactionStarted)
+            exec(QStringLiteral("ROLLBACK"));
+
+        // the cached IDs may come from the rolled back transaction
+        categoryIDs.clear();
+        words.clear();
+    }
+
+    /*QString error;
+    //tempFile.setAutoRemove(false);
+    qDebug() << "packages in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE", &error);
+    qDebug() << error;
+    qDebug() << "package versions in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE_VERSION", &error);
+    qDebug() << error;
+    qDebug() << tempFile.fileName();
+    */
+
+    /*
+    qDebug() << "packages in db" << count("SELECT COUNT(*) FROM PACKAGE", &error);
+    qDebug() << error;
+    qDebug() << "package versions in db" << count("SELECT COUNT(*) FROM PACKAGE_VERSION", &error);
+    qDebug() << error;
+    qDebug() << tempFile.fileName();
+    */
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.1,
+                QObject::tr("Reading categories"));
+        QString err = readCategories();
+        if (err.isEmpty()) {
+            sub->completeWithProgress();
+            job->setProgress(1);
+        } else
+            job->setErrorMessage(err);
+    }
+
+    job->complete();
+}
+
+bool DBRepository::canUpdateIncrementally(QString* err)
+{
+    *err = QStringLiteral("");
+
+    bool r = false;
+
+    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(err);
+    QStringList reps;
+    if (err->isEmpty()) {
+        for (int i = 0; i < urls.size(); i++) {
+            reps.append(urls.at(i)->toString(QUrl::FullyEncoded));
+        }
+    }
+
+    QStringList saved;
+    if (err->isEmpty())
+        saved = readRepositories(err);
+
+    if (err->isEmpty()) {
+        r = reps.count() > 0 && reps == saved;
+        for (int i = 0; i < reps.count(); i++) {
+            if (!r)
+                break;
+
+            QString sha1 = getRepositorySHA1(reps.at(i), err);
+            if (!err->isEmpty() || sha1.isEmpty())
+                r = false;
+        }
+    }
+
+    qDeleteAll(urls);
+
+    return r;
+}
+
+void DBRepository::updateF5Incremental(Job* job, bool interactive)
+{
+    QString err;
+    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(&err);
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+    else if (urls.count() == 0)
+        job->setErrorMessage(QObject::tr("No repositories defined"));
+
+    QList<QTemporaryFile*> files;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.2,
+                QObject::tr("Downloading the remote repositories"),
+                true, true);
+        files = downloadRepositories(sub, urls, true, interactive);
+    }
+
+    // package versions installed before the update as "package/version"
+    QSet<QString> installedBefore;
+    if (job->shouldProceed()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("SELECT PACKAGE, VERSION FROM INSTALLED")) ||
+                !q.exec())
+            job->setErrorMessage(getErrorString(q));
+        else {
+            while (q.next()) {
+                installedBefore.insert(q.value(0).toString() +
+                        QStringLiteral("/") + q.value(1).toString());
+            }
+        }
+    }
+
+    bool transactionStarted = false;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Starting an SQL transaction"));
+        QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else {
+            sub->completeWithProgress();
+            transactionStarted = true;
+        }
+
+        // the category IDs are re-read in each transaction
+        categoryIDs.clear();
+    }
+
+    // names of the packages where the status should be re-computed
+    QSet<QString> packages;
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.21,
+                QObject::tr("Applying the changed repositories"));
+        updateRepositories(sub, urls, files, &packages);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.4,
+                QObject::tr("Refreshing the installation status"));
+        InstalledPackages ip(*InstalledPackages::getDefault());
+        ip.refresh(this, sub);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.04,
+                QObject::tr("Saving the installed package versions"));
+        QList<InstalledPackageVersion*> installed =
+                InstalledPackages::getDefault()->getAll();
+        QSet<QString> installedAfter;
+        for (int i = 0; i < installed.count(); i++) {
+            InstalledPackageVersion* ipv = installed.at(i);
+            if (ipv->installed())
+                installedAfter.insert(ipv->package + QStringLiteral("/") +
+                        ipv->version.getVersionString());
+        }
+
+        QSet<QString> changed = installedAfter - installedBefore;
+        changed.unite(installedBefore - installedAfter);
+        QSetIterator<QString> it(changed);
+        while (it.hasNext()) {
+            QString pv = it.next();
+            packages.insert(pv.left(pv.lastIndexOf('/')));
+        }
+
+        QString err = exec(QStringLiteral("DELETE FROM INSTALLED"));
+        if (err.isEmpty())
+            err = saveInstalled(installed);
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+
+        qDeleteAll(installed);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.06,
+                QObject::tr("Updating the status for the changed packages"));
+        QList<QString> names = packages.values();
+        for (int i = 0; i < names.count(); i++) {
+            QString err = updateStatus(names.at(i));
+            if (!err.isEmpty()) {
+                job->setErrorMessage(err);
+                break;
+            }
+            sub->setProgress((i + 1.0) / names.count());
+        }
+        if (job->shouldProceed())
+            sub->completeWithProgress();
+    }
+
+    // packages that are not installed and not available have the status 3
+    // after updateStatus()
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.03,
+                QObject::tr("Removing packages without versions"));
+        QString err = exec(QStringLiteral(
+                "DELETE FROM PACKAGE WHERE STATUS IN (0, 3) AND NOT EXISTS "
+                "(SELECT 1 FROM PACKAGE_VERSION "
+                "WHERE PACKAGE = PACKAGE.NAME AND URL <>'')"));
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.04,
+                QObject::tr("Commiting the SQL transaction"));
+        QString err = exec(QStringLiteral("COMMIT"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    } else {
+        if (transactionStarted)
+            exec(QStringLiteral("ROLLBACK"));
+    }
+
+    // the cached data may be out of date now
+    words.clear();
+    licenses.clear();
+    categoryIDs.clear();
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Reading categories"));
+        QString err = readCategories();
+        if (err.isEmpty()) {
+            sub->completeWithProgress();
+            job->setProgress(1);
+        } else
+            job->setErrorMessage(err);
+    }
+
+    qDeleteAll(files);
+    qDeleteAll(urls);
+
+    job->complete();
+}
+
+void DBRepository::updateRepositories(Job* job, const QList<QUrl*>& urls,
+        const QList<QTemporaryFile*>& files, QSet<QString>* packages)
+{
+    // the detected packages are always re-created by InstalledPackages
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.05,
+                QObject::tr("Removing the detected packages"));
+        QString err = deleteRepositoryRows(DETECTION_REPOSITORY, packages);
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+    }
+
+    // if some rows were deleted in a repository, they may be defined in
+    // one of the following repositories and all of them have to be
+    // reprocessed
+    bool reload = false;
+    for (int i = 0; i < urls.count(); i++) {
+        if (!job->shouldProceed())
+            break;
+
+        QTemporaryFile* tf = files.at(i);
+        Job* s = job->newSubJob(0.95 / urls.count(), QString(
+                QObject::tr("Repository %1 of %2")).arg(i + 1).
+                arg(urls.count()));
+
+        QString err;
+        QString url = urls.at(i)->toString(QUrl::FullyEncoded);
+        QString sha1 = WPMUtils::sha1(tf->fileName());
+        QString oldSHA1 = getRepositorySHA1(url, &err);
+        if (!err.isEmpty()) {
+            job->setErrorMessage(err);
+            break;
+        }
+
+        if (reload || sha1 != oldSHA1) {
+            bool deleted = false;
+            updateRepository(s, i, tf, *urls.at(i), &deleted, packages);
+            if (!s->getErrorMessage().isEmpty()) {
+                job->setErrorMessage(QString(
+                        QObject::tr("Error loading the repository %1: %2")).arg(
+                        urls.at(i)->toString()).arg(
+                        s->getErrorMessage()));
+                break;
+            }
+            if (deleted)
+                reload = true;
+
+            setRepositorySHA1(url, sha1, &err);
+            if (!err.isEmpty()) {
+                job->setErrorMessage(err);
+                break;
+            }
+        } else {
+            s->completeWithProgress();
+        }
+    }
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+}
+
+void DBRepository::updateRepository(Job* job, int repository, QFile* f,
+        const QUrl& url, bool* deleted, QSet<QString>* packages)
+{
+    DBRepository repdb;
+
+    QTemporaryFile tempFile;
+    if (job->shouldProceed()) {
+        if (!tempFile.open()) {
+            job->setErrorMessage(QObject::tr("Error creating a temporary file"));
+        } else {
+            tempFile.close();
+            QString err = repdb.open(QStringLiteral("repository"),
+                    tempFile.fileName());
+            if (!err.isEmpty())
+                job->setErrorMessage(err);
+            else
+                job->setProgress(0.05);
+        }
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.65, QObject::tr("Parsing the repository"));
+        repdb.currentRepository = repository;
+        QString err = repdb.exec(QStringLiteral("BEGIN TRANSACTION"));
+        if (err.isEmpty()) {
+            repdb.loadOne(sub, f, url);
+            if (sub->getErrorMessage().isEmpty())
+                err = repdb.exec(QStringLiteral("COMMIT"));
+            else {
+                repdb.exec(QStringLiteral("ROLLBACK"));
+                err = sub->getErrorMessage();
+            }
+        }
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.3, QObject::tr("Applying the changes"));
+        this->currentRepository = repository;
+        QString err = applyRepositoryChanges(&repdb, repository, deleted,
+                packages);
+        if (err.isEmpty())
+            sub->completeWithProgress();
+        else
+            job->setErrorMessage(err);
+    }
+
+    repdb.db.close();
+
+    job->complete();
+}
+
+/**
+ * @brief decides whether a row from a repository should be written
+ * @param owners key => index of the repository that currently defines the row
+ * @param oldHashSums key => hash sum of the rows currently defined by the
+ *     repository
+ * @param key key of the row
+ * @param hashSum new hash sum of the row
+ * @param repository index of the repository
+ * @return true = the row is new, changed or was defined by a repository with
+ *     a higher index
+ */
+static bool shouldWrite(const QHash<QString, int>& owners,
+        const QHash<QString, QByteArray>& oldHashSums, const QString& key,
+        const QByteArray& hashSum, int repository)
+{
+    bool r;
+    int owner = owners.value(key, -1);
+    if (owner < 0 || owner > repository)
+        r = true;
+    else if (owner == repository)
+        r = oldHashSums.value(key) != hashSum;
+    else
+        r = false;
+    return r;
+}
+
+/**
+ * @brief prepares a package read from a database for saving in another one.
+ *     readLinks() and saveLinks() reverse the order of the links with the
+ *     same rel.
+ * @param p a package
+ */
+static void preparePackageForSaving(Package* p)
+{
+    QMultiMap<QString, QString> links;
+    QList<QString> rels = p->links.uniqueKeys();
+    for (int i = 0; i < rels.count(); i++) {
+        QList<QString> hrefs = p->links.values(rels.at(i));
+        for (int j = 0; j < hrefs.count(); j++) {
+            links.insert(rels.at(i), hrefs.at(j));
+        }
+    }
+    p->links = links;
+
+    if (p->categories.count() == 1 && p->categories.at(0).isEmpty())
+        p->categories.clear();
+}
+
+QString DBRepository::applyRepositoryChanges(DBRepository* from,
+        int repository, bool* deleted, QSet<QString>* packages)
+{
+    QString err = from->readCategories();
+
+    // links are hashed together with their packages
+    QString linksSQL = QStringLiteral("SELECT LINK.PACKAGE, LINK.REL, "
+            "LINK.HREF FROM LINK JOIN PACKAGE ON PACKAGE.NAME = LINK.PACKAGE "
+            "WHERE PACKAGE.REPOSITORY = :REPOSITORY "
+            "ORDER BY LINK.PACKAGE, LINK.INDEX_");
+    QString packagesSQL = QStringLiteral("SELECT P.NAME, P.TITLE, P.URL, "
+            "P.ICON, P.DESCRIPTION, P.LICENSE, "
+            "C0.NAME, C1.NAME, C2.NAME, C3.NAME, C4.NAME "
+            "FROM PACKAGE P "
+            "LEFT JOIN CATEGORY C0 ON C0.ID = P.CATEGORY0 "
+            "LEFT JOIN CATEGORY C1 ON C1.ID = P.CATEGORY1 "
+            "LEFT JOIN CATEGORY C2 ON C2.ID = P.CATEGORY2 "
+            "LEFT JOIN CATEGORY C3 ON C3.ID = P.CATEGORY3 "
+            "LEFT JOIN CATEGORY C4 ON C4.ID = P.CATEGORY4 "
+            "WHERE P.REPOSITORY = :REPOSITORY");
+    QString versionsSQL = QStringLiteral("SELECT PACKAGE || '/' || NAME, "
+            "CONTENT FROM PACKAGE_VERSION WHERE REPOSITORY = :REPOSITORY");
+    QString licensesSQL = QStringLiteral("SELECT NAME, TITLE, DESCRIPTION, "
+            "URL FROM LICENSE WHERE REPOSITORY = :REPOSITORY");
+
+    // packages
+    QHash<QString, QByteArray> oldHashSums, newHashSums;
+    QHash<QString, int> owners;
+    if (err.isEmpty())
+        err = readHashSums(linksSQL, repository, &oldHashSums);
+    if (err.isEmpty())
+        err = readHashSums(packagesSQL, repository, &oldHashSums);
+    if (err.isEmpty())
+        err = from->readHashSums(linksSQL, repository, &newHashSums);
+    if (err.isEmpty())
+        err = from->readHashSums(packagesSQL, repository, &newHashSums);
+    if (err.isEmpty())
+        err = readOwners(QStringLiteral("SELECT NAME, REPOSITORY FROM PACKAGE"),
+                &owners);
+
+    if (err.isEmpty()) {
+        QHashIterator<QString, QByteArray> it(newHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (shouldWrite(owners, oldHashSums, it.key(), it.value(),
+                    repository)) {
+                Package* p = from->findPackage_(it.key());
+                if (p) {
+                    preparePackageForSaving(p);
+                    err = savePackage(p, true);
+                    packages->insert(p->name);
+                    delete p;
+                }
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        QHashIterator<QString, QByteArray> it(oldHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (!newHashSums.contains(it.key())) {
+                err = deletePackage(it.key());
+                packages->insert(it.key());
+                *deleted = true;
+            }
+        }
+    }
+
+    // package versions
+    oldHashSums.clear();
+    newHashSums.clear();
+    owners.clear();
+    if (err.isEmpty())
+        err = readHashSums(versionsSQL, repository, &oldHashSums);
+    if (err.isEmpty())
+        err = from->readHashSums(versionsSQL, repository, &newHashSums);
+    if (err.isEmpty())
+        err = readOwners(QStringLiteral("SELECT PACKAGE || '/' || NAME, "
+                "REPOSITORY FROM PACKAGE_VERSION"), &owners);
+
+    if (err.isEmpty()) {
+        QHashIterator<QString, QByteArray> it(newHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (shouldWrite(owners, oldHashSums, it.key(), it.value(),
+                    repository)) {
+                int pos = it.key().lastIndexOf('/');
+                QString package = it.key().left(pos);
+                Version version;
+                if (version.setVersion(it.key().mid(pos + 1))) {
+                    PackageVersion* pv = from->findPackageVersion_(package,
+                            version, &err);
+                    if (pv) {
+                        err = savePackageVersion(pv, true);
+                        delete pv;
+                    }
+                    packages->insert(package);
+                }
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        QHashIterator<QString, QByteArray> it(oldHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (!newHashSums.contains(it.key())) {
+                int pos = it.key().lastIndexOf('/');
+                QString package = it.key().left(pos);
+                Version version;
+                if (version.setVersion(it.key().mid(pos + 1)))
+                    err = deletePackageVersion(package, version);
+                packages->insert(package);
+                *deleted = true;
+            }
+        }
+    }
+
+    // licenses
+    oldHashSums.clear();
+    newHashSums.clear();
+    owners.clear();
+    if (err.isEmpty())
+        err = readHashSums(licensesSQL, repository, &oldHashSums);
+    if (err.isEmpty())
+        err = from->readHashSums(licensesSQL, repository, &newHashSums);
+    if (err.isEmpty())
+        err = readOwners(QStringLiteral("SELECT NAME, REPOSITORY FROM LICENSE"),
+                &owners);
+
+    if (err.isEmpty()) {
+        QHashIterator<QString, QByteArray> it(newHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (shouldWrite(owners, oldHashSums, it.key(), it.value(),
+                    repository)) {
+                License* lic = from->findLicense_(it.key(), &err);
+                if (lic) {
+                    err = saveLicense(lic, true);
+                    delete lic;
+                }
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("DELETE FROM LICENSE WHERE NAME = :NAME")))
+            err = getErrorString(q);
+
+        QHashIterator<QString, QByteArray> it(oldHashSums);
+        while (it.hasNext() && err.isEmpty()) {
+            it.next();
+            if (!newHashSums.contains(it.key())) {
+                q.bindValue(QStringLiteral(":NAME"), it.key());
+                if (!q.exec())
+                    err = getErrorString(q);
+                *deleted = true;
+            }
+        }
+    }
+
+    return err;
+}
+
+QString DBRepository::readHashSums(const QString& sql, int repository,
+        QHash<QString, QByteArray>* r) const
+{
+    QString err;
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":REPOSITORY"), repository);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
+
+    if (err.isEmpty()) {
+        int n = q.record().count();
+        while (q.next()) {
+            QString key = q.value(0).toString();
+
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            hash.addData(r->value(key));
+            for (int c = 1; c < n; c++) {
+                QVariant v = q.value(c);
+                QByteArray data = v.toByteArray();
+
+                // the length is stored to separate the values
+                if (v.isNull())
+                    hash.addData(QByteArray("-1:"));
+                else
+                    hash.addData(QByteArray::number(data.length()) + ':');
+                hash.addData(data);
+            }
+            r->insert(key, hash.result());
+        }
+    }
+
+    return err;
+}
+
+QString DBRepository::readOwners(const QString& sql,
+        QHash<QString, int>* r) const
+{
+    QString err;
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql) || !q.exec())
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        while (q.next()) {
+            QVariant v = q.value(1);
+            r->insert(q.value(0).toString(), v.isNull() ? -1 : v.toInt());
+        }
+    }
+
+    return err;
+}
+
+QString DBRepository::deleteRepositoryRows(int repository,
+        QSet<QString>* packages)
+{
+    QString err;
+
+    MySQLQuery q(db);
+    if (!q.prepare(QStringLiteral("SELECT NAME FROM PACKAGE "
+            "WHERE REPOSITORY = :REPOSITORY "
+            "UNION SELECT PACKAGE FROM PACKAGE_VERSION "
+            "WHERE REPOSITORY = :REPOSITORY")))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":REPOSITORY"), repository);
+        if (!q.exec())
+            err = getErrorString(q);
         else {
-            sub->completeWithProgress();
-            transactionStarted = true;
+            while (q.next()) {
+                packages->insert(q.value(0).toString());
+            }
         }
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.01,
-                QObject::tr("Clearing the database"));
-        QString err = clear();
-        if (err.isEmpty())
-            sub->completeWithProgress();
-        else
-            job->setErrorMessage(err);
-    }
+    QString owned = QStringLiteral("SELECT NAME FROM PACKAGE "
+            "WHERE REPOSITORY = %1").arg(repository);
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM LINK WHERE PACKAGE IN (") +
+                owned + QStringLiteral(")"));
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM PACKAGE_WORD "
+                "WHERE PACKAGE IN (") + owned + QStringLiteral(")"));
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM PACKAGE WHERE REPOSITORY = %1").
+                arg(repository));
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.27,
-                QObject::tr("Downloading the remote repositories and filling the local database (tempdb)"));
-        load(sub, true, interactive);
-        if (!sub->getErrorMessage().isEmpty())
-            job->setErrorMessage(sub->getErrorMessage());
-    }
+    QStringList tables;
+    tables << QStringLiteral("CMD_FILE") <<
+            QStringLiteral("DEPENDENCY");
+    for (int i = 0; i < tables.count(); i++) {
+        if (!err.isEmpty())
+            break;
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.4,
-                QObject::tr("Refreshing the installation status (tempdb)"));
-        InstalledPackages ip(*InstalledPackages::getDefault());
-        ip.refresh(this, sub);
-        if (!sub->getErrorMessage().isEmpty())
-            job->setErrorMessage(sub->getErrorMessage());
+        err = exec(QStringLiteral("DELETE FROM %1 WHERE EXISTS "
+                "(SELECT 1 FROM PACKAGE_VERSION "
+                "WHERE REPOSITORY = %2 AND "
+                "PACKAGE_VERSION.PACKAGE = %1.PACKAGE AND "
+                "PACKAGE_VERSION.NAME = %1.VERSION)").arg(tables.at(i)).
+                arg(repository));
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.06,
-                QObject::tr("Updating the status for installed packages in the database (tempdb)"));
-        updateStatusForInstalled(sub);
-        if (!sub->getErrorMessage().isEmpty())
-            job->setErrorMessage(sub->getErrorMessage());
-    }
+    if (err.isEmpty())
+        err = exec(QStringLiteral(
+                "DELETE FROM PACKAGE_VERSION WHERE REPOSITORY = %1").
+                arg(repository));
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM LICENSE WHERE REPOSITORY = %1").
+                arg(repository));
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.05,
-                QObject::tr("Removing packages without versions"));
-        QString err = exec(QStringLiteral(
-                "DELETE FROM PACKAGE WHERE STATUS=0 AND NOT EXISTS "
-                "(SELECT 1 FROM PACKAGE_VERSION "
-                "WHERE PACKAGE = PACKAGE.NAME AND URL <>'')"));
-        if (err.isEmpty())
-            sub->completeWithProgress();
-        else
-            job->setErrorMessage(err);
-    }
+    return err;
+}
 
-    if (job->shouldProceed()) {
-        QList<InstalledPackageVersion*> installed =
-                InstalledPackages::getDefault()->getAll();
-        QString err = saveInstalled(installed);
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
-        else
-            job->setProgress(0.85);
+QString DBRepository::deletePackage(const QString& name)
+{
+    QString err = deleteLinks(name);
 
-        qDeleteAll(installed);
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("DELETE FROM PACKAGE WHERE NAME = :NAME")))
+            err = getErrorString(q);
+        else {
+            q.bindValue(QStringLiteral(":NAME"), name);
+            if (!q.exec())
+                err = getErrorString(q);
+        }
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.05,
-                QObject::tr("Commiting the SQL transaction (tempdb)"));
-        QString err = exec(QStringLiteral("COMMIT"));
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
-        else
-            sub->completeWithProgress();
-    } else {
-        if (transactionStarted)
-            exec(QStringLiteral("ROLLBACK"));
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral(
+                "DELETE FROM PACKAGE_WORD WHERE PACKAGE = :PACKAGE")))
+            err = getErrorString(q);
+        else {
+            q.bindValue(QStringLiteral(":PACKAGE"), name);
+            if (!q.exec())
+                err = getErrorString(q);
+        }
     }
 
-    /*QString error;
-    //tempFile.setAutoRemove(false);
-    qDebug() << "packages in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE", &error);
-    qDebug() << error;
-    qDebug() << "package versions in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE_VERSION", &error);
-    qDebug() << error;
-    qDebug() << tempFile.fileName();
-    */
+    return err;
+}
 
-    /*
-    qDebug() << "packages in db" << count("SELECT COUNT(*) FROM PACKAGE", &error);
-    qDebug() << error;
-    qDebug() << "package versions in db" << count("SELECT COUNT(*) FROM PACKAGE_VERSION", &error);
-    qDebug() << error;
-    qDebug() << tempFile.fileName();
-    */
+QString DBRepository::deletePackageVersion(const QString& package,
+        const Version& version)
+{
+    QString err = deletePackageVersionDetails(package, version);
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.1,
-                QObject::tr("Reading categories"));
-        QString err = readCategories();
-        if (err.isEmpty()) {
-            sub->completeWithProgress();
-            job->setProgress(1);
-        } else
-            job->setErrorMessage(err);
+    if (err.isEmpty())
+        err = deleteCmdFiles(package, version);
+
+    if (err.isEmpty()) {
+        Version v(version);
+        v.normalize();
+
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("DELETE FROM PACKAGE_VERSION "
+                "WHERE PACKAGE = :PACKAGE AND NAME = :NAME")))
+            err = getErrorString(q);
+        else {
+            q.bindValue(QStringLiteral(":PACKAGE"), package);
+            q.bindValue(QStringLiteral(":NAME"), v.getVersionString());
+            if (!q.exec())
+                err = getErrorString(q);
+        }
     }
 
-    job->complete();
+    return err;
 }
 
 void DBRepository::updateF5Runnable(Job *job)
@@ -1660,32 +3155,65 @@ void DBRepository::updateF5Runnable(Job *job)
             THREAD_MODE_BACKGROUND_BEGIN);
     */
 
+    DBRepository dbr;
+
+    if (job->shouldProceed()) {
+        QString err = dbr.openDefault(QStringLiteral("recognize"));
+        if (!err.isEmpty()) {
+            job->setErrorMessage(QObject::tr("Error opening the database: %1").
+                    arg(err));
+        } else {
+            job->setProgress(0.01);
+        }
+    }
+
+    // the database is only re-created from scratch if the list of
+    // repositories changed or the last update did not succeed
+    bool incremental = false;
+    if (job->shouldProceed()) {
+        QString err;
+        incremental = dbr.canUpdateIncrementally(&err);
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed() && incremental) {
+        Job* sub = job->newSubJob(0.99,
+                QObject::tr("Updating the database"), true, true);
+        CoInitialize(0);
+        dbr.updateF5Incremental(sub);
+        CoUninitialize();
+    }
+
     DBRepository tempdb;
 
-    QTemporaryFile tempFile;
+    // the new database is created in the same directory so that it can be
+    // renamed to the next generation of the default database
+    QTemporaryFile tempFile(getDefaultDir() +
+            QStringLiteral("\\Data-XXXXXX.tmp"));
     bool tempDatabaseOpen = false;
-    if (job->shouldProceed()) {
+    if (job->shouldProceed() && !incremental) {
         if (!tempFile.open()) {
             job->setErrorMessage(QObject::tr("Error creating a temporary file"));
         } else {
             tempFile.close();
-            job->setProgress(0.01);
+            job->setProgress(0.02);
         }
     }
 
-    if (job->shouldProceed()) {
+    if (job->shouldProceed() && !incremental) {
         QString err = tempdb.open(QStringLiteral("tempdb"),
                 tempFile.fileName());
         if (!err.isEmpty())
             job->setErrorMessage(err);
         else {
             tempDatabaseOpen = true;
-            job->setProgress(0.02);
+            job->setProgress(0.03);
         }
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.77,
+    if (job->shouldProceed() && !incremental) {
+        Job* sub = job->newSubJob(0.96,
                 QObject::tr("Updating the temporary database"), true, true);
         CoInitialize(0);
         tempdb.updateF5(sub);
@@ -1695,23 +3223,15 @@ void DBRepository::updateF5Runnable(Job *job)
     if (tempDatabaseOpen)
         tempdb.db.close();
 
-    DBRepository dbr;
-
-    if (job->shouldProceed()) {
-        QString err = dbr.openDefault(QStringLiteral("recognize"));
-        if (!err.isEmpty()) {
-            job->setErrorMessage(QObject::tr("Error opening the database: %1").
-                    arg(err));
-        } else {
-            job->setProgress(0.8);
-        }
-    }
-
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.2,
-                QObject::tr("Transferring the data from the temporary database"),
-                true, true);
-        dbr.transferFrom(sub, tempFile.fileName());
+    // the new database replaces the old one atomically for all
+    // connections opened later
+    if (job->shouldProceed() && !incremental) {
+        dbr.db.close();
+        QString err = publishDefault(tempFile.fileName());
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            tempFile.setAutoRemove(false);
     }
 
     if (job->shouldProceed()) {
@@ -1761,28 +3281,117 @@ void DBRepository::saveAll(Job* job, Repository* r, bool replace)
     job->complete();
 }
 
+/**
+ * @param newestInstalled newest installed version or 0
+ * @param newestInstallable newest version with a download URL or 0
+ * @return status of the package
+ */
+static Package::Status computeStatus(const Version* newestInstalled,
+        const Version* newestInstallable)
+{
+    Package::Status status;
+    if (newestInstalled) {
+        bool up2date = !(newestInstallable &&
+                newestInstallable->compare(*newestInstalled) > 0);
+        if (up2date)
+            status = Package::INSTALLED;
+        else
+            status = Package::UPDATEABLE;
+    } else {
+        if (newestInstallable)
+            status = Package::NOT_INSTALLED;
+        else
+            status = Package::NOT_INSTALLED_NOT_AVAILABLE;
+    }
+    return status;
+}
+
 void DBRepository::updateStatusForInstalled(Job* job)
 {
     QString initialTitle = job->getTitle();
 
-    QSet<QString> packages;
+    // package name => sort keys of the installed versions
+    QHash<QString, QSet<QByteArray> > installed;
     if (job->shouldProceed()) {
-        packages = InstalledPackages::getDefault()->getPackages();
+        QList<InstalledPackageVersion*> ipvs =
+                InstalledPackages::getDefault()->getAll();
+        for (int i = 0; i < ipvs.count(); i++) {
+            InstalledPackageVersion* ipv = ipvs.at(i);
+            installed[ipv->package].insert(ipv->version.toSortKey());
+        }
+        qDeleteAll(ipvs);
         job->setProgress(0.1);
     }
 
+    // the newest installed and installable versions for all installed
+    // packages are computed in one pass over the versions sorted by
+    // VERSION_KEY without reading the package version contents. Only the
+    // installed versions that are also stored in the database count, like
+    // in updateStatus().
+    QHash<QString, Version> newestInstalled;
+    QHash<QString, Version> newestInstallable;
+    if (job->shouldProceed()) {
+        job->setTitle(initialTitle + QStringLiteral(" / ") +
+                QObject::tr("Searching for the newest versions"));
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral(
+                "SELECT PACKAGE, NAME, URL, VERSION_KEY FROM PACKAGE_VERSION "
+                "ORDER BY PACKAGE, VERSION_KEY DESC")) ||
+                !q.exec())
+            job->setErrorMessage(getErrorString(q));
+        else {
+            while (q.next()) {
+                QString package = q.value(0).toString();
+                QHash<QString, QSet<QByteArray> >::const_iterator it =
+                        installed.constFind(package);
+                if (it == installed.constEnd())
+                    continue;
+
+                // the first matching row is the newest version
+                Version v;
+                if (!newestInstalled.contains(package) &&
+                        it.value().contains(q.value(3).toByteArray()) &&
+                        v.setVersion(q.value(1).toString()))
+                    newestInstalled.insert(package, v);
+
+                if (!newestInstallable.contains(package) &&
+                        !q.value(2).toString().isEmpty() &&
+                        v.setVersion(q.value(1).toString()))
+                    newestInstallable.insert(package, v);
+            }
+            job->setProgress(0.5);
+        }
+    }
+
     if (job->shouldProceed()) {
         job->setTitle(initialTitle + QStringLiteral(" / ") +
                 QObject::tr("Updating statuses"));
-        QList<QString> packages_ = packages.values();
-        for (int i = 0; i < packages_.count(); i++) {
-            QString package = packages_.at(i);
-            updateStatus(package);
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("UPDATE PACKAGE "
+                "SET STATUS=:STATUS "
+                "WHERE NAME=:NAME")))
+            job->setErrorMessage(getErrorString(q));
 
+        QList<QString> packages = installed.keys();
+        for (int i = 0; i < packages.count(); i++) {
             if (!job->shouldProceed())
                 break;
 
-            job->setProgress(0.1 + 0.9 * (i + 1) / packages_.count());
+            const QString& package = packages.at(i);
+            QHash<QString, Version>::const_iterator a =
+                    newestInstalled.constFind(package);
+            QHash<QString, Version>::const_iterator b =
+                    newestInstallable.constFind(package);
+            Package::Status status = computeStatus(
+                    a == newestInstalled.constEnd() ? 0 : &a.value(),
+                    b == newestInstallable.constEnd() ? 0 : &b.value());
+
+            q.bindValue(QStringLiteral(":STATUS"), status);
+            q.bindValue(QStringLiteral(":NAME"), package);
+            if (!q.exec())
+                job->setErrorMessage(getErrorString(q));
+            else
+                job->setProgress(0.5 + 0.5 * (i + 1) / packages.count());
         }
     }
 
@@ -1897,6 +3506,8 @@ QStringList DBRepository::readRepositories(QString* err)
 
 QString DBRepository::getRepositorySHA1(const QString& url, QString* err)
 {
+    *err = QStringLiteral("");
+
     QString r;
 
     QString sql = QStringLiteral("SELECT SHA1 FROM REPOSITORY WHERE URL=:URL");
@@ -1913,7 +3524,7 @@ QString DBRepository::getRepositorySHA1(const QString& url, QString* err)
             *err = getErrorString(q);
         else {
             if (q.next()) {
-                r = q.value(1).toString();
+                r = q.value(0).toString();
             }
         }
     }
@@ -1924,6 +3535,8 @@ QString DBRepository::getRepositorySHA1(const QString& url, QString* err)
 void DBRepository::setRepositorySHA1(const QString& url, const QString& sha1,
         QString* err)
 {
+    *err = QStringLiteral("");
+
     MySQLQuery q(db);
 
     QString sql = QStringLiteral(
@@ -1998,9 +3611,11 @@ QString DBRepository::updateStatus(const QString& package)
     PackageVersion* newestInstallable = 0;
     PackageVersion* newestInstalled = 0;
     if (err.isEmpty()) {
+        QSharedPointer<const InstalledPackagesSnapshot> installed =
+                InstalledPackages::getDefault()->getSnapshot();
         for (int j = 0; j < pvs.count(); j++) {
             PackageVersion* pv = pvs.at(j);
-            if (pv->installed()) {
+            if (installed->isInstalled(pv->package, pv->version)) {
                 if (!newestInstalled ||
                         newestInstalled->version.compare(pv->version) < 0)
                     newestInstalled = pv;
@@ -2017,21 +3632,9 @@ QString DBRepository::updateStatus(const QString& package)
     }
 
     if (err.isEmpty()) {
-        Package::Status status;
-        if (newestInstalled) {
-            bool up2date = !(newestInstalled && newestInstallable &&
-                    newestInstallable->version.compare(
-                    newestInstalled->version) > 0);
-            if (up2date)
-                status = Package::INSTALLED;
-            else
-                status = Package::UPDATEABLE;
-        } else {
-            if (newestInstallable)
-                status = Package::NOT_INSTALLED;
-            else
-                status = Package::NOT_INSTALLED_NOT_AVAILABLE;
-        }
+        Package::Status status = computeStatus(
+                newestInstalled ? &newestInstalled->version : 0,
+                newestInstallable ? &newestInstallable->version : 0);
 
         MySQLQuery q(db);
         if (!q.prepare(QStringLiteral("UPDATE PACKAGE "
@@ -2039,180 +3642,229 @@ QString DBRepository::updateStatus(const QString& package)
                 "WHERE NAME=:NAME")))
             err = getErrorString(q);
 
-        if (err.isEmpty()) {
-            q.bindValue(QStringLiteral(":STATUS"), status);
-            q.bindValue(QStringLiteral(":NAME"), package);
-            if (!q.exec())
-                err = getErrorString(q);
+        if (err.isEmpty()) {
+            q.bindValue(QStringLiteral(":STATUS"), status);
+            q.bindValue(QStringLiteral(":NAME"), package);
+            if (!q.exec())
+                err = getErrorString(q);
+        }
+    }
+    qDeleteAll(pvs);
+
+    // the newest generation is checked after the change so that a
+    // generation published in the meantime is also updated
+    if (err.isEmpty())
+        err = updateStatusInNewestGeneration(package);
+
+    return err;
+}
+
+QString DBRepository::updateStatusInNewestGeneration(const QString& package)
+{
+    QString err;
+
+    if (!defaultFile.isEmpty()) {
+        QString dir = getDefaultDir();
+        QList<int> generations = findGenerations(dir);
+        if (!generations.isEmpty()) {
+            QString newest = getGenerationFile(dir, generations.last());
+            if (!WPMUtils::pathEquals(newest, defaultFile)) {
+                // updateStatus() may run in several threads at once
+                DBRepository dbr;
+                err = dbr.open(QStringLiteral("newest-") + QString::number(
+                        (quintptr) QThread::currentThreadId()), newest);
+                if (err.isEmpty())
+                    err = dbr.updateStatus(package);
+                dbr.close();
+            }
+        }
+    }
+
+    return err;
+}
+
+QString DBRepository::getDefaultDir()
+{
+    QString dir = WPMUtils::getShellDir(CSIDL_COMMON_APPDATA) +
+            QStringLiteral("\\Npackd");
+    QDir d;
+    if (!d.exists(dir))
+        d.mkpath(dir);
+
+    return dir;
+}
+
+QList<int> DBRepository::findGenerations(const QString& dir)
+{
+    QList<int> r;
+
+    QDir d(dir);
+    QStringList names = d.entryList(QStringList() <<
+            QStringLiteral("Data.db") << QStringLiteral("Data-*.db"),
+            QDir::Files);
+    for (int i = 0; i < names.count(); i++) {
+        const QString& name = names.at(i);
+        if (name.compare(QStringLiteral("Data.db"),
+                Qt::CaseInsensitive) == 0) {
+            r.append(0);
+        } else {
+            // Data-N.db
+            bool ok;
+            int generation = name.mid(5, name.length() - 8).toInt(&ok);
+            if (ok && generation > 0)
+                r.append(generation);
         }
     }
-    qDeleteAll(pvs);
 
-    return err;
+    qSort(r);
+
+    return r;
 }
 
-void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
+QString DBRepository::getGenerationFile(const QString& dir, int generation)
 {
-    bool transactionStarted = false;
-
-    QString initialTitle = job->getTitle();
+    QString r;
+    if (generation == 0)
+        r = dir + QStringLiteral("\\Data.db");
+    else
+        r = dir + QStringLiteral("\\Data-") + QString::number(generation) +
+                QStringLiteral(".db");
+    return QDir::toNativeSeparators(r);
+}
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-            QObject::tr("Attaching the temporary database"));
-        QString err = exec(QStringLiteral("ATTACH '") + databaseFilename +
-                QStringLiteral("' as tempdb"));
-        if (err.isEmpty())
-            job->setProgress(0.10);
-        else
-            job->setErrorMessage(err);
-    }
+QString DBRepository::publishDefault(const QString& file)
+{
+    QString err;
 
-    /*QString error;
-    //tempFile.setAutoRemove(false);
-    qDebug() << "packages in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE", &error);
-    qDebug() << error;
-    qDebug() << "package versions in tempdb" << count("SELECT COUNT(*) FROM tempdb.PACKAGE_VERSION", &error);
-    qDebug() << error;
-    qDebug() << tempFile.fileName();
-    */
+    QString dir = getDefaultDir();
+    QList<int> generations = findGenerations(dir);
+    int generation = generations.isEmpty() ? 0 : generations.last();
+
+    // MoveFile fails if the target already exists. Another process may
+    // publish a database at the same time and we try the next generation
+    // in this case.
+    QString from = QDir::toNativeSeparators(file);
+    bool moved = false;
+    for (int i = 0; i < 10; i++) {
+        generation++;
+        QString to = getGenerationFile(dir, generation);
+        if (MoveFileW((LPCWSTR) from.utf16(), (LPCWSTR) to.utf16())) {
+            moved = true;
+            break;
+        }
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Starting an SQL transaction"));
-        QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
-        else {
-            job->setProgress(0.11);
-            transactionStarted = true;
+        DWORD e = GetLastError();
+        if (e != ERROR_ALREADY_EXISTS && e != ERROR_FILE_EXISTS) {
+            WPMUtils::formatMessage(e, &err);
+            break;
         }
     }
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Clearing the database"));
-        QString err = clear();
-        if (err.isEmpty())
-            job->setProgress(0.20);
-        else
-            job->setErrorMessage(err);
-    }
+    if (err.isEmpty() && !moved)
+        err = QObject::tr("Cannot find a free file name for the database in %1").
+                arg(dir);
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Transferring the data from the temporary database"));
+    if (!err.isEmpty())
+        err = QObject::tr("Error publishing the database %1: %2").
+                arg(from).arg(err);
 
-        // exec("DROP INDEX PACKAGE_VERSION_PACKAGE_NAME");
-        QString err = exec(QStringLiteral(
-                "INSERT INTO PACKAGE(NAME, TITLE, URL, ICON, "
-                "DESCRIPTION, LICENSE, FULLTEXT, STATUS, SHORT_NAME, "
-                "REPOSITORY, CATEGORY0, CATEGORY1, CATEGORY2, CATEGORY3, "
-                "CATEGORY4) SELECT NAME, TITLE, URL, ICON, DESCRIPTION, "
-                "LICENSE, FULLTEXT, STATUS, SHORT_NAME, REPOSITORY, "
-                "CATEGORY0, CATEGORY1, CATEGORY2, CATEGORY3, CATEGORY4 "
-                "FROM tempdb.PACKAGE"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO PACKAGE_VERSION(NAME, PACKAGE, URL, "
-                    "CONTENT, MSIGUID, DETECT_FILE_COUNT) SELECT NAME, "
-                    "PACKAGE, URL, CONTENT, MSIGUID, DETECT_FILE_COUNT "
-                    "FROM tempdb.PACKAGE_VERSION"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO LICENSE(NAME, TITLE, DESCRIPTION, URL) "
-                    "SELECT NAME, TITLE, DESCRIPTION, URL FROM tempdb.LICENSE"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO CATEGORY(ID, NAME, PARENT, LEVEL) "
-                    "SELECT ID, NAME, PARENT, LEVEL FROM tempdb.CATEGORY"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO LINK(PACKAGE, INDEX_, REL, HREF) "
-                    "SELECT PACKAGE, INDEX_, REL, HREF FROM tempdb.LINK"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO CMD_FILE(PACKAGE, VERSION, PATH, NAME) "
-                    "SELECT PACKAGE, VERSION, PATH, NAME FROM tempdb.CMD_FILE"));
-        if (err.isEmpty())
-            err = exec(QStringLiteral(
-                    "INSERT INTO INSTALLED(PACKAGE, VERSION, CVERSION, "
-                    "WHEN_, WHERE_, DETECTION_INFO) "
-                    "SELECT PACKAGE, VERSION, CVERSION, WHEN_, WHERE_, "
-                    "DETECTION_INFO FROM tempdb.INSTALLED"));
-        if (err.isEmpty())
-            job->setProgress(0.90);
-        else
-            job->setErrorMessage(err);
+    // the previous generation is kept as another process may have just
+    // found it and is about to open it. Older generations cannot be deleted
+    // while they are still open. They will be deleted after the next update.
+    // Data.db is used by older Npackd versions and always kept.
+    if (err.isEmpty()) {
+        for (int i = 0; i < generations.count() - 1; i++) {
+            if (generations.at(i) != 0)
+                QFile::remove(getGenerationFile(dir, generations.at(i)));
+        }
     }
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Commiting the SQL transaction"));
-        QString err = exec(QStringLiteral("COMMIT"));
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
-        else
-            job->setProgress(0.95);
-    } else {
-        if (transactionStarted)
-            exec(QStringLiteral("ROLLBACK"));
-    }
+    return err;
+}
 
-    /*
-    qDebug() << "packages in db" << count("SELECT COUNT(*) FROM PACKAGE", &error);
-    qDebug() << error;
-    qDebug() << "package versions in db" << count("SELECT COUNT(*) FROM PACKAGE_VERSION", &error);
-    qDebug() << error;
-    qDebug() << tempFile.fileName();
-    */
+QString DBRepository::openDefault(const QString& databaseName, bool readOnly)
+{
+    QString err;
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Detaching the temporary database"));
-        QString err;
-        for (int i = 0; i < 10; i++) {
-            err = exec(QStringLiteral("DETACH tempdb"));
-            if (err.isEmpty())
+    // open() would create an empty database if the chosen generation was
+    // deleted in the meantime. The next older generation is tried in this
+    // case and the search is repeated if all of them are gone.
+    QString dir = getDefaultDir();
+    QString path;
+    for (int attempt = 0; attempt < 3 && path.isEmpty(); attempt++) {
+        QList<int> generations = findGenerations(dir);
+
+        // the very first database is created here
+        if (generations.isEmpty())
+            path = getGenerationFile(dir, 0);
+
+        for (int i = generations.count() - 1; i >= 0; i--) {
+            QString p = getGenerationFile(dir, generations.at(i));
+            if (QFile::exists(p)) {
+                path = p;
                 break;
-            else
-                Sleep(1000);
+            }
         }
-
-        if (err.isEmpty())
-            job->setProgress(0.99);
-        else
-            job->setErrorMessage(err);
     }
 
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("Reorganizing the database"));
-        QString err = exec(QStringLiteral("VACUUM"));
-        if (!err.isEmpty())
-            job->setErrorMessage(err);
-        else
-            job->setProgress(1);
-    }
+    if (path.isEmpty())
+        err = QObject::tr("Cannot find the default database in %1").
+                arg(dir);
+    else
+        err = open(databaseName, path, readOnly);
 
-    job->setTitle(initialTitle);
+    if (err.isEmpty())
+        defaultFile = path;
 
-    job->complete();
+    return err;
 }
 
-QString DBRepository::openDefault(const QString& databaseName, bool readOnly)
+QString DBRepository::fillVersionKeys()
 {
-    QString dir = WPMUtils::getShellDir(CSIDL_COMMON_APPDATA) +
-            QStringLiteral("\\Npackd");
-    QDir d;
-    if (!d.exists(dir))
-        d.mkpath(dir);
+    QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
+
+    QList<QString> packages;
+    QList<QString> names;
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral(
+                "SELECT PACKAGE, NAME FROM PACKAGE_VERSION")) || !q.exec())
+            err = getErrorString(q);
+        else {
+            while (q.next()) {
+                packages.append(q.value(0).toString());
+                names.append(q.value(1).toString());
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral(
+                "UPDATE PACKAGE_VERSION SET VERSION_KEY = :VERSION_KEY "
+                "WHERE PACKAGE = :PACKAGE AND NAME = :NAME")))
+            err = getErrorString(q);
+
+        for (int i = 0; i < packages.count(); i++) {
+            if (!err.isEmpty())
+                break;
 
-    QString path = dir + QStringLiteral("\\Data.db");
+            Version v;
+            if (!v.setVersion(names.at(i)))
+                continue;
 
-    path = QDir::toNativeSeparators(path);
+            q.bindValue(QStringLiteral(":VERSION_KEY"), v.toSortKey());
+            q.bindValue(QStringLiteral(":PACKAGE"), packages.at(i));
+            q.bindValue(QStringLiteral(":NAME"), names.at(i));
+            if (!q.exec())
+                err = getErrorString(q);
+        }
+    }
 
-    QString err = open(databaseName, path, readOnly);
+    if (err.isEmpty())
+        err = exec(QStringLiteral("COMMIT"));
+    else
+        exec(QStringLiteral("ROLLBACK"));
 
     return err;
 }
@@ -2226,6 +3878,10 @@ QString DBRepository::updateDatabase()
     if (err.isEmpty()) {
         e = tableExists(&db, QStringLiteral("PACKAGE"), &err);
     }
+
+    // the full text search index should be created for existing packages
+    bool packagesExist = e;
+
     if (err.isEmpty()) {
         if (!e) {
             // NULL should be stored in CATEGORYx if a package is not
@@ -2322,11 +3978,55 @@ QString DBRepository::updateDatabase()
             db.exec(QStringLiteral(
                     "CREATE TABLE PACKAGE_VERSION(NAME TEXT, "
                     "PACKAGE TEXT, URL TEXT, "
-                    "CONTENT BLOB, MSIGUID TEXT, DETECT_FILE_COUNT INTEGER)"));
+                    "CONTENT BLOB, MSIGUID TEXT, DETECT_FILE_COUNT INTEGER, "
+                    "TYPE INTEGER, HASH_SUM_TYPE INTEGER, HASH_SUM TEXT, "
+                    "REPOSITORY INTEGER, VERSION_KEY BLOB, CONTENT_BIN BLOB)"));
             err = toString(db.lastError());
         }
     }
 
+    // PACKAGE_VERSION.TYPE, HASH_SUM_TYPE and HASH_SUM are new in 1.23.
+    // The columns are added to the existing table so that the data is
+    // not lost.
+    if (err.isEmpty()) {
+        if (e) {
+            bool typeExists = columnExists(&db, QStringLiteral("PACKAGE_VERSION"),
+                    QStringLiteral("TYPE"), &err);
+            if (err.isEmpty() && !typeExists) {
+                db.exec(QStringLiteral(
+                        "ALTER TABLE PACKAGE_VERSION ADD COLUMN TYPE INTEGER"));
+                err = toString(db.lastError());
+                if (err.isEmpty()) {
+                    db.exec(QStringLiteral(
+                            "ALTER TABLE PACKAGE_VERSION ADD COLUMN "
+                            "HASH_SUM_TYPE INTEGER"));
+                    err = toString(db.lastError());
+                }
+                if (err.isEmpty()) {
+                    db.exec(QStringLiteral(
+                            "ALTER TABLE PACKAGE_VERSION ADD COLUMN "
+                            "HASH_SUM TEXT"));
+                    err = toString(db.lastError());
+                }
+            }
+        }
+    }
+
+    // PACKAGE_VERSION.REPOSITORY is new in 1.23
+    if (err.isEmpty()) {
+        if (e) {
+            bool repositoryExists = columnExists(&db,
+                    QStringLiteral("PACKAGE_VERSION"),
+                    QStringLiteral("REPOSITORY"), &err);
+            if (err.isEmpty() && !repositoryExists) {
+                db.exec(QStringLiteral(
+                        "ALTER TABLE PACKAGE_VERSION ADD COLUMN "
+                        "REPOSITORY INTEGER"));
+                err = toString(db.lastError());
+            }
+        }
+    }
+
     if (err.isEmpty()) {
         if (!e) {
             db.exec(QStringLiteral(
@@ -2346,6 +4046,46 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // PACKAGE_VERSION.VERSION_KEY is new in 1.23
+    if (err.isEmpty()) {
+        if (e) {
+            bool keyExists = columnExists(&db,
+                    QStringLiteral("PACKAGE_VERSION"),
+                    QStringLiteral("VERSION_KEY"), &err);
+            if (err.isEmpty() && !keyExists) {
+                db.exec(QStringLiteral(
+                        "ALTER TABLE PACKAGE_VERSION ADD COLUMN "
+                        "VERSION_KEY BLOB"));
+                err = toString(db.lastError());
+                if (err.isEmpty())
+                    err = fillVersionKeys();
+            }
+        }
+    }
+
+    // PACKAGE_VERSION.CONTENT_BIN is new in 1.23. CONTENT still contains the
+    // XML for older versions of Npackd sharing the same database file.
+    if (err.isEmpty()) {
+        if (e) {
+            bool binExists = columnExists(&db,
+                    QStringLiteral("PACKAGE_VERSION"),
+                    QStringLiteral("CONTENT_BIN"), &err);
+            if (err.isEmpty() && !binExists) {
+                db.exec(QStringLiteral(
+                        "ALTER TABLE PACKAGE_VERSION ADD COLUMN "
+                        "CONTENT_BIN BLOB"));
+                err = toString(db.lastError());
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        db.exec(QStringLiteral(
+                "CREATE INDEX IF NOT EXISTS PACKAGE_VERSION_PACKAGE_VERSION_KEY "
+                "ON PACKAGE_VERSION(PACKAGE, VERSION_KEY)"));
+        err = toString(db.lastError());
+    }
+
     if (err.isEmpty()) {
         db.exec(QStringLiteral(
                 "CREATE INDEX IF NOT EXISTS PACKAGE_VERSION_MSIGUID ON "
@@ -2371,12 +4111,27 @@ QString DBRepository::updateDatabase()
             db.exec(QStringLiteral("CREATE TABLE LICENSE(NAME TEXT, "
                     "TITLE TEXT, "
                     "DESCRIPTION TEXT, "
-                    "URL TEXT"
+                    "URL TEXT, "
+                    "REPOSITORY INTEGER"
                     ")"));
             err = toString(db.lastError());
         }
     }
 
+    // LICENSE.REPOSITORY is new in 1.23
+    if (err.isEmpty()) {
+        if (e) {
+            bool repositoryExists = columnExists(&db,
+                    QStringLiteral("LICENSE"),
+                    QStringLiteral("REPOSITORY"), &err);
+            if (err.isEmpty() && !repositoryExists) {
+                db.exec(QStringLiteral(
+                        "ALTER TABLE LICENSE ADD COLUMN REPOSITORY INTEGER"));
+                err = toString(db.lastError());
+            }
+        }
+    }
+
     if (err.isEmpty()) {
         if (!e) {
             db.exec(QStringLiteral(
@@ -2461,9 +4216,143 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // DEPENDENCY. This table is new in Npackd 1.23.
+    if (err.isEmpty()) {
+        e = tableExists(&db, QStringLiteral("DEPENDENCY"), &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral("CREATE TABLE DEPENDENCY("
+                    "PACKAGE TEXT NOT NULL, "
+                    "VERSION TEXT NOT NULL, "
+                    "INDEX_ INTEGER NOT NULL, "
+                    "DEPENDENCY TEXT NOT NULL, "
+                    "MIN_INCLUDED INTEGER NOT NULL, "
+                    "MIN_ TEXT NOT NULL, "
+                    "MAX_INCLUDED INTEGER NOT NULL, "
+                    "MAX_ TEXT NOT NULL, "
+                    "VAR TEXT)"));
+            err = toString(db.lastError());
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral(
+                    "CREATE INDEX DEPENDENCY_PACKAGE_VERSION ON DEPENDENCY("
+                    "PACKAGE, VERSION)"));
+            err = toString(db.lastError());
+        }
+    }
+
+    // DETECT_FILE, IMPORTANT_FILE and TEXT_FILE were created by development
+    // versions of Npackd 1.23. The data is only read from
+    // PACKAGE_VERSION.CONTENT_BIN or CONTENT.
+    QStringList unused;
+    unused << QStringLiteral("DETECT_FILE") <<
+            QStringLiteral("IMPORTANT_FILE") << QStringLiteral("TEXT_FILE");
+    for (int i = 0; i < unused.count(); i++) {
+        if (err.isEmpty())
+            err = exec(QStringLiteral("DROP TABLE IF EXISTS ") + unused.at(i));
+    }
+
+    // WORD, WORD_SUFFIX and PACKAGE_WORD are the full text search index for
+    // PACKAGE.FULLTEXT. These tables are new in Npackd 1.23.
+    bool rebuildIndex = false;
+
+    // WORD
+    if (err.isEmpty()) {
+        e = tableExists(&db, QStringLiteral("WORD"), &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral("CREATE TABLE WORD("
+                    "ID INTEGER PRIMARY KEY ASC, "
+                    "WORD TEXT NOT NULL)"));
+            err = toString(db.lastError());
+            rebuildIndex = true;
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral(
+                    "CREATE UNIQUE INDEX WORD_WORD ON WORD(WORD)"));
+            err = toString(db.lastError());
+        }
+    }
+
+    // WORD_SUFFIX
+    if (err.isEmpty()) {
+        e = tableExists(&db, QStringLiteral("WORD_SUFFIX"), &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral("CREATE TABLE WORD_SUFFIX("
+                    "SUFFIX TEXT NOT NULL, "
+                    "WORD INTEGER NOT NULL)"));
+            err = toString(db.lastError());
+            rebuildIndex = true;
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral(
+                    "CREATE INDEX WORD_SUFFIX_SUFFIX ON WORD_SUFFIX("
+                    "SUFFIX, WORD)"));
+            err = toString(db.lastError());
+        }
+    }
+
+    // PACKAGE_WORD
+    if (err.isEmpty()) {
+        e = tableExists(&db, QStringLiteral("PACKAGE_WORD"), &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral("CREATE TABLE PACKAGE_WORD("
+                    "PACKAGE TEXT NOT NULL, "
+                    "WORD INTEGER NOT NULL, "
+                    "FIELD INTEGER NOT NULL)"));
+            err = toString(db.lastError());
+            rebuildIndex = true;
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral(
+                    "CREATE INDEX PACKAGE_WORD_WORD ON PACKAGE_WORD("
+                    "WORD, FIELD, PACKAGE)"));
+            err = toString(db.lastError());
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral(
+                    "CREATE INDEX PACKAGE_WORD_PACKAGE ON PACKAGE_WORD("
+                    "PACKAGE)"));
+            err = toString(db.lastError());
+        }
+    }
+
+    if (err.isEmpty()) {
+        if (rebuildIndex && packagesExist)
+            err = rebuildWordIndex();
+    }
+
     return err;
 }
 
+void DBRepository::close()
+{
+    defaultFile = "";
+    deleteQueries();
+    licenses.clear();
+    categories.clear();
+    words.clear();
+    categoryIDs.clear();
+    db.close();
+    db = QSqlDatabase();
+}
+
 QString DBRepository::open(const QString& connectionName, const QString& file,
         bool readOnly)
 {
@@ -2478,6 +4367,10 @@ QString DBRepository::open(const QString& connectionName, const QString& file,
         }
     }
 
+    // the prepared queries and cached data belong to the previously opened
+    // database
+    close();
+
     QSqlDatabase::removeDatabase(connectionName);
     db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
     db.setDatabaseName(file);
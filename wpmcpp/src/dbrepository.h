@@ -12,6 +12,10 @@
 #include <QMultiMap>
 #include <QCache>
 #include <QList>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QTemporaryFile>
 
 #include "package.h"
 #include "repository.h"
@@ -39,28 +43,108 @@ private:
 
     QMap<int, QString> categories;
 
+    /** WORD.WORD => WORD.ID for the words in the full text search index */
+    QHash<QString, int> words;
+
+    /**
+     * "PARENT/LEVEL/NAME" => CATEGORY.ID for all categories. This map is
+     * loaded from the CATEGORY table if empty and cleared after
+     * transactions are started or rolled back.
+     */
+    QHash<QString, int> categoryIDs;
+
     MySQLQuery* replacePackageVersionQuery;
     MySQLQuery* insertPackageVersionQuery;
     std::unique_ptr<MySQLQuery> insertCmdFileQuery;
     MySQLQuery* insertPackageQuery;
     MySQLQuery* replacePackageQuery;
-    MySQLQuery* selectCategoryQuery;
     MySQLQuery* insertLinkQuery;
     MySQLQuery* deleteLinkQuery;
     std::unique_ptr<MySQLQuery> deleteCmdFilesQuery;
     MySQLQuery* insertInstalledQuery;
+    std::unique_ptr<MySQLQuery> insertDependencyQuery;
+    std::unique_ptr<MySQLQuery> deletePackageWordsQuery;
+    std::unique_ptr<MySQLQuery> insertPackageWordQuery;
+    std::unique_ptr<MySQLQuery> insertWordQuery;
+    std::unique_ptr<MySQLQuery> selectWordQuery;
+    std::unique_ptr<MySQLQuery> insertWordSuffixQuery;
+
+    /**
+     * DELETE queries for the tables with details about package versions:
+     * DEPENDENCY
+     */
+    QList<MySQLQuery*> deleteDetailsQueries;
 
     QSqlDatabase db;
 
+    /**
+     * generation file of the default database opened by openDefault() or ""
+     * if another file is open
+     */
+    QString defaultFile;
+
+    /**
+     * @brief applies updateStatus() also to the newest generation of the
+     *     default database if this object still uses an older one. Otherwise
+     *     the change would be lost as nobody opens the older generation
+     *     again.
+     * @param package full package name
+     * @return error message
+     */
+    QString updateStatusInNewestGeneration(const QString& package);
+
     QString readCategories();
     QString getCategoryPath(int c0, int c1, int c2, int c3, int c4) const;
     int insertCategory(int parent, int level,
             const QString &category, QString *err);
+
+    /**
+     * @brief fills categoryIDs from the CATEGORY table
+     * @return error message
+     */
+    QString readCategoryIDs();
+
     QString findCategory(int cat) const;
 
+    /**
+     * @brief searches for packages
+     * @param where WHERE clause for the PACKAGE table or an empty string
+     * @param orderBy ORDER BY clause without the keywords "ORDER BY"
+     * @param params values for the parameters in where and orderBy in the
+     *     order of their appearance
+     * @param err error message will be stored here
+     * @return full package names
+     */
     QStringList findPackagesWhere(const QString &where,
+            const QString &orderBy,
             const QList<QVariant> &params, QString *err) const;
 
+    /**
+     * @brief updates the full text search index for a package
+     * @param package full package name
+     * @param title package title
+     * @param description package description
+     * @param shortName short package name
+     * @return error message
+     */
+    QString savePackageWords(const QString& package, const QString& title,
+            const QString& description, const QString& shortName);
+
+    /**
+     * @brief searches for a word in the full text search index and inserts it
+     *     together with all its suffixes if it does not exist yet
+     * @param word lower case word
+     * @param err error message will be stored here
+     * @return WORD.ID
+     */
+    int insertWord(const QString& word, QString* err);
+
+    /**
+     * @brief re-creates the full text search index for all packages
+     * @return error message
+     */
+    QString rebuildWordIndex();
+
     /**
      * @brief inserts or updates existing packages
      * @param r repository with packages
@@ -113,13 +197,181 @@ private:
     QString getRepositorySHA1(const QString &url, QString *err);
     void setRepositorySHA1(const QString &url, const QString &sha1, QString *err);
     QString clearRepository(int id);
+
+    /**
+     * @brief checks whether updateF5Incremental() can be used. This is only
+     *     possible if the list of repositories did not change since the last
+     *     update and the SHA-1 is known for all of them.
+     * @param err error message will be stored here
+     * @return true = the database can be updated incrementally
+     */
+    bool canUpdateIncrementally(QString* err);
+
+    /**
+     * @brief parses a changed repository in a temporary database and applies
+     *     the differences to this database
+     * @param job job
+     * @param repository index of the repository
+     * @param f the downloaded repository
+     * @param url URL of the repository
+     * @param deleted will be set to true if some rows of the repository were
+     *     deleted
+     * @param packages names of the changed packages will be added here
+     */
+    void updateRepository(Job* job, int repository, QFile* f, const QUrl& url,
+            bool* deleted, QSet<QString>* packages);
+
+    /**
+     * @brief inserts, updates and deletes the packages, package versions and
+     *     licenses from one repository so that they correspond to the content
+     *     of another database. Rows from repositories with a lower index are
+     *     preserved.
+     * @param from database with the new content of the repository. All rows
+     *     in this database should belong to the repository.
+     * @param repository index of the repository
+     * @param deleted will be set to true if some rows of the repository were
+     *     deleted
+     * @param packages names of the changed packages will be added here
+     * @return error message
+     */
+    QString applyRepositoryChanges(DBRepository* from, int repository,
+            bool* deleted, QSet<QString>* packages);
+
+    /**
+     * @brief computes hash sums for the rows returned by a query
+     * @param sql SELECT statement. The first column is the key and the hash sum
+     *     is computed over all other columns. The parameter :REPOSITORY is
+     *     bound to the value of repository.
+     * @param repository index of the repository
+     * @param r key => hash sum will be stored here. If a key is already
+     *     present, the new hash sum also covers the old one.
+     * @return error message
+     */
+    QString readHashSums(const QString& sql, int repository,
+            QHash<QString, QByteArray>* r) const;
+
+    /**
+     * @brief reads the repository for each row in a table
+     * @param sql SELECT statement for the key and the index of the repository
+     * @param r key => index of the repository or -1 if unknown
+     * @return error message
+     */
+    QString readOwners(const QString& sql, QHash<QString, int>* r) const;
+
+    /**
+     * @brief deletes all packages, package versions and licenses from one
+     *     repository
+     * @param repository index of the repository
+     * @param packages names of the affected packages will be added here
+     * @return error message
+     */
+    QString deleteRepositoryRows(int repository, QSet<QString>* packages);
+
+    /**
+     * @brief deletes a package together with its links
+     * @param name full package name
+     * @return error message
+     */
+    QString deletePackage(const QString& name);
+
+    /**
+     * @brief deletes a package version together with its details
+     * @param package full package name
+     * @param version version number
+     * @return error message
+     */
+    QString deletePackageVersion(const QString& package,
+            const Version& version);
     QString saveLinks(Package *p);
     QString readLinks(Package *p);
     QString deleteLinks(const QString &name);
     QString updateDatabase();
-    void transferFrom(Job *job, const QString &databaseFilename);
+
+    /**
+     * @brief computes PACKAGE_VERSION.VERSION_KEY for all rows
+     * @return error message
+     */
+    QString fillVersionKeys();
+
+    /**
+     * @brief deletes all prepared queries. They will be prepared again for
+     *     the current database connection if necessary.
+     */
+    void deleteQueries();
+
+    /**
+     * @return directory for the default database
+     */
+    static QString getDefaultDir();
+
+    /**
+     * @brief searches for the generations of the default database.
+     *     Generation 0 is stored in Data.db, generation N > 0 in Data-N.db.
+     * @param dir directory with the default database
+     * @return sorted generation numbers of the existing database files
+     */
+    static QList<int> findGenerations(const QString& dir);
+
+    /**
+     * @param dir directory with the default database
+     * @param generation generation number
+     * @return full path to the database file for the specified generation
+     */
+    static QString getGenerationFile(const QString& dir, int generation);
+
+    /**
+     * @brief publishes a completely filled database file as the newest
+     *     generation of the default database. The file is renamed and not
+     *     copied. Connections opened before continue to use the older
+     *     generation. The previous generation is kept, even older
+     *     generations are deleted if they are not used anymore. Generation 0
+     *     (Data.db) is never deleted: older Npackd versions only know this
+     *     file and continue to use and refresh it on their own.
+     * @param file database file in the directory returned by getDefaultDir()
+     * @return error message
+     */
+    static QString publishDefault(const QString& file);
     QString deleteCmdFiles(const QString &name, const Version &version);
+
+    /**
+     * @brief deletes the dependencies for the specified package version.
+     *     Other details are only stored in PACKAGE_VERSION.CONTENT_BIN and
+     *     CONTENT.
+     * @param package full package name
+     * @param version version number
+     * @return error message
+     */
+    QString deletePackageVersionDetails(const QString &package,
+            const Version &version);
+
+    /**
+     * @brief saves the dependencies for the specified package version.
+     *     Other details are only stored in PACKAGE_VERSION.CONTENT_BIN and
+     *     CONTENT.
+     * @param p a package version
+     * @return error message
+     */
+    QString savePackageVersionDetails(PackageVersion *p);
+
+    /**
+     * @brief creates package versions from the rows of an executed query. The
+     *     query should select PACKAGE_VERSION.CONTENT_BIN and CONTENT as
+     *     the first two columns. CONTENT_BIN is in the format created by
+     *     PackageVersion::toBinary() and is NULL for rows written by an older
+     *     version of Npackd. The XML from CONTENT is parsed in this case.
+     * @param q executed query
+     * @param err error message will be stored here
+     * @return [owner:caller] package versions in the order of the rows
+     */
+    QList<PackageVersion*> readPackageVersions(MySQLQuery& q,
+            QString *err) const;
 public:
+    /**
+     * value for currentRepository used for the packages and package versions
+     * detected by InstalledPackages::refresh()
+     */
+    static const int DETECTION_REPOSITORY = 10000;
+
     /** index of the current repository used for saving the packages */
     int currentRepository;
 
@@ -153,7 +405,12 @@ public:
     QString savePackage(Package *p, bool replace);
 
     /**
-     * @brief opens the default database
+     * @brief opens the newest existing generation of the default database.
+     *     A new database is only created if there is no generation at all.
+     *     Status changes made by updateStatus() after a newer generation was
+     *     published are also applied to the newest generation. A status
+     *     change made by another process while a new generation is being
+     *     built is only corrected by the next refresh.
      * @param databaseName name for the database
      * @param readOnly true = open in read-only mode
      * @return error
@@ -171,6 +428,11 @@ public:
     QString open(const QString &connectionName, const QString &file,
             bool readOnly=false);
 
+    /**
+     * @brief closes the database. The file is not used anymore afterwards.
+     */
+    void close();
+
     /**
      * @brief update the status for the specified package
      *     (see Package::Status)
@@ -202,6 +464,25 @@ public:
     QList<PackageVersion*> getPackageVersions_(const QString& package,
             QString *err) const;
 
+    /**
+     * @brief reads the version numbers and download URLs for many packages
+     *     at once. The package version definitions are not parsed.
+     * @param packages full package names
+     * @param err error message will be stored here
+     * @return [owner:caller] list of package versions. The versions of one
+     *     package follow each other and are sorted from the newest to the
+     *     oldest. Only PackageVersion::package, PackageVersion::version and
+     *     PackageVersion::download are filled.
+     */
+    QList<PackageVersion*> getPackageVersionSummaries(
+            const QStringList& packages, QString *err) const;
+
+    PackageVersion* findNewestInstallablePackageVersion_(
+            const QString& package, QString *err) const;
+
+    PackageVersion* findBestMatchToInstall(const Dependency& dep,
+            const QList<PackageVersion*>& avoid, QString *err);
+
     /**
      * @brief returns all package versions with at least one <detect-file>
      *     entry
@@ -212,6 +493,19 @@ public:
     QList<PackageVersion*> getPackageVersionsWithDetectFiles(
             QString *err) const;
 
+    /**
+     * @brief searches for the installed package versions that depend on other
+     *     packages. The DEPENDENCY table is used and the contents of the
+     *     package versions are not read.
+     * @param installed installed package versions
+     * @param err error message will be stored here
+     * @return [owner:caller] full name of the package that is referenced by a
+     *     dependency => installed package versions with such a dependency
+     */
+    QMultiHash<QString, InstalledPackageVersion*> findInstalledDependents(
+            const QList<InstalledPackageVersion*>& installed,
+            QString *err) const;
+
     /**
      * @brief returns all package versions with a <cmd-file> entry with the
      *     specified path
@@ -251,6 +545,33 @@ public:
      */
     void updateF5(Job *job, bool interactive=true);
 
+    /**
+     * @brief does the same as updateF5(), but changes this database in place.
+     *     Only the repositories with a changed SHA-1 are parsed and the
+     *     differences are applied. The status is only re-computed for the
+     *     changed packages. canUpdateIncrementally() should be checked
+     *     before this method is called.
+     * @param job job
+     * @param interactive true = allow the interaction with the user
+     */
+    void updateF5Incremental(Job *job, bool interactive=true);
+
+    /**
+     * @brief the part of updateF5Incremental() that changes the packages,
+     *     package versions and licenses. The detected packages
+     *     (DETECTION_REPOSITORY) are removed. A repository is only parsed if
+     *     its SHA-1 differs from the one stored in the REPOSITORY table or
+     *     if rows were deleted in a repository before it. No transaction is
+     *     started here.
+     * @param job job
+     * @param urls URLs of the repositories in the same order as in the
+     *     REPOSITORY table
+     * @param files downloaded repositories in the same order as urls
+     * @param packages names of the changed packages will be added here
+     */
+    void updateRepositories(Job* job, const QList<QUrl*>& urls,
+            const QList<QTemporaryFile*>& files, QSet<QString>* packages);
+
     /**
      * @brief updateF5() that can be used with QtConcurrent::Run
      * @param job job
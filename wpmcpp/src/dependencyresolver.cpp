@@ -0,0 +1,197 @@
+#include "dependencyresolver.h"
+
+#include "wpmutils.h"
+
+DependencyResolver::DependencyResolver(AbstractRepository* rep,
+        InstalledPackages* installed): rep(rep), installed(installed),
+        avoidedCount(0), opsBase(0), state(0), lastState(0)
+{
+}
+
+DependencyResolver::~DependencyResolver()
+{
+    QList<QList<PackageVersion*> > lists = candidates.values();
+    for (int i = 0; i < lists.count(); i++) {
+        qDeleteAll(lists.at(i));
+    }
+}
+
+QString DependencyResolver::findCandidates(const Dependency& d,
+        const QList<PackageVersion*>** r)
+{
+    QString err;
+
+    QString key = d.package + QLatin1Char(' ') + d.versionsToString();
+    QHash<QString, QList<PackageVersion*> >::const_iterator it =
+            candidates.constFind(key);
+    if (it == candidates.constEnd()) {
+        QList<PackageVersion*> pvs = rep->findAllMatchesToInstall(d,
+                QList<PackageVersion*>(), &err);
+        if (!err.isEmpty()) {
+            qDeleteAll(pvs);
+            pvs.clear();
+        }
+        it = candidates.insert(key, pvs);
+    }
+    *r = &it.value();
+
+    return err;
+}
+
+bool DependencyResolver::isInstalled(const Dependency& d,
+        const QList<InstallOperation*>& ops) const
+{
+    QMultiHash<QString, int>::const_iterator it = planned.constFind(d.package);
+    while (it != planned.constEnd() && it.key() == d.package) {
+        if (d.test(ops.at(it.value())->version))
+            return true;
+        ++it;
+    }
+
+    return installed->isInstalled(d);
+}
+
+bool DependencyResolver::isInstalled(const QString& package,
+        const Version& version, const QList<InstallOperation*>& ops) const
+{
+    QMultiHash<QString, int>::const_iterator it = planned.constFind(package);
+    while (it != planned.constEnd() && it.key() == package) {
+        if (ops.at(it.value())->version == version)
+            return true;
+        ++it;
+    }
+
+    return installed->isInstalled(package, version);
+}
+
+void DependencyResolver::rollback(QList<InstallOperation*>& ops,
+        int opsCount, QList<PackageVersion*>& avoid, int avoidCount)
+{
+    while (ops.count() > opsCount) {
+        InstallOperation* op = ops.takeLast();
+        planned.remove(op->package, ops.count());
+        plannedPaths.removeLast();
+        delete op;
+    }
+    while (avoid.count() > avoidCount) {
+        PackageVersion* pv = avoid.takeLast();
+        avoided.remove(pv->getStringId());
+        delete pv;
+    }
+}
+
+QString DependencyResolver::plan(const PackageVersion* pv,
+        QList<InstallOperation*>& ops, QList<PackageVersion*>& avoid,
+        const QString& where)
+{
+    QString res;
+
+    avoid.append(pv->clone());
+    avoided.insert(pv->getStringId());
+
+    for (int i = 0; i < pv->dependencies.count(); i++) {
+        Dependency* d = pv->dependencies.at(i);
+        if (isInstalled(*d, ops))
+            continue;
+
+        // we cannot just use the best match here as it is possible that the
+        // highest match cannot be installed because of unsatisfied
+        // dependencies. Example: the newest version depends on Windows
+        // Vista, but the current operating system is XP.
+        const QList<PackageVersion*>* pvs;
+        QString err = findCandidates(*d, &pvs);
+        if (!err.isEmpty()) {
+            res = QString(QObject::tr("Error searching for the dependency matches: %1")).
+                       arg(err);
+            break;
+        }
+
+        bool found = false;
+        for (int j = 0; j < pvs->count(); j++) {
+            const PackageVersion* c = pvs->at(j);
+            QString id = c->getStringId();
+            if (avoided.contains(id)) {
+                avoidedCount++;
+                continue;
+            }
+
+            QString key = QString::number(state) + QLatin1Char('/') + id;
+            if (failed.contains(key))
+                continue;
+
+            int opsCount = ops.count();
+            int avoidCount = avoid.count();
+            int oldState = state;
+            int oldAvoidedCount = avoidedCount;
+
+            if (plan(c, ops, avoid, QString()).isEmpty()) {
+                found = true;
+                break;
+            }
+
+            rollback(ops, opsCount, avoid, avoidCount);
+            state = oldState;
+
+            // the result does not depend on the "avoid" list if no
+            // candidate was skipped because of it
+            if (avoidedCount == oldAvoidedCount)
+                failed.insert(key);
+        }
+
+        if (!found) {
+            res = QString(QObject::tr("Unsatisfied dependency: %1")).
+                       arg(rep->toString(*d));
+            break;
+        }
+    }
+
+    if (res.isEmpty()) {
+        if (!isInstalled(pv->package, pv->version, ops)) {
+            InstallOperation* io = new InstallOperation();
+            io->install = true;
+            io->package = pv->package;
+            io->version = pv->version;
+            io->where = where;
+            ops.append(io);
+
+            QString where2 = where;
+            if (where2.isEmpty()) {
+                where2 = pv->getIdealInstallationDirectory();
+                where2 = WPMUtils::findNonExistingFile(where2, "");
+            }
+            planned.insert(pv->package, ops.count() - 1);
+            plannedPaths.append(where2);
+            state = ++lastState;
+        }
+    }
+
+    return res;
+}
+
+QString DependencyResolver::planInstallation(const PackageVersion* pv,
+        QList<InstallOperation*>& ops, QList<PackageVersion*>& avoid,
+        const QString& where)
+{
+    opsBase = ops.count();
+    planned.clear();
+    plannedPaths.clear();
+    failed.clear();
+    state = lastState = 0;
+
+    avoided.clear();
+    for (int i = 0; i < avoid.count(); i++) {
+        avoided.insert(avoid.at(i)->getStringId());
+    }
+
+    QString res = plan(pv, ops, avoid, where);
+
+    // the planned operations are applied to the installed package versions
+    // even after an error like in the previous implementation
+    for (int i = opsBase; i < ops.count(); i++) {
+        InstallOperation* op = ops.at(i);
+        installed->setPackageVersionPath(op->package, op->version,
+                plannedPaths.at(i - opsBase), false);
+    }
+
+    return res;
+}
@@ -0,0 +1,106 @@
+#ifndef DEPENDENCYRESOLVER_H
+#define DEPENDENCYRESOLVER_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include "abstractrepository.h"
+#include "packageversion.h"
+#include "installedpackages.h"
+#include "installoperation.h"
+#include "dependency.h"
+
+/**
+ * @brief plans the installation of a package version together with all its
+ *     dependencies.
+ *
+ * The installed package versions are not copied for each attempt. The
+ * planned operations are an overlay over the unchanged installed package
+ * versions and are removed again if an attempt fails. The candidates for a
+ * dependency are only searched once. A package version that could not be
+ * planned is not tried again in the same state.
+ */
+class DependencyResolver
+{
+    AbstractRepository* rep;
+    InstalledPackages* installed;
+
+    /**
+     * package name + " " + versions => [owner] matching installable package
+     * versions in the order returned by the repository
+     */
+    QHash<QString, QList<PackageVersion*> > candidates;
+
+    /** package version IDs for the "avoid" list */
+    QSet<QString> avoided;
+
+    /** number of candidates skipped because they were in the "avoid" list */
+    int avoidedCount;
+
+    /** index of the first operation added by this object */
+    int opsBase;
+
+    /** package name => indexes of the planned installation operations */
+    QMultiHash<QString, int> planned;
+
+    /** installation directories for the planned operations */
+    QStringList plannedPaths;
+
+    /**
+     * identifies the planned operations. Each newly added operation creates a
+     * new state. Removing the operations restores the previous state.
+     */
+    int state;
+    int lastState;
+
+    /**
+     * "state/package version ID" for the package versions that could not be
+     * planned. Only failures that did not depend on the "avoid" list are
+     * stored.
+     */
+    QSet<QString> failed;
+
+    QString findCandidates(const Dependency& d,
+            const QList<PackageVersion*>** r);
+
+    bool isInstalled(const Dependency& d,
+            const QList<InstallOperation*>& ops) const;
+
+    bool isInstalled(const QString& package, const Version& version,
+            const QList<InstallOperation*>& ops) const;
+
+    QString plan(const PackageVersion* pv, QList<InstallOperation*>& ops,
+            QList<PackageVersion*>& avoid, const QString& where);
+
+    void rollback(QList<InstallOperation*>& ops, int opsCount,
+            QList<PackageVersion*>& avoid, int avoidCount);
+public:
+    /**
+     * @param rep repository with the package versions
+     * @param installed installed package versions. This object will be
+     *     updated to reflect the planned operations.
+     */
+    DependencyResolver(AbstractRepository* rep, InstalledPackages* installed);
+
+    ~DependencyResolver();
+
+    /**
+     * @brief plans the installation of the specified package version and
+     *     all its dependencies. See PackageVersion::planInstallation()
+     * @param pv package version
+     * @param ops necessary operations will be added here
+     * @param avoid [ownership:caller] these package versions will not be
+     *     considered and the planned ones will be added
+     * @param where the installation directory for pv or "" if the
+     *     directory should be chosen automatically
+     * @return error message or ""
+     */
+    QString planInstallation(const PackageVersion* pv,
+            QList<InstallOperation*>& ops,
+            QList<PackageVersion*>& avoid, const QString& where);
+};
+
+#endif // DEPENDENCYRESOLVER_H
@@ -11,10 +11,14 @@
 #include <QWaitCondition>
 #include <QMutex>
 #include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QLocale>
 
 #include "downloader.h"
 #include "job.h"
 #include "wpmutils.h"
+#include "hashsumwriter.h"
 
 bool Downloader::debug = false;
 
@@ -27,6 +31,34 @@ DWORD __stdcall myInternetAuthNotifyCallback(DWORD_PTR dwContext,
     return 0;
 }
 
+/**
+ * @param dt a time
+ * @return the time in the format used by the HTTP headers like
+ *     "Sun, 06 Nov 1994 08:49:37 GMT"
+ */
+static QString toHTTPDate(const QDateTime& dt)
+{
+    return QLocale::c().toString(dt.toUTC(),
+            QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+}
+
+/**
+ * @brief reads a header from an HTTP response
+ * @param hResourceHandle request handle
+ * @param info HTTP_QUERY_*
+ * @return header value or "" if the header is not available
+ */
+static QString queryHeader(HINTERNET hResourceHandle, DWORD info)
+{
+    QString r;
+    WCHAR buffer[1024];
+    DWORD bufferLength = sizeof(buffer);
+    DWORD index = 0;
+    if (HttpQueryInfoW(hResourceHandle, info, buffer, &bufferLength, &index))
+        r.setUtf16((ushort*) buffer, bufferLength / 2);
+    return r;
+}
+
 int64_t Downloader::downloadWin(Job* job, const Request& request,
         Downloader::Response* response)
 {
@@ -50,6 +82,21 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
     if (sha1)
         sha1->clear();
 
+    // conditional request
+    QString headers = request.headers;
+    if (!request.ifNoneMatch.isEmpty()) {
+        if (!headers.isEmpty())
+            headers.append("\r\n");
+        headers.append("If-None-Match: ").append(request.ifNoneMatch);
+    }
+    if (!request.ifModifiedSince.isEmpty()) {
+        if (!headers.isEmpty())
+            headers.append("\r\n");
+        headers.append("If-Modified-Since: ").append(request.ifModifiedSince);
+    }
+    bool conditional = !request.ifNoneMatch.isEmpty() ||
+            !request.ifModifiedSince.isEmpty();
+
     QString server = url.host();
     QString resource = url.path();
     QString encQuery = url.query(QUrl::FullyEncoded);
@@ -156,7 +203,7 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
         // the following call uses NULL for headers in case there are no headers
         // because Windows 2003 generates the error 12150 otherwise
         if (!HttpSendRequestW(hResourceHandle,
-                request.headers.length() == 0 ? NULL : reinterpret_cast<LPCWSTR>(request.headers.utf16()), -1,
+                headers.length() == 0 ? NULL : reinterpret_cast<LPCWSTR>(headers.utf16()), -1,
                 request.postData.length() == 0 ? NULL : const_cast<char*>(request.postData.data()),
                 request.postData.length())) {
             sendRequestError = GetLastError();
@@ -179,10 +226,11 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
                     arg(sendRequestError).arg(dwStatus));
         }
 
-        // 2XX
+        // 2XX or 304 "Not Modified" for a conditional request
         if (sendRequestError == 0) {
             DWORD hundreds = dwStatus / 100;
-            if (hundreds == 2 || hundreds == 5)
+            if (hundreds == 2 || hundreds == 5 ||
+                    (conditional && dwStatus == HTTP_STATUS_NOT_MODIFIED))
                 break;
         }
 
@@ -296,6 +344,8 @@ out:
             QString errMsg;
             WPMUtils::formatMessage(GetLastError(), &errMsg);
             job->setErrorMessage(errMsg);
+        } else if (conditional && dwStatus == HTTP_STATUS_NOT_MODIFIED) {
+            response->notModified = true;
         } else {
             // 2XX
             if (dwStatus / 100 != 2) {
@@ -305,6 +355,16 @@ out:
         }
     }
 
+    // validators for the next conditional request
+    if (job->shouldProceed()) {
+#ifndef HTTP_QUERY_ETAG
+        const DWORD HTTP_QUERY_ETAG = 54;
+#endif
+        response->eTag = queryHeader(hResourceHandle, HTTP_QUERY_ETAG);
+        response->lastModified = queryHeader(hResourceHandle,
+                HTTP_QUERY_LAST_MODIFIED);
+    }
+
     if (job->shouldProceed()) {
         job->setProgress(0.03);
         job->setTitle(initialTitle + " / " + QObject::tr("Downloading"));
@@ -378,7 +438,7 @@ out:
         job->setProgress(0.05);
     }
 
-    if (job->shouldProceed()) {
+    if (job->shouldProceed() && !response->notModified) {
         Job* sub = job->newSubJob(0.95, QObject::tr("Reading the data"));
         readData(sub, hResourceHandle, file, sha1, gzip, contentLength, alg);
         if (!sub->getErrorMessage().isEmpty())
@@ -491,7 +551,7 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
     QString initialTitle = job->getTitle();
 
     // download/compute SHA1 loop
-    QCryptographicHash hash(alg);
+    HashSumWriter writer(file, sha1 != 0, alg);
     const int bufferSize = 512 * 1024;
     unsigned char* buffer = new unsigned char[bufferSize];
     const int buffer2Size = 512 * 1024;
@@ -627,12 +687,12 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
                 inflateEnd(&d_stream);
                 break;
             } else {
-                if (sha1)
-                    hash.addData((char*) buffer2,
-                            buffer2Size - d_stream.avail_out);
-
-                file->write((char*) buffer2,
+                QString e = writer.write((char*) buffer2,
                         buffer2Size - d_stream.avail_out);
+                if (!e.isEmpty()) {
+                    job->setErrorMessage(e);
+                    break;
+                }
             }
         } while (d_stream.avail_out == 0);
 
@@ -661,7 +721,7 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
     }
 
     if (sha1 && job->shouldProceed())
-        *sha1 = hash.result().toHex().toLower();
+        *sha1 = writer.getHashSum();
 
 // out:
     delete[] buffer;
@@ -683,7 +743,7 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
     QString initialTitle = job->getTitle();
 
     // download/compute SHA1 loop
-    QCryptographicHash hash(alg);
+    HashSumWriter writer(file, sha1 != 0, alg);
     const int bufferSize = 512 * 1024;
     unsigned char* buffer = new unsigned char[bufferSize];
 
@@ -707,12 +767,12 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
         if (bufferLength == 0)
             break;
 
-        // update SHA1 if necessary
-        if (sha1)
-            hash.addData((char*) buffer, bufferLength);
-
-        if (file)
-            file->write((char*) buffer, bufferLength);
+        // update SHA1 and write the data in one pass
+        QString e = writer.write((char*) buffer, bufferLength);
+        if (!e.isEmpty()) {
+            job->setErrorMessage(e);
+            break;
+        }
 
         alreadyRead += bufferLength;
         if (contentLength > 0) {
@@ -733,7 +793,7 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
         job->setProgress(1);
 
     if (sha1 && job->shouldProceed())
-        *sha1 = hash.result().toHex().toLower();
+        *sha1 = writer.getHashSum();
 
     delete[] buffer;
 
@@ -744,7 +804,7 @@ void Downloader::readData(Job* job, HINTERNET hResourceHandle, QFile* file,
         QString* sha1, bool gzip, int64_t contentLength,
         QCryptographicHash::Algorithm alg)
 {
-    if (gzip && file)
+    if (gzip)
         readDataGZip(job, hResourceHandle, file, sha1, contentLength, alg);
     else
         readDataFlat(job, hResourceHandle, file, sha1, contentLength, alg);
@@ -762,16 +822,17 @@ void Downloader::copyFile(Job* job, const QString& source, QFile* file,
         char* data = new char[SZ];
 
         qint64 progress = 0;
-        QCryptographicHash crypto(alg);
+        HashSumWriter writer(file, sha1 != 0, alg);
         while(true) {
             qint64 c = srcFile.read(data, SZ);
             if (c <= 0)
                 break;
 
-            if (sha1)
-                crypto.addData(data, c);
-            if (file)
-                file->write(data, c);
+            QString e = writer.write(data, c);
+            if (!e.isEmpty()) {
+                job->setErrorMessage(e);
+                break;
+            }
 
             progress += c;
             if (srcSize != 0)
@@ -779,7 +840,7 @@ void Downloader::copyFile(Job* job, const QString& source, QFile* file,
         }
 
         if (sha1)
-            *sha1 = crypto.result().toHex().toLower();
+            *sha1 = writer.getHashSum();
 
         srcFile.close();
         delete[] data;
@@ -807,9 +868,19 @@ Downloader::Response Downloader::download(Job *job,
     } else if (request.url.scheme() == "file") {
         QString localFile = request.url.toLocalFile();
         QFileInfo fi(localFile);
-        if (fi.isAbsolute())
-            copyFile(job, localFile, request.file, sha1, request.alg);
-        else {
+        if (fi.isAbsolute()) {
+            // the modification time is used instead of the Last-Modified
+            // header
+            if (fi.exists())
+                r.lastModified = toHTTPDate(fi.lastModified());
+            if (!request.ifModifiedSince.isEmpty() &&
+                    request.ifModifiedSince == r.lastModified) {
+                r.notModified = true;
+                job->complete();
+            } else {
+                copyFile(job, localFile, request.file, sha1, request.alg);
+            }
+        } else {
             job->setErrorMessage(
                     QObject::tr("Cannot download a file from a relative path %1").
                     arg(localFile));
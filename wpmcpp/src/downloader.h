@@ -142,6 +142,20 @@ public:
          */
         QString headers;
 
+        /**
+         * ETag from a previous response or "". If the resource was not
+         * changed, Response::notModified will be true and no data will be
+         * read. This is only applicable to http: and https:.
+         */
+        QString ifNoneMatch;
+
+        /**
+         * Last-Modified from a previous response or "". If the resource was
+         * not changed, Response::notModified will be true and no data will
+         * be read. This is applicable to http:, https: and file:.
+         */
+        QString ifModifiedSince;
+
         /**
          * @param url http:/https:/file: URL
          */
@@ -167,6 +181,24 @@ public:
 
         /** if not null, Content-Disposition will be stored here */
         QString contentDisposition;
+
+        /** ETag header or "" */
+        QString eTag;
+
+        /**
+         * Last-Modified header or "". For file: URLs the modification time
+         * of the file in the same format.
+         */
+        QString lastModified;
+
+        /**
+         * true if the resource was not changed since the request specified
+         * in Request::ifNoneMatch or Request::ifModifiedSince
+         */
+        bool notModified;
+
+        Response(): notModified(false) {
+        }
     };
 
     /**
@@ -0,0 +1,283 @@
+#include <windows.h>
+#include <shlobj.h>
+
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include <QStringList>
+#include <QMultiMap>
+#include <QSet>
+
+#include "filecache.h"
+#include "wpmutils.h"
+
+/** name of the index file */
+static const QString INDEX_FILE = QStringLiteral("index.txt");
+
+FileCache::FileCache(const QString &dir, qint64 maxSize): dir(dir),
+        maxSize(maxSize), size(0)
+{
+}
+
+FileCache::~FileCache()
+{
+    qDeleteAll(entries);
+}
+
+QString FileCache::getDefaultDir()
+{
+    return WPMUtils::getShellDir(CSIDL_LOCAL_APPDATA) +
+            "\\Npackd\\FileCache";
+}
+
+QString FileCache::getFileName(const QString &url)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(url.toUtf8(),
+            QCryptographicHash::Sha1).toHex());
+}
+
+QString FileCache::getDir() const
+{
+    return dir;
+}
+
+qint64 FileCache::getSize() const
+{
+    return size;
+}
+
+int FileCache::count() const
+{
+    return entries.count();
+}
+
+QString FileCache::load()
+{
+    QString err;
+
+    qDeleteAll(entries);
+    entries.clear();
+    size = 0;
+
+    QDir d(dir);
+    if (!d.exists() && !d.mkpath(dir))
+        err = QObject::tr("Cannot create the directory %1").arg(dir);
+
+    if (err.isEmpty()) {
+        QFile f(dir + "\\" + INDEX_FILE);
+        if (f.exists()) {
+            if (f.open(QFile::ReadOnly)) {
+                QTextStream ts(&f);
+                ts.setCodec("UTF-8");
+
+                // URL, file, size, last access, validation, ETag,
+                // Last-Modified
+                while (!ts.atEnd()) {
+                    QStringList parts = ts.readLine().split('\t');
+                    if (parts.count() != 7)
+                        continue;
+
+                    Entry* e = new Entry();
+                    e->url = parts.at(0);
+                    e->file = parts.at(1);
+                    e->lastUsed = QDateTime::fromMSecsSinceEpoch(
+                            parts.at(3).toLongLong());
+                    e->validated = QDateTime::fromMSecsSinceEpoch(
+                            parts.at(4).toLongLong());
+                    e->eTag = parts.at(5);
+                    e->lastModified = parts.at(6);
+
+                    // the size from the index is only a hint
+                    QFileInfo fi(dir + "\\" + e->file);
+                    if (e->url.isEmpty() || entries.contains(e->url) ||
+                            !fi.isFile()) {
+                        delete e;
+                    } else {
+                        e->size = fi.size();
+                        size += e->size;
+                        entries.insert(e->url, e);
+                    }
+                }
+                f.close();
+            } else {
+                err = QObject::tr("Cannot open the file %1").arg(
+                        f.fileName());
+            }
+        }
+    }
+
+    // remove files that are not referenced from the index. Downloads in
+    // progress (*.tmp from the last day) and files that were stored by
+    // another instance after the index was written are left alone.
+    if (err.isEmpty()) {
+        QFileInfo index(dir + "\\" + INDEX_FILE);
+        QDateTime indexTime;
+        if (index.exists())
+            indexTime = index.lastModified();
+
+        QSet<QString> referenced;
+        QHashIterator<QString, Entry*> it(entries);
+        while (it.hasNext()) {
+            it.next();
+            referenced.insert(it.value()->file.toLower());
+        }
+
+        QDateTime yesterday = QDateTime::currentDateTime().addDays(-1);
+        QFileInfoList files = d.entryInfoList(QDir::Files);
+        for (int i = 0; i < files.count(); i++) {
+            const QFileInfo& fi = files.at(i);
+            QString file = fi.fileName();
+            if (file.compare(INDEX_FILE, Qt::CaseInsensitive) == 0 ||
+                    referenced.contains(file.toLower()))
+                continue;
+
+            bool remove;
+            if (file.endsWith(QStringLiteral(".tmp"), Qt::CaseInsensitive))
+                remove = fi.lastModified() < yesterday;
+            else
+                remove = indexTime.isValid() &&
+                        fi.lastModified() < indexTime;
+            if (remove)
+                d.remove(file);
+        }
+
+        evict("");
+    }
+
+    return err;
+}
+
+QString FileCache::save() const
+{
+    QString err;
+
+    QString fn = dir + "\\" + INDEX_FILE;
+    QString tmp = fn + ".tmp";
+    QFile f(tmp);
+    if (f.open(QFile::WriteOnly | QFile::Truncate)) {
+        QTextStream ts(&f);
+        ts.setCodec("UTF-8");
+
+        QHashIterator<QString, Entry*> it(entries);
+        while (it.hasNext()) {
+            it.next();
+            const Entry* e = it.value();
+            ts << e->url << '\t' << e->file << '\t' << e->size << '\t' <<
+                    e->lastUsed.toMSecsSinceEpoch() << '\t' <<
+                    e->validated.toMSecsSinceEpoch() << '\t' <<
+                    e->eTag << '\t' << e->lastModified << '\n';
+        }
+        ts.flush();
+        if (f.error() != QFile::NoError)
+            err = f.errorString();
+        f.close();
+    } else {
+        err = QObject::tr("Cannot open the file %1").arg(tmp);
+    }
+
+    if (err.isEmpty()) {
+        if (!MoveFileExW((LPCWSTR) tmp.utf16(), (LPCWSTR) fn.utf16(),
+                MOVEFILE_REPLACE_EXISTING)) {
+            WPMUtils::formatMessage(GetLastError(), &err);
+        }
+    } else {
+        QFile::remove(tmp);
+    }
+
+    return err;
+}
+
+const FileCache::Entry* FileCache::find(const QString &url)
+{
+    Entry* e = entries.value(url);
+    if (e)
+        e->lastUsed = QDateTime::currentDateTimeUtc();
+    return e;
+}
+
+QString FileCache::store(const QString &url, const QString &tempFile,
+        const QString &ext, const QString &eTag, const QString &lastModified)
+{
+    QString err;
+
+    // the index is line-based
+    if (url.contains('\t') || url.contains('\n') || url.contains('\r') ||
+            eTag.contains('\t') || eTag.contains('\n') ||
+            lastModified.contains('\t') || lastModified.contains('\n')) {
+        err = QObject::tr("Cannot cache the file from %1").arg(url);
+    }
+
+    Entry* e = entries.value(url);
+    if (err.isEmpty() && e) {
+        remove(e);
+        e = 0;
+    }
+
+    QString file = getFileName(url) + ext;
+    QString fn = dir + "\\" + file;
+    if (err.isEmpty()) {
+        if (!MoveFileExW((LPCWSTR) tempFile.utf16(), (LPCWSTR) fn.utf16(),
+                MOVEFILE_REPLACE_EXISTING)) {
+            WPMUtils::formatMessage(GetLastError(), &err);
+        }
+    }
+
+    if (err.isEmpty()) {
+        e = new Entry();
+        e->url = url;
+        e->file = file;
+        e->eTag = eTag;
+        e->lastModified = lastModified;
+        e->size = QFileInfo(fn).size();
+        e->lastUsed = QDateTime::currentDateTimeUtc();
+        e->validated = e->lastUsed;
+        entries.insert(url, e);
+        size += e->size;
+
+        evict(url);
+    } else {
+        QFile::remove(tempFile);
+    }
+
+    return err;
+}
+
+void FileCache::validated(const QString &url)
+{
+    Entry* e = entries.value(url);
+    if (e)
+        e->validated = QDateTime::currentDateTimeUtc();
+}
+
+void FileCache::remove(Entry *e)
+{
+    QFile::remove(dir + "\\" + e->file);
+    size -= e->size;
+    entries.remove(e->url);
+    delete e;
+}
+
+void FileCache::evict(const QString &keep)
+{
+    if (size <= maxSize)
+        return;
+
+    // last access -> entry
+    QMultiMap<qint64, Entry*> lru;
+    QHashIterator<QString, Entry*> it(entries);
+    while (it.hasNext()) {
+        it.next();
+        Entry* e = it.value();
+        if (e->url != keep)
+            lru.insert(e->lastUsed.toMSecsSinceEpoch(), e);
+    }
+
+    QMultiMap<qint64, Entry*>::iterator i = lru.begin();
+    while (size > maxSize && i != lru.end()) {
+        remove(i.value());
+        ++i;
+    }
+}
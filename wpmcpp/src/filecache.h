@@ -0,0 +1,152 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QDateTime>
+
+/**
+ * @brief persistent cache for downloaded files (icons, screenshots).
+ *
+ * The files are stored in one directory. The name of a file is the SHA-1 of
+ * the URL plus an extension. The directory also contains an index file with
+ * the URL, validators (ETag, Last-Modified) and the time of the last access
+ * for each file. The least recently used files are deleted if the size of
+ * the cache exceeds the limit.
+ *
+ * This class is not thread-safe.
+ */
+class FileCache
+{
+public:
+    /**
+     * @brief one cached file
+     */
+    class Entry
+    {
+    public:
+        /** URL */
+        QString url;
+
+        /** file name relative to the cache directory */
+        QString file;
+
+        /** ETag or "" */
+        QString eTag;
+
+        /** Last-Modified or "" */
+        QString lastModified;
+
+        /** size of the file in bytes */
+        qint64 size;
+
+        /** last access */
+        QDateTime lastUsed;
+
+        /** the last time the file was downloaded or re-validated */
+        QDateTime validated;
+
+        Entry(): size(0) {
+        }
+    };
+private:
+    QString dir;
+    qint64 maxSize;
+    qint64 size;
+
+    /** URL -> entry */
+    QHash<QString, Entry*> entries;
+
+    /**
+     * @brief deletes the least recently used files until the size of the
+     *     cache is below the limit
+     * @param keep this URL will not be removed
+     */
+    void evict(const QString& keep);
+
+    /**
+     * @brief removes an entry and the corresponding file
+     * @param e the entry. The object will be destroyed.
+     */
+    void remove(Entry* e);
+public:
+    /**
+     * @param dir directory for the files. It will be created if necessary.
+     * @param maxSize maximum size of all files in bytes
+     */
+    FileCache(const QString& dir, qint64 maxSize);
+
+    ~FileCache();
+
+    /**
+     * @return default directory for the cache:
+     *     "%LOCALAPPDATA%\Npackd\FileCache"
+     */
+    static QString getDefaultDir();
+
+    /**
+     * @param url a URL
+     * @return file name without an extension for the URL
+     */
+    static QString getFileName(const QString& url);
+
+    /**
+     * @return directory for the files
+     */
+    QString getDir() const;
+
+    /**
+     * @return size of all files in bytes
+     */
+    qint64 getSize() const;
+
+    /**
+     * @return number of cached files
+     */
+    int count() const;
+
+    /**
+     * @brief reads the index. Files that are not listed in the index and
+     *     are older than the index are deleted. *.tmp files are only
+     *     deleted if they are older than one day.
+     * @return error message or ""
+     */
+    QString load();
+
+    /**
+     * @brief writes the index
+     * @return error message or ""
+     */
+    QString save() const;
+
+    /**
+     * @brief searches for a file and marks it as recently used
+     * @param url URL
+     * @return found entry or 0. The returned object is valid until the next
+     *     change in the cache.
+     */
+    const Entry* find(const QString& url);
+
+    /**
+     * @brief adds or replaces a file in the cache
+     * @param url URL
+     * @param tempFile full path to a downloaded file. It will be moved into
+     *     the cache directory.
+     * @param ext file extension with the dot, e.g. ".png"
+     * @param eTag ETag or ""
+     * @param lastModified Last-Modified or ""
+     * @return error message or ""
+     */
+    QString store(const QString& url, const QString& tempFile,
+            const QString& ext, const QString& eTag,
+            const QString& lastModified);
+
+    /**
+     * @brief records that the server confirmed that the cached file is
+     *     still up-to-date
+     * @param url URL
+     */
+    void validated(const QString& url);
+};
+
+#endif // FILECACHE_H
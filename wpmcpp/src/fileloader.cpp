@@ -12,8 +12,49 @@
 #include "downloadsizefinder.h"
 #include "concurrent.h"
 
-FileLoader::FileLoader(): id(0)
+/** default maximum size of the cache: 50 MiB */
+static const qint64 DEFAULT_MAX_SIZE = 50 * 1024 * 1024;
+
+FileLoader::FileLoader(): id(0),
+        cache(FileCache::getDefaultDir(), DEFAULT_MAX_SIZE)
+{
+    init();
+}
+
+FileLoader::FileLoader(const QString &dir, qint64 maxSize): id(0),
+        cache(dir, maxSize)
 {
+    init();
+}
+
+FileLoader::~FileLoader()
+{
+    saveIndex();
+}
+
+void FileLoader::init()
+{
+    QString err = cache.load();
+    if (!err.isEmpty())
+        qDebug() << "FileLoader: " << err;
+
+    // the index is written regularly so that the files are not lost if the
+    // program is terminated
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(SAVE_DELAY);
+    connect(&saveTimer, SIGNAL(timeout()), this, SLOT(saveIndex()));
+}
+
+void FileLoader::saveIndex()
+{
+    saveTimer.stop();
+
+    this->mutex.lock();
+    QString err = cache.save();
+    this->mutex.unlock();
+
+    if (!err.isEmpty())
+        qDebug() << "FileLoader: " << err;
 }
 
 QString FileLoader::downloadOrQueue(const QString &url, QString *err)
@@ -21,30 +62,46 @@ QString FileLoader::downloadOrQueue(const QString &url, QString *err)
     QString r;
     *err = "";
 
+    bool start = false;
+
     this->mutex.lock();
-    if (this->files.contains(url)) {
-        QString file = this->files.value(url);
-        if (file.startsWith('*'))
-            *err = file.mid(1);
-        else
-            r = dir.path() + "\\" + file;
-        this->mutex.unlock();
-    } else {
-        this->mutex.unlock();
-
-        QFuture<DownloadFile> future = run(
-                &DownloadSizeFinder::threadPool, this,
-                &FileLoader::downloadRunnable, url);
-        QFutureWatcher<DownloadFile>* w =
-                new QFutureWatcher<DownloadFile>(this);
-        connect(w, SIGNAL(finished()), this,
-                SLOT(watcherFinished()));
-        w->setFuture(future);
+    const FileCache::Entry* e;
+    if (this->errors.contains(url)) {
+        *err = this->errors.value(url);
+    } else if ((e = cache.find(url)) != 0) {
+        r = cache.getDir() + "\\" + e->file;
+
+        // a cache hit is returned immediately and only re-validated in the
+        // background if it is old enough
+        if (e->validated.secsTo(QDateTime::currentDateTimeUtc()) >
+                REVALIDATE && !this->loading.contains(url)) {
+            this->loading.insert(url);
+            start = true;
+        }
+    } else if (!this->loading.contains(url)) {
+        this->loading.insert(url);
+        start = true;
     }
+    this->mutex.unlock();
+
+    if (start)
+        queue(url);
 
     return r;
 }
 
+void FileLoader::queue(const QString &url)
+{
+    QFuture<DownloadFile> future = run(
+            &DownloadSizeFinder::threadPool, this,
+            &FileLoader::downloadRunnable, url);
+    QFutureWatcher<DownloadFile>* w =
+            new QFutureWatcher<DownloadFile>(this);
+    connect(w, SIGNAL(finished()), this,
+            SLOT(watcherFinished()));
+    w->setFuture(future);
+}
+
 void FileLoader::watcherFinished()
 {
     QFutureWatcher<DownloadFile>* w = static_cast<
@@ -52,17 +109,18 @@ void FileLoader::watcherFinished()
     DownloadFile r = w->result();
 
     this->mutex.lock();
-    if (!r.file.isEmpty())
-        this->files.insert(r.url, r.file);
-    else
-        this->files.insert(r.url, "*" + r.error);
+    this->loading.remove(r.url);
+    if (r.notModified)
+        cache.validated(r.url);
+    else if (r.file.isEmpty())
+        this->errors.insert(r.url, r.error);
     this->mutex.unlock();
 
-    QString file = r.file;
-    if (!file.isEmpty())
-        file = dir.path() + "\\" + file;
+    if ((r.notModified || !r.file.isEmpty()) && !saveTimer.isActive())
+        saveTimer.start();
 
-    emit this->downloadCompleted(r.url, file, r.error);
+    if (!r.notModified)
+        emit this->downloadCompleted(r.url, r.file, r.error);
 
     w->deleteLater();
 }
@@ -79,61 +137,78 @@ FileLoader::DownloadFile FileLoader::downloadRunnable(const QString& url)
     FileLoader::DownloadFile r;
     r.url = url;
 
+    // validators from the cached version
+    bool cached = false;
+    QString eTag, lastModified;
     this->mutex.lock();
-    if (this->files.contains(url)) {
-        QString v = this->files.value(url);
-        if (v.startsWith('*'))
-            r.error = v.mid(1);
-        else
-            r.file = v;
-        this->mutex.unlock();
-    } else {
-        this->mutex.unlock();
-        QString filename = QString::number(id.fetchAndAddAcquire(1));
-        QString fn = dir.path() + "\\" + filename;
-        QFile f(fn);
-        if (f.open(QFile::ReadWrite)) {
-            Job* job = new Job();
-            Downloader::Request request = QUrl(url);
-            request.file = &f;
-            request.useCache = true;
-            request.keepConnection = false;
-            request.timeout = 15;
-
-            Downloader::Response response = Downloader::download(job, request);
-            QString mime = response.mimeType;
-            f.close();
-
-            if (!job->getErrorMessage().isEmpty()) {
+    const FileCache::Entry* e = cache.find(url);
+    if (e) {
+        cached = true;
+        eTag = e->eTag;
+        lastModified = e->lastModified;
+    }
+    this->mutex.unlock();
+
+    QString fn = cache.getDir() + "\\" + QString::number(
+            GetCurrentProcessId()) + "_" +
+            QString::number(id.fetchAndAddAcquire(1)) + ".tmp";
+    QFile f(fn);
+    if (f.open(QFile::ReadWrite)) {
+        Job* job = new Job();
+        Downloader::Request request = QUrl(url);
+        request.file = &f;
+
+        // the files are cached here, not by WinINet
+        request.useCache = false;
+        request.keepConnection = false;
+        request.timeout = 15;
+        request.ifNoneMatch = eTag;
+        request.ifModifiedSince = lastModified;
+
+        Downloader::Response response = Downloader::download(job, request);
+        QString mime = response.mimeType;
+        f.close();
+
+        if (!job->getErrorMessage().isEmpty()) {
+            // an outdated file is better than none
+            if (cached)
+                r.notModified = true;
+            else
                 r.error = job->getErrorMessage();
-            } else {
-                // supported extensions:
-                // "bmp", "cur", "dds", "gif", "icns", "ico", "jp2", "jpeg",
-                // "jpg", "mng", "pbm", "pgm", "png", "ppm", "tga", "tif",
-                // "tiff", "wbmp", "webp", "xbm", "xpm"
-                QString ext;
-                if (mime == "image/png")
-                    ext = ".png";
-                else if (mime == "image/x-icon" || mime == "image/vnd.microsoft.icon")
-                    ext = ".ico";
-                else if (mime == "image/jpeg")
-                    ext = ".jpg";
-                else if (mime == "image/gif")
-                    ext = ".gif";
-                else if (mime == "image/x-windows-bmp" || mime == "image/bmp")
-                    ext = ".bmp";
-                else
-                    ext = ".png";
-
-                // qDebug() << ext;
-                f.close();
-                f.rename(fn + ext);
-                r.file = filename + ext;
-            }
-            delete job;
+            f.remove();
+        } else if (response.notModified) {
+            r.notModified = true;
+            f.remove();
         } else {
-            r.error = QObject::tr("Cannot open the file %1").arg(fn);
+            // supported extensions:
+            // "bmp", "cur", "dds", "gif", "icns", "ico", "jp2", "jpeg",
+            // "jpg", "mng", "pbm", "pgm", "png", "ppm", "tga", "tif",
+            // "tiff", "wbmp", "webp", "xbm", "xpm"
+            QString ext;
+            if (mime == "image/png")
+                ext = ".png";
+            else if (mime == "image/x-icon" || mime == "image/vnd.microsoft.icon")
+                ext = ".ico";
+            else if (mime == "image/jpeg")
+                ext = ".jpg";
+            else if (mime == "image/gif")
+                ext = ".gif";
+            else if (mime == "image/x-windows-bmp" || mime == "image/bmp")
+                ext = ".bmp";
+            else
+                ext = ".png";
+
+            // qDebug() << ext;
+            this->mutex.lock();
+            r.error = cache.store(url, fn, ext, response.eTag,
+                    response.lastModified);
+            if (r.error.isEmpty())
+                r.file = cache.getDir() + "\\" + cache.find(url)->file;
+            this->mutex.unlock();
         }
+        delete job;
+    } else {
+        r.error = QObject::tr("Cannot open the file %1").arg(fn);
     }
 
     CoUninitialize();
@@ -9,11 +9,16 @@
 #include <QThread>
 #include <QAtomicInt>
 #include <QMutex>
-#include <QTemporaryDir>
 #include <QMap>
+#include <QSet>
+#include <QTimer>
+
+#include "filecache.h"
 
 /**
- * Loads files from the Internet.
+ * Loads files from the Internet. The downloaded files are kept in a
+ * persistent FileCache and re-validated in the background using
+ * conditional requests.
  */
 class FileLoader: public QObject
 {
@@ -23,20 +28,46 @@ class FileLoader: public QObject
     {
     public:
         QString url, file, error;
+
+        /** true if the cached file is still up-to-date */
+        bool notModified;
+
+        DownloadFile(): notModified(false) {
+        }
     };
 
     /**
-     * @brief URL -> local relative file name in the temporary directory or
-     *     an error message if it starts with an asterisk (*). The data
+     * @brief URL -> error message for failed downloads. The data
+     *     in this field should be accessed under the mutex.
+     */
+    QMap<QString, QString> errors;
+
+    /**
+     * @brief URLs that are being downloaded or re-validated. The data
      *     in this field should be accessed under the mutex.
      */
-    QMap<QString, QString> files;
+    QSet<QString> loading;
 
     QAtomicInt id;
 
     QMutex mutex;
 
-    QTemporaryDir dir;
+    /** downloaded files. Should be accessed under the mutex. */
+    FileCache cache;
+
+    /** writes the cache index some time after a change */
+    QTimer saveTimer;
+
+    /**
+     * @brief loads the cache index and prepares the timer
+     */
+    void init();
+
+    /**
+     * @brief starts a download in the thread pool
+     * @param url this file will be downloaded
+     */
+    void queue(const QString& url);
 
     /**
      * @brief downloads a file
@@ -45,15 +76,34 @@ class FileLoader: public QObject
      */
     DownloadFile downloadRunnable(const QString &url);
 public:
+    /** cached files are re-validated after this number of seconds */
+    static const int REVALIDATE = 24 * 60 * 60;
+
     /**
-     * The thread is not started.
+     * The thread is not started. The default cache directory is used.
      */
     FileLoader();
 
-    virtual ~FileLoader() {}
+    /**
+     * The thread is not started.
+     *
+     * @param dir cache directory
+     * @param maxSize maximum size of the cache in bytes
+     */
+    FileLoader(const QString& dir, qint64 maxSize);
 
     /**
-     * @brief download a file. This function does not block.
+     * Saves the cache index.
+     */
+    virtual ~FileLoader();
+
+    /** the cache index is written after this number of milliseconds */
+    static const int SAVE_DELAY = 5000;
+
+    /**
+     * @brief download a file. This function does not block. Files from the
+     *     cache are returned immediately. downloadCompleted() is emitted if
+     *     a file was downloaded or changed on the server.
      * @param url this file will be downloaded
      * @param err error message or ""
      * @return local file name or "" if file is being downloaded
@@ -70,6 +120,11 @@ signals:
             const QString& err);
 private slots:
     void watcherFinished();
+
+    /**
+     * @brief writes the cache index
+     */
+    void saveIndex();
 };
 
 #endif // FILELOADER_H
@@ -0,0 +1,55 @@
+#include "hashsumwriter.h"
+
+HashSumWriter::HashSumWriter(QFile* file, bool computeHashSum,
+        QCryptographicHash::Algorithm alg): file(file), hash(alg),
+        computeHashSum(computeHashSum)
+{
+}
+
+QString HashSumWriter::write(const char* data, qint64 len)
+{
+    QString err;
+
+    if (computeHashSum)
+        hash.addData(data, len);
+
+    if (file && file->write(data, len) != len)
+        err = QObject::tr("Error writing file %1: %2").
+                arg(file->fileName()).arg(file->errorString());
+
+    return err;
+}
+
+QString HashSumWriter::writeAll(QIODevice* device)
+{
+    QString err;
+
+    const int SIZE = 512 * 1024;
+    char* buffer = new char[SIZE];
+
+    while (true) {
+        qint64 r = device->read(buffer, SIZE);
+        if (r < 0) {
+            err = device->errorString();
+            break;
+        }
+        if (r == 0)
+            break;
+
+        err = write(buffer, r);
+        if (!err.isEmpty())
+            break;
+    }
+
+    delete[] buffer;
+
+    return err;
+}
+
+QString HashSumWriter::getHashSum() const
+{
+    QString r;
+    if (computeHashSum)
+        r = hash.result().toHex().toLower();
+    return r;
+}
@@ -0,0 +1,51 @@
+#ifndef HASHSUMWRITER_H
+#define HASHSUMWRITER_H
+
+#include <QFile>
+#include <QString>
+#include <QCryptographicHash>
+
+/**
+ * @brief passes data through a hash sum computation and into a file at the
+ *     same time. This way the data only has to be read once.
+ */
+class HashSumWriter
+{
+private:
+    QFile* file;
+    QCryptographicHash hash;
+    bool computeHashSum;
+public:
+    /**
+     * @param file the data will be written here. 0 means that the data is not
+     *     stored.
+     * @param computeHashSum true = compute the hash sum
+     * @param alg algorithm for the hash sum
+     */
+    HashSumWriter(QFile* file, bool computeHashSum,
+            QCryptographicHash::Algorithm alg);
+
+    /**
+     * @brief processes the next block of data
+     * @param data data
+     * @param len length of the data
+     * @return error message
+     */
+    QString write(const char* data, qint64 len);
+
+    /**
+     * @brief reads the whole device from the current position and processes
+     *     the data
+     * @param device data source
+     * @return error message
+     */
+    QString writeAll(QIODevice* device);
+
+    /**
+     * @return computed hash sum as a lower case hex string or "" if the hash
+     *     sum is not computed
+     */
+    QString getHashSum() const;
+};
+
+#endif // HASHSUMWRITER_H
@@ -31,12 +31,13 @@ InstalledPackages* InstalledPackages::getDefault()
     return &def;
 }
 
-InstalledPackages::InstalledPackages() : mutex(QMutex::Recursive)
+InstalledPackages::InstalledPackages() : mutex(QMutex::Recursive),
+        ownersChanged(true)
 {
 }
 
 InstalledPackages::InstalledPackages(const InstalledPackages &other) :
-        QObject(), mutex(QMutex::Recursive)
+        QObject(), mutex(QMutex::Recursive), ownersChanged(true)
 {
     *this = other;
 }
@@ -46,6 +47,7 @@ InstalledPackages &InstalledPackages::operator=(const InstalledPackages &other)
     this->mutex.lock();
     qDeleteAll(this->data);
     this->data.clear();
+    changed();
     QList<InstalledPackageVersion*> ipvs = other.getAll();
     for (int i = 0; i < ipvs.size(); i++) {
         InstalledPackageVersion* ipv = ipvs.at(i);
@@ -76,19 +78,50 @@ InstalledPackageVersion* InstalledPackages::findNoCopy(const QString& package,
     return ipv;
 }
 
+void InstalledPackages::changed()
+{
+    // internal method, mutex should be held
+
+    this->ownersChanged = true;
+
+    this->snapshotMutex.lock();
+    this->snapshot.reset();
+    this->snapshotMutex.unlock();
+}
+
+QSharedPointer<const InstalledPackagesSnapshot>
+        InstalledPackages::getSnapshot() const
+{
+    this->snapshotMutex.lock();
+    QSharedPointer<const InstalledPackagesSnapshot> r = this->snapshot;
+    this->snapshotMutex.unlock();
+
+    if (r.isNull()) {
+        // the order of locking is always "mutex", then "snapshotMutex"
+        this->mutex.lock();
+        this->snapshotMutex.lock();
+
+        // another thread may have already created the snapshot
+        if (this->snapshot.isNull())
+            this->snapshot = QSharedPointer<const InstalledPackagesSnapshot>(
+                    new InstalledPackagesSnapshot(this->data));
+        r = this->snapshot;
+
+        this->snapshotMutex.unlock();
+        this->mutex.unlock();
+    }
+
+    return r;
+}
+
 InstalledPackageVersion* InstalledPackages::find(const QString& package,
         const Version& version) const
 {
-    this->mutex.lock();
+    QSharedPointer<const InstalledPackagesSnapshot> s = getSnapshot();
 
-    InstalledPackageVersion* ipv = this->data.value(
-            PackageVersion::getStringId(package, version));
-    if (ipv)
-        ipv = ipv->clone();
+    const InstalledPackageVersion* ipv = s->find(package, version);
 
-    this->mutex.unlock();
-
-    return ipv;
+    return ipv ? ipv->clone() : 0;
 }
 
 void InstalledPackages::detect3rdParty(Job* job, DBRepository* r,
@@ -338,6 +371,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
     }
 
     InstalledPackageVersion* ipv2 = 0;
+    this->mutex.lock();
     if (err.isEmpty()) {
         // qDebug() << "    4";
         ipv2 = this->findOrCreate(ipv->package, ipv->version, &err);
@@ -347,10 +381,12 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         // qDebug() << "    5";
         ipv2->detectionInfo = ipv->detectionInfo;
         ipv2->setPath(d);
+        changed();
 
         //qDebug() << ipv2->package << ipv2->version.getVersionString() <<
         //        ipv2->directory << ipv2->detectionInfo;
     }
+    this->mutex.unlock();
 }
 
 InstalledPackageVersion* InstalledPackages::findOrCreate(const QString& package,
@@ -378,6 +414,8 @@ QString InstalledPackages::setPackageVersionPath(const QString& package,
 
     QString err;
 
+    changed();
+
     InstalledPackageVersion* ipv = this->findNoCopy(package, version);
     if (!ipv) {
         ipv = new InstalledPackageVersion(package, version, directory);
@@ -402,16 +440,32 @@ InstalledPackageVersion *InstalledPackages::findOwner(
 {
     this->mutex.lock();
 
-    InstalledPackageVersion* f = 0;
-    QList<InstalledPackageVersion*> ipvs = this->data.values();
-    for (int i = 0; i < ipvs.count(); ++i) {
-        InstalledPackageVersion* ipv = ipvs.at(i);
-        QString dir = ipv->getDirectory();
-        if (!dir.isEmpty() && (WPMUtils::pathEquals(filePath, dir) ||
-                WPMUtils::isUnder(filePath, dir))) {
-            f = ipv;
-            break;
+    if (this->ownersChanged) {
+        this->owners.clear();
+        QMap<QString, InstalledPackageVersion*>::const_iterator it;
+        for (it = this->data.constBegin(); it != this->data.constEnd(); ++it) {
+            InstalledPackageVersion* ipv = it.value();
+            QString dir = ipv->getDirectory();
+            if (!dir.isEmpty()) {
+                dir = WPMUtils::normalizePath(dir, true);
+                if (!this->owners.contains(dir))
+                    this->owners.insert(dir, ipv);
+            }
         }
+        this->ownersChanged = false;
+    }
+
+    // the path itself and then all parent directories from the deepest to
+    // the root are searched in the index
+    QString path = WPMUtils::normalizePath(filePath, true);
+    InstalledPackageVersion* f = this->owners.value(path);
+    int index = path.length();
+    while (!f) {
+        index = path.lastIndexOf(QLatin1Char('\\'), index - 1);
+        if (index <= 0)
+            break;
+
+        f = this->owners.value(path.left(index));
     }
 
     if (f)
@@ -424,132 +478,49 @@ InstalledPackageVersion *InstalledPackages::findOwner(
 
 QList<InstalledPackageVersion*> InstalledPackages::getAll() const
 {
-    this->mutex.lock();
+    QSharedPointer<const InstalledPackagesSnapshot> s = getSnapshot();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
+    QList<const InstalledPackageVersion*> all = s->getAll();
     QList<InstalledPackageVersion*> r;
     for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed())
-            r.append(ipv->clone());
+        r.append(all.at(i)->clone());
     }
 
-    this->mutex.unlock();
-
     return r;
 }
 
 QList<InstalledPackageVersion *> InstalledPackages::getByPackage(
         const QString &package) const
 {
-    this->mutex.lock();
+    QSharedPointer<const InstalledPackagesSnapshot> s = getSnapshot();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
+    QList<const InstalledPackageVersion*> all = s->getByPackage(package);
     QList<InstalledPackageVersion*> r;
     for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed() && ipv->package == package)
-            r.append(ipv->clone());
+        r.append(all.at(i)->clone());
     }
 
-    this->mutex.unlock();
-
     return r;
 }
 
 InstalledPackageVersion* InstalledPackages::getNewestInstalled(
         const QString &package) const
 {
-    this->mutex.lock();
+    QSharedPointer<const InstalledPackagesSnapshot> s = getSnapshot();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
-    InstalledPackageVersion* r = 0;
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->package == package && ipv->installed()) {
-            if (!r || r->version < ipv->version)
-                r = ipv;
-        }
-    }
-
-    if (r)
-        r = r->clone();
-
-    this->mutex.unlock();
+    const InstalledPackageVersion* r = s->getNewestInstalled(package);
 
-    return r;
+    return r ? r->clone() : 0;
 }
 
 bool InstalledPackages::isInstalled(const Dependency& dep) const
 {
-    QList<InstalledPackageVersion*> installed = getAll();
-    bool res = false;
-    for (int i = 0; i < installed.count(); i++) {
-        InstalledPackageVersion* ipv = installed.at(i);
-        if (ipv->package == dep.package &&
-                dep.test(ipv->version)) {
-            res = true;
-            break;
-        }
-    }
-    qDeleteAll(installed);
-    return res;
+    return getSnapshot()->isInstalled(dep);
 }
 
 QSet<QString> InstalledPackages::getPackages() const
 {
-    this->mutex.lock();
-
-    QList<InstalledPackageVersion*> all = this->data.values();
-    QSet<QString> r;
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed())
-            r.insert(ipv->package);
-    }
-
-    this->mutex.unlock();
-
-    return r;
-}
-
-InstalledPackageVersion*
-        InstalledPackages::findFirstWithMissingDependency() const
-{
-    InstalledPackageVersion* r = 0;
-
-    this->mutex.lock();
-
-    DBRepository* dbr = DBRepository::getDefault();
-    QList<InstalledPackageVersion*> all = this->data.values();
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed()) {
-            QString err;
-            QScopedPointer<PackageVersion> pv(dbr->findPackageVersion_(
-                    ipv->package, ipv->version, &err));
-
-            //if (!pv.data()) {
-            //    qDebug() << "cannot find" << ipv->package << ipv->version.getVersionString();
-            //}
-
-            if (err.isEmpty() && pv.data()) {
-                for (int j = 0; j < pv->dependencies.size(); j++) {
-                    if (!isInstalled(*pv->dependencies.at(j))) {
-                        r = ipv->clone();
-                        break;
-                    }
-                }
-            }
-        }
-
-        if (r)
-            break;
-    }
-
-    this->mutex.unlock();
-
-    return r;
+    return getSnapshot()->getPackages();
 }
 
 QString InstalledPackages::notifyInstalled(const QString &package,
@@ -613,7 +584,7 @@ QStringList InstalledPackages::getAllInstalledPackagePaths() const
 
 void InstalledPackages::refresh(DBRepository *rep, Job *job, bool detectMSI)
 {
-    rep->currentRepository = 10000;
+    rep->currentRepository = DBRepository::DETECTION_REPOSITORY;
 
     // no direct usage of "data" here => no mutex
 
@@ -792,29 +763,13 @@ QString InstalledPackages::save()
 QString InstalledPackages::getPath(const QString &package,
         const Version &version) const
 {
-    this->mutex.lock();
-
-    QString r;
-    InstalledPackageVersion* ipv = findNoCopy(package, version);
-    if (ipv)
-        r = ipv->getDirectory();
-
-    this->mutex.unlock();
-
-    return r;
+    return getSnapshot()->getPath(package, version);
 }
 
 bool InstalledPackages::isInstalled(const QString &package,
         const Version &version) const
 {
-    this->mutex.lock();
-
-    InstalledPackageVersion* ipv = findNoCopy(package, version);
-    bool r = ipv && ipv->installed();
-
-    this->mutex.unlock();
-
-    return r;
+    return getSnapshot()->isInstalled(package, version);
 }
 
 void InstalledPackages::fireStatusChanged(const QString &package,
@@ -907,6 +862,7 @@ QString InstalledPackages::readRegistryDatabase()
     this->mutex.lock();
     qDeleteAll(this->data);
     this->data.clear();
+    changed();
     for (int i = 0; i < ipvs.count(); i++) {
         InstalledPackageVersion* ipv = ipvs.at(i);
         this->data.insert(PackageVersion::getStringId(ipv->package,
@@ -930,6 +886,7 @@ void InstalledPackages::clear()
     this->mutex.lock();
     qDeleteAll(this->data);
     this->data.clear();
+    changed();
     this->mutex.unlock();
 }
 
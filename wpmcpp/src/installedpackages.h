@@ -5,11 +5,14 @@
 #include <memory>
 
 #include <QMap>
+#include <QHash>
 #include <QObject>
 #include <QSet>
 #include <QString>
+#include <QSharedPointer>
 
 #include "installedpackageversion.h"
+#include "installedpackagessnapshot.h"
 #include "version.h"
 #include "windowsregistry.h"
 #include "job.h"
@@ -33,6 +36,39 @@ private:
     /** please use the mutex to access the data */
     QMap<QString, InstalledPackageVersion*> data;
 
+    /**
+     * normalized lower case installation directory => installed package
+     * version from *data*. Please use the mutex to access this index. It is
+     * re-created by findOwner() if ownersChanged is true.
+     */
+    mutable QHash<QString, InstalledPackageVersion*> owners;
+
+    /**
+     * true if the installation directories in *data* were changed after
+     * *owners* was created. Please use the mutex.
+     */
+    mutable bool ownersChanged;
+
+    /**
+     * this mutex only protects *snapshot* and is never held for a long time.
+     * It is always acquired after *mutex* if both are needed.
+     */
+    mutable QMutex snapshotMutex;
+
+    /**
+     * the current snapshot of *data* or null if it was not yet created after
+     * the last change. Please use snapshotMutex to access this value.
+     */
+    mutable QSharedPointer<const InstalledPackagesSnapshot> snapshot;
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE. *mutex* should be held.
+     *
+     * @brief should be called after *data* was changed. Invalidates the
+     *     current snapshot and the index of installation directories.
+     */
+    void changed();
+
     /**
      * @brief processOneInstalled3rdParty
      * @param r
@@ -164,6 +200,15 @@ public:
     InstalledPackageVersion* find(const QString& package,
             const Version& version) const;
 
+    /**
+     * @brief returns the current state of installed packages. The returned
+     *     object can be used without locking or copying from any thread and
+     *     does not change. Use this for many read operations in a row, e.g.
+     *     for checking the status of all package versions in a list.
+     * @return immutable snapshot
+     */
+    QSharedPointer<const InstalledPackagesSnapshot> getSnapshot() const;
+
     /**
      * @brief searches for a dependency in the list of installed packages. This
      *     function uses the Windows registry directly and should be only used
@@ -279,12 +324,6 @@ public:
      * @return the package names
      */
     QSet<QString> getPackages() const;
-
-    /**
-     * @return [owner:caller] the first found package version with a missing
-     *     dependency or 0
-     */
-    InstalledPackageVersion *findFirstWithMissingDependency() const;
 signals:
     /**
      * @brief fired if a package version was installed or uninstalled
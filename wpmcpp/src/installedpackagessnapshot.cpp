@@ -0,0 +1,115 @@
+#include "installedpackagessnapshot.h"
+
+#include "packageversion.h"
+
+InstalledPackagesSnapshot::InstalledPackagesSnapshot(
+        const QMap<QString, InstalledPackageVersion*>& data)
+{
+    QMap<QString, InstalledPackageVersion*>::const_iterator it;
+    for (it = data.constBegin(); it != data.constEnd(); ++it) {
+        // the keys are sorted => appending is fast
+        this->data.insert(this->data.constEnd(), it.key(),
+                it.value()->clone());
+    }
+}
+
+InstalledPackagesSnapshot::~InstalledPackagesSnapshot()
+{
+    qDeleteAll(this->data);
+}
+
+const InstalledPackageVersion* InstalledPackagesSnapshot::find(
+        const QString& package, const Version& version) const
+{
+    return this->data.value(PackageVersion::getStringId(package, version));
+}
+
+QString InstalledPackagesSnapshot::getPath(const QString& package,
+        const Version& version) const
+{
+    QString r;
+    const InstalledPackageVersion* ipv = find(package, version);
+    if (ipv)
+        r = ipv->getDirectory();
+    return r;
+}
+
+bool InstalledPackagesSnapshot::isInstalled(const QString& package,
+        const Version& version) const
+{
+    const InstalledPackageVersion* ipv = find(package, version);
+    return ipv && ipv->installed();
+}
+
+bool InstalledPackagesSnapshot::isInstalled(const Dependency& dep) const
+{
+    // the keys are sorted and start with the package name
+    QString prefix = dep.package + QLatin1Char('/');
+    QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            this->data.lowerBound(prefix);
+    for (; it != this->data.constEnd() && it.key().startsWith(prefix); ++it) {
+        const InstalledPackageVersion* ipv = it.value();
+        if (ipv->installed() && dep.test(ipv->version))
+            return true;
+    }
+
+    return false;
+}
+
+const InstalledPackageVersion* InstalledPackagesSnapshot::getNewestInstalled(
+        const QString& package) const
+{
+    QString prefix = package + QLatin1Char('/');
+    const InstalledPackageVersion* r = 0;
+    QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            this->data.lowerBound(prefix);
+    for (; it != this->data.constEnd() && it.key().startsWith(prefix); ++it) {
+        const InstalledPackageVersion* ipv = it.value();
+        if (ipv->installed() && (!r || r->version < ipv->version))
+            r = ipv;
+    }
+
+    return r;
+}
+
+QList<const InstalledPackageVersion*> InstalledPackagesSnapshot::getAll() const
+{
+    QList<const InstalledPackageVersion*> r;
+    QMap<QString, InstalledPackageVersion*>::const_iterator it;
+    for (it = this->data.constBegin(); it != this->data.constEnd(); ++it) {
+        const InstalledPackageVersion* ipv = it.value();
+        if (ipv->installed())
+            r.append(ipv);
+    }
+
+    return r;
+}
+
+QList<const InstalledPackageVersion*> InstalledPackagesSnapshot::getByPackage(
+        const QString& package) const
+{
+    QString prefix = package + QLatin1Char('/');
+    QList<const InstalledPackageVersion*> r;
+    QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            this->data.lowerBound(prefix);
+    for (; it != this->data.constEnd() && it.key().startsWith(prefix); ++it) {
+        const InstalledPackageVersion* ipv = it.value();
+        if (ipv->installed())
+            r.append(ipv);
+    }
+
+    return r;
+}
+
+QSet<QString> InstalledPackagesSnapshot::getPackages() const
+{
+    QSet<QString> r;
+    QMap<QString, InstalledPackageVersion*>::const_iterator it;
+    for (it = this->data.constBegin(); it != this->data.constEnd(); ++it) {
+        const InstalledPackageVersion* ipv = it.value();
+        if (ipv->installed())
+            r.insert(ipv->package);
+    }
+
+    return r;
+}
@@ -0,0 +1,101 @@
+#ifndef INSTALLEDPACKAGESSNAPSHOT_H
+#define INSTALLEDPACKAGESSNAPSHOT_H
+
+#include <QMap>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+#include "installedpackageversion.h"
+#include "version.h"
+#include "dependency.h"
+
+/**
+ * @brief immutable copy of the information about installed packages.
+ *
+ * A snapshot is created by InstalledPackages::getSnapshot() and is never
+ * changed afterwards. It can be used from many threads at the same time
+ * without any locking. Changes in InstalledPackages are only visible in
+ * snapshots created after the change.
+ *
+ * @threadsafe
+ */
+class InstalledPackagesSnapshot
+{
+    /** "package/version" => [owner] installed package version */
+    QMap<QString, InstalledPackageVersion*> data;
+
+    Q_DISABLE_COPY(InstalledPackagesSnapshot)
+public:
+    /**
+     * @param data "package/version" => installed package version. The
+     *     objects are copied.
+     */
+    InstalledPackagesSnapshot(
+            const QMap<QString, InstalledPackageVersion*>& data);
+
+    ~InstalledPackagesSnapshot();
+
+    /**
+     * @brief finds the specified installed package version
+     * @param package full package name
+     * @param version package version
+     * @return [ownership:this] found information or 0. The returned object
+     *     may still represent a not installed package version. Please check
+     *     InstalledPackageVersion::getDirectory()
+     */
+    const InstalledPackageVersion* find(const QString& package,
+            const Version& version) const;
+
+    /**
+     * @brief returns the path of an installed package version
+     * @param package full package name
+     * @param version package version
+     * @return installation path or "" if the package version is not installed
+     */
+    QString getPath(const QString& package, const Version& version) const;
+
+    /**
+     * @brief checks whether a package version is installed
+     * @param package full package name
+     * @param version version number
+     * @return true = installed
+     */
+    bool isInstalled(const QString& package, const Version& version) const;
+
+    /**
+     * @param dep a dependency
+     * @return true if a package, that satisfies this dependency, is installed
+     */
+    bool isInstalled(const Dependency& dep) const;
+
+    /**
+     * @brief returns the newest installed version for a package
+     * @param package full package name
+     * @return [ownership:this] found installed version or 0
+     */
+    const InstalledPackageVersion* getNewestInstalled(
+            const QString& package) const;
+
+    /**
+     * @return [ownership:this] installed packages
+     */
+    QList<const InstalledPackageVersion*> getAll() const;
+
+    /**
+     * Searches for installed versions of a package.
+     *
+     * @param package full package name
+     * @return [ownership:this] installed versions of the package
+     */
+    QList<const InstalledPackageVersion*> getByPackage(
+            const QString& package) const;
+
+    /**
+     * @brief returns the packages with at least one version installed
+     * @return the package names
+     */
+    QSet<QString> getPackages() const;
+};
+
+#endif // INSTALLEDPACKAGESSNAPSHOT_H
@@ -1,18 +1,27 @@
 #include <math.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "qdebug.h"
 #include "qmutex.h"
+#include <QTimer>
 
 #include "wpmutils.h"
 
 #include "job.h"
 
+/** Job::progress is stored as an integer with this precision */
+static const int PROGRESS_SCALE = 1000000;
+
+/** minimal interval between two changed() signals in milliseconds */
+static const int CHANGE_INTERVAL = 100;
+
 Job::Job(const QString &title, Job *parent):
-        mutex(QMutex::Recursive), parentJob(parent)
+        mutex(QMutex::Recursive), progress(0), reportedProgress(0),
+        lastChangeEmitted(0), flushScheduled(0),
+        parentJob(parent)
 {
     this->title = title;
-    this->progress = 0.0;
     this->subJobStart = 0;
     this->subJobSteps = -1;
     this->cancelRequested = false;
@@ -31,8 +40,8 @@ time_t Job::remainingTime()
 {
     this->mutex.lock();
     time_t started_ = this->started;
-    double progress_ = this->progress;
     this->mutex.unlock();
+    double progress_ = getProgress();
 
     time_t result;
     if (started != 0) {
@@ -92,8 +101,12 @@ void Job::complete()
     }
     this->mutex.unlock();
 
-    if (f)
+    if (f) {
+        // the pending changes should be visible before the completion
+        fireChange(true);
+
         emit jobCompleted();
+    }
 }
 
 void Job::completeWithProgress()
@@ -123,7 +136,7 @@ void Job::cancel()
     this->mutex.unlock();
 
     if (changed) {
-        fireChange();
+        fireChange(true);
 
         this->mutex.lock();
         for (int i = 0; i < this->childJobs.size(); i++) {
@@ -181,7 +194,7 @@ bool Job::isCompleted()
     return completed_;
 }
 
-void Job::fireChange()
+void Job::fireChange(bool force)
 {
     this->mutex.lock();
     if (this->started == 0)
@@ -202,34 +215,87 @@ void Job::fireChange()
     while (top->parentJob)
         top = top->parentJob;
 
-    top->fireChange(this);
+    top->fireChange(this, force);
 
     if (t)
         this->cancel();
 }
 
-void Job::fireChange(Job* s)
+void Job::fireChange(Job* s, bool force)
 {
-    emit changed(s);
+    // GetTickCount() wraps around after 49 days. The difference is still
+    // correct.
+    DWORD now = GetTickCount();
+    DWORD last = (DWORD) this->lastChangeEmitted.load();
+    if (!force && now - last < (DWORD) CHANGE_INTERVAL) {
+        this->pendingMutex.lock();
+        this->pendingChanges.insert(s);
+        this->pendingMutex.unlock();
+
+        // the change should not get lost if the job does not change anymore.
+        // The timer can only be started in the thread of this job.
+        if (this->flushScheduled.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(this, "scheduleFlush",
+                    Qt::QueuedConnection);
+    } else {
+        this->lastChangeEmitted.store((int) now);
+
+        QSet<Job*> pending = takePendingChanges();
+        pending.remove(s);
+        QSetIterator<Job*> it(pending);
+        while (it.hasNext())
+            emit changed(it.next());
+        emit changed(s);
+    }
 }
 
-void Job::setProgress(double progress)
+QSet<Job*> Job::takePendingChanges()
 {
-    bool changed = false;
+    this->pendingMutex.lock();
+    QSet<Job*> r;
+    r.swap(this->pendingChanges);
+    this->pendingMutex.unlock();
+    return r;
+}
 
-    this->mutex.lock();
+void Job::scheduleFlush()
+{
+    QTimer::singleShot(CHANGE_INTERVAL, this, SLOT(flushChange()));
+}
+
+void Job::flushChange()
+{
+    this->flushScheduled.store(0);
+
+    QSet<Job*> pending = takePendingChanges();
+    if (!pending.isEmpty()) {
+        this->lastChangeEmitted.store((int) GetTickCount());
+        QSetIterator<Job*> it(pending);
+        while (it.hasNext())
+            emit changed(it.next());
+    }
+}
+
+void Job::setProgress(double progress)
+{
     if (progress > 1.0001) {
-        qDebug() << "Job: progress =" << progress << "in" << this->title;
+        qDebug() << "Job: progress =" << progress << "in" << getTitle();
     }
-    if (progress < this->progress) {
-        qDebug() << "Job: stepping back from" << this->progress <<
+
+    int p = lround(progress * PROGRESS_SCALE);
+    int old = this->progress.fetchAndStoreOrdered(p);
+    if (p < old) {
+        qDebug() << "Job: stepping back from" <<
+                ((double) old) / PROGRESS_SCALE <<
                 "to" << progress << "in" << getFullTitle();
     }
-    if (fabs(progress - this->progress) > 0.005) {
-        this->progress = progress;
-        changed = true;
-    }
-    this->mutex.unlock();
+
+    // only changes bigger than 0.5% and the end are reported to the
+    // listeners and the parent job. Smaller changes are only stored.
+    int reported = this->reportedProgress.load();
+    bool changed = (abs(p - reported) > PROGRESS_SCALE / 200 ||
+            (p >= PROGRESS_SCALE && reported < PROGRESS_SCALE)) &&
+            this->reportedProgress.testAndSetOrdered(reported, p);
 
     if (changed) {
         fireChange();
@@ -259,12 +325,7 @@ void Job::updateParentProgress()
 
 double Job::getProgress() const
 {
-    double progress_;
-    this->mutex.lock();
-    progress_ = this->progress;
-    this->mutex.unlock();
-
-    return progress_;
+    return ((double) this->progress.load()) / PROGRESS_SCALE;
 }
 
 int Job::getLevel() const
@@ -400,7 +461,7 @@ void Job::setErrorMessage(const QString &errorMessage)
     this->mutex.unlock();
 
     if (changed) {
-        fireChange();
+        fireChange(true);
 
         this->mutex.lock();
         for (int i = 0; i < childJobs.count(); i++) {
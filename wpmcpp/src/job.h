@@ -8,6 +8,8 @@
 #include <QQueue>
 #include <QTime>
 #include <QList>
+#include <QAtomicInt>
+#include <QSet>
 
 class Job;
 
@@ -39,6 +41,15 @@ class Job;
  * } else {
  *     ....
  * }
+ *
+ * The changes are reported to the listeners via the changed() signal of the
+ * top level job at most every 100 milliseconds. Completion, errors and
+ * cancelling are reported immediately. Every job that changed in between is
+ * reported once with the next signal, or after 100 milliseconds if the
+ * thread of the top level job runs an event loop. Listeners should also
+ * update the
+ * parent jobs of the reported job as their progress is not always reported
+ * separately.
  */
 class Job: public QObject
 {
@@ -51,8 +62,35 @@ private:
 
     QList<Job*> childJobs;
 
-    /** progress 0...1 */
-    double progress;
+    /** progress 0...1 multiplied by PROGRESS_SCALE */
+    QAtomicInt progress;
+
+    /**
+     * progress 0...1 multiplied by PROGRESS_SCALE that was last reported to
+     * the listeners and the parent job
+     */
+    QAtomicInt reportedProgress;
+
+    /**
+     * only used in the top level job: GetTickCount() at the time when the
+     * changed() signal was last emitted
+     */
+    QAtomicInt lastChangeEmitted;
+
+    /** only used in the top level job: protects pendingChanges */
+    QMutex pendingMutex;
+
+    /**
+     * only used in the top level job: changed jobs that were not yet
+     * reported via the changed() signal
+     */
+    QSet<Job*> pendingChanges;
+
+    /**
+     * only used in the top level job: 1 if flushChange() is already
+     * scheduled
+     */
+    QAtomicInt flushScheduled;
 
     QString title;
 
@@ -80,13 +118,42 @@ private:
     void updateParentProgress();
 
     /**
+     * @param force true = report the change immediately
      * @threadsafe
      */
-    void fireChange();
+    void fireChange(bool force=false);
 
     void fireSubJobCreated(Job *sub);
 
-    void fireChange(Job *s);
+    /**
+     * Only called on the top level job. Emits the changed() signal if the
+     * last one was emitted long enough ago.
+     *
+     * @param s the changed job
+     * @param force true = emit the signal regardless of the time
+     * @threadsafe
+     */
+    void fireChange(Job *s, bool force);
+
+    /**
+     * Only called on the top level job.
+     *
+     * @return the pending changes. The list of pending changes is empty
+     *     afterwards.
+     * @threadsafe
+     */
+    QSet<Job*> takePendingChanges();
+private slots:
+    /**
+     * @brief starts a timer for flushChange(). Runs in the thread of this
+     *     job.
+     */
+    void scheduleFlush();
+
+    /**
+     * @brief emits the changed() signal for the pending changes, if any
+     */
+    void flushChange();
 public slots:
     /**
      * @threadsafe
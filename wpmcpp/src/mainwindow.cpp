@@ -518,6 +518,10 @@ void MainWindow::repositoryStatusChanged(const QString& package,
 void MainWindow::downloadCompleted(const QString& url,
         const QString& filename, const QString& error)
 {
+    // a cached file may have been replaced by a newer version
+    icons.remove(url);
+    screenshots.remove(url);
+
     updateIcon(url);
 }
 
@@ -700,11 +704,10 @@ void MainWindow::monitoredJobChanged(Job* state)
     time_t now;
     time(&now);
 
-    if (!state->parentJob) {
-        VisibleJobs::getDefault()->monitoredJobLastChanged = now;
+    // the changes of the top level job are not always reported separately
+    VisibleJobs::getDefault()->monitoredJobLastChanged = now;
 
-        updateProgressTabTitle();
-    }
+    updateProgressTabTitle();
 }
 
 void MainWindow::monitor(Job* job)
@@ -1616,6 +1619,12 @@ void MainWindow::recognizeAndLoadRepositoriesThreadFinished()
     PackageItemModel* m = static_cast<PackageItemModel*>(t->model());
     m->setPackages(QStringList());
     m->clearCache();
+
+    // the database may have been replaced by a newer generation
+    QString err = DBRepository::getDefault()->openDefault();
+    if (!err.isEmpty())
+        addErrorMessage(err, err, true, QMessageBox::Critical);
+
     fillList();
 
     sm->setCurrentIndex(index, QItemSelectionModel::Current);
@@ -3,6 +3,9 @@
 #include <QSharedPointer>
 #include <QDebug>
 #include <QApplication>
+#include <QThread>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "dbrepository.h"
 #include "license.h"
@@ -10,15 +13,27 @@
 #include "abstractrepository.h"
 #include "mainwindow.h"
 #include "wpmutils.h"
+#include "installedpackages.h"
+
+const int PackageItemModel::BLOCK;
 
 PackageItemModel::PackageItemModel(const QStringList& packages) :
-        obsoleteBrush(QColor(255, 0xc7, 0xc7))
+        obsoleteBrush(QColor(255, 0xc7, 0xc7)), nextBlockID(0)
 {
     this->packages = packages;
+
+    // the visible rows and a few blocks around them should fit in the cache
+    this->cache.setMaxCost(BLOCK * 40);
+
+    // the blocks are loaded one after another using only one database
+    // connection
+    this->threadPool.setMaxThreadCount(1);
 }
 
 PackageItemModel::~PackageItemModel()
 {
+    this->threadPool.clear();
+    this->threadPool.waitForDone();
 }
 
 int PackageItemModel::rowCount(const QModelIndex &parent) const
@@ -31,25 +46,20 @@ int PackageItemModel::columnCount(const QModelIndex &parent) const
     return 7;
 }
 
-PackageItemModel::Info* PackageItemModel::createInfo(
-        Package* p) const
+PackageItemModel::Info PackageItemModel::createInfo(DBRepository* rep,
+        const InstalledPackagesSnapshot* installed, Package* p,
+        const QList<PackageVersion*>& pvs)
 {
-    Info* r = new Info();
-
-    DBRepository* rep = DBRepository::getDefault();
-
-    // error is ignored here
-    QString err;
-    QList<PackageVersion*> pvs = rep->getPackageVersions_(p->name, &err);
+    Info r;
 
     PackageVersion* newestInstallable = 0;
     PackageVersion* newestInstalled = 0;
     for (int j = 0; j < pvs.count(); j++) {
         PackageVersion* pv = pvs.at(j);
-        if (pv->installed()) {
-            if (!r->installed.isEmpty())
-                r->installed.append(", ");
-            r->installed.append(pv->version.getVersionString());
+        if (installed->isInstalled(pv->package, pv->version)) {
+            if (!r.installed.isEmpty())
+                r.installed.append(", ");
+            r.installed.append(pv->version.getVersionString());
             if (!newestInstalled ||
                     newestInstalled->version.compare(pv->version) < 0)
                 newestInstalled = pv;
@@ -63,35 +73,138 @@ PackageItemModel::Info* PackageItemModel::createInfo(
     }
 
     if (newestInstallable) {
-        r->avail = newestInstallable->version.getVersionString();
-        r->newestDownloadURL = newestInstallable->download.toString(
+        r.avail = newestInstallable->version.getVersionString();
+        r.newestDownloadURL = newestInstallable->download.toString(
                 QUrl::FullyEncoded);
     }
 
-    r->up2date = !(newestInstalled && newestInstallable &&
+    r.up2date = !(newestInstalled && newestInstallable &&
             newestInstallable->version.compare(
             newestInstalled->version) > 0);
 
-    qDeleteAll(pvs);
-    pvs.clear();
+    if (p) {
+        QString s = p->description;
+        if (s.length() > 200) {
+            s = s.left(200) + "...";
+        }
+        r.shortenDescription = s;
 
-    QString s = p->description;
-    if (s.length() > 200) {
-        s = s.left(200) + "...";
+        r.title = p->title;
+
+        // the error message is ignored
+        QString err;
+        QSharedPointer<License> lic(rep->findLicense_(
+                p->license, &err));
+        if (lic)
+            r.licenseTitle = lic->title;
+
+        r.icon = p->getIcon();
     }
-    r->shortenDescription = s;
 
-    r->title = p->title;
+    return r;
+}
+
+PackageItemModel::InfoBlock PackageItemModel::loadBlock(InfoBlock block)
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
 
-    // the error message is ignored
-    QSharedPointer<License> lic(rep->findLicense_(
-            p->license, &err));
-    if (lic)
-        r->licenseTitle = lic->title;
+    const QString connection = QStringLiteral("packageitemmodel");
 
-    r->icon = p->getIcon();
+    {
+        // a separate connection is necessary as the default one is used by
+        // the GUI thread. The newest database generation is opened each time.
+        DBRepository dbr;
+        QString err = dbr.openDefault(connection, true);
 
-    return r;
+        QList<Package*> ps;
+        QList<PackageVersion*> pvs;
+        if (err.isEmpty()) {
+            ps = dbr.findPackages(block.packages);
+            pvs = dbr.getPackageVersionSummaries(block.packages, &err);
+        }
+
+        // errors are ignored here. The rows are shown empty.
+
+        QHash<QString, Package*> byName;
+        for (int i = 0; i < ps.count(); i++) {
+            Package* p = ps.at(i);
+            byName.insert(p->name, p);
+        }
+
+        QHash<QString, QList<PackageVersion*> > versions;
+        for (int i = 0; i < pvs.count(); i++) {
+            PackageVersion* pv = pvs.at(i);
+            versions[pv->package].append(pv);
+        }
+
+        QSharedPointer<const InstalledPackagesSnapshot> installed =
+                InstalledPackages::getDefault()->getSnapshot();
+
+        for (int i = 0; i < block.packages.count(); i++) {
+            const QString& name = block.packages.at(i);
+            block.infos.append(createInfo(&dbr, installed.data(),
+                    byName.value(name), versions.value(name)));
+        }
+
+        qDeleteAll(pvs);
+        qDeleteAll(ps);
+    }
+
+    // the database file should not stay open so that an older generation
+    // can be deleted
+    QSqlDatabase::removeDatabase(connection);
+
+    return block;
+}
+
+void PackageItemModel::requestBlock(int row) const
+{
+    InfoBlock block;
+    block.id = this->nextBlockID++;
+    block.firstRow = row - row % BLOCK;
+    block.rowCount = qMin(BLOCK, this->packages.count() - block.firstRow);
+    for (int i = block.firstRow; i < block.firstRow + block.rowCount; i++) {
+        const QString& p = this->packages.at(i);
+        if (!this->cache.contains(p) && !this->loading.contains(p)) {
+            block.packages.append(p);
+            this->loading.insert(p, block.id);
+        }
+    }
+
+    if (!block.packages.isEmpty()) {
+        QFuture<InfoBlock> future = QtConcurrent::run(&this->threadPool,
+                &PackageItemModel::loadBlock, block);
+
+        // the method is const because it is called from data()
+        PackageItemModel* self = const_cast<PackageItemModel*>(this);
+        QFutureWatcher<InfoBlock>* w = new QFutureWatcher<InfoBlock>(self);
+        connect(w, SIGNAL(finished()), self, SLOT(watcherFinished()));
+        w->setFuture(future);
+    }
+}
+
+void PackageItemModel::watcherFinished()
+{
+    QFutureWatcher<InfoBlock>* w = static_cast<
+            QFutureWatcher<InfoBlock>*>(sender());
+    InfoBlock block = w->result();
+    w->deleteLater();
+
+    // the results for packages that were invalidated in the meantime are
+    // ignored. These rows are requested again by the view.
+    for (int i = 0; i < block.packages.count(); i++) {
+        const QString& p = block.packages.at(i);
+        if (this->loading.value(p, -1) == block.id) {
+            this->loading.remove(p);
+            this->cache.insert(p, new Info(block.infos.at(i)));
+        }
+    }
+
+    int last = qMin(block.firstRow + block.rowCount,
+            this->packages.count()) - 1;
+    if (block.firstRow <= last)
+        this->dataChanged(this->index(block.firstRow, 0),
+                this->index(last, columnCount(QModelIndex()) - 1));
 }
 
 QVariant PackageItemModel::data(const QModelIndex &index, int role) const
@@ -104,14 +217,14 @@ QVariant PackageItemModel::data(const QModelIndex &index, int role) const
     }
 
     QVariant r;
-    DBRepository* rep = DBRepository::getDefault();
+
+    // the information is loaded in the background and the row is shown
+    // empty until then
+    Info empty;
     Info* cached = this->cache.object(p);
-    bool insertIntoCache = false;
     if (!cached) {
-        Package* pk = rep->findPackage_(p);
-        cached = createInfo(pk);
-        delete pk;
-        insertIntoCache = true;
+        requestBlock(index.row());
+        cached = &empty;
     }
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
@@ -195,9 +308,6 @@ QVariant PackageItemModel::data(const QModelIndex &index, int role) const
         }
     }
 
-    if (insertIntoCache)
-        this->cache.insert(p, cached);
-
     return r;
 }
 
@@ -241,6 +351,8 @@ void PackageItemModel::setPackages(const QStringList& packages)
 {
     this->beginResetModel();
     this->packages = packages;
+    this->cache.clear();
+    this->loading.clear();
     this->endResetModel();
 }
 
@@ -262,6 +374,7 @@ void PackageItemModel::installedStatusChanged(const QString& package,
     //qDebug() << "PackageItemModel::installedStatusChanged" << package <<
     //        version.getVersionString();
     this->cache.remove(package);
+    this->loading.remove(package);
     for (int i = 0; i < this->packages.count(); i++) {
         QString p = this->packages.at(i);
         if (p == package) {
@@ -273,6 +386,7 @@ void PackageItemModel::installedStatusChanged(const QString& package,
 void PackageItemModel::clearCache()
 {
     this->cache.clear();
+    this->loading.clear();
     this->dataChanged(this->index(0, 3),
             this->index(this->packages.count() - 1, 4));
 }
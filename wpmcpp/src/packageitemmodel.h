@@ -6,15 +6,29 @@
 #include <QAbstractTableModel>
 #include <QCache>
 #include <QBrush>
+#include <QHash>
+#include <QThreadPool>
 
 #include "package.h"
+#include "packageversion.h"
 #include "version.h"
+#include "dbrepository.h"
+#include "installedpackagessnapshot.h"
 
 /**
- * @brief shows packages
+ * @brief shows packages.
+ *
+ * The information for the rows is loaded in blocks of rows on a background
+ * thread. Rows that are not yet loaded are shown empty until the
+ * information is available.
  */
 class PackageItemModel: public QAbstractTableModel
 {
+    Q_OBJECT
+
+    /** number of rows loaded together */
+    static const int BLOCK = 50;
+
     QBrush obsoleteBrush;
 
     QStringList packages;
@@ -29,11 +43,73 @@ class PackageItemModel: public QAbstractTableModel
         QString title;
         QString licenseTitle;
         QString icon;
+
+        Info(): up2date(true) {}
+    };
+
+    /**
+     * @brief information for a block of rows loaded on a background thread
+     */
+    class InfoBlock {
+    public:
+        /** unique ID of the request */
+        int id;
+
+        /** index of the first row */
+        int firstRow;
+
+        /** number of rows */
+        int rowCount;
+
+        /** full package names */
+        QStringList packages;
+
+        /** information for the packages in the same order */
+        QList<Info> infos;
     };
 
     mutable QCache<QString, Info> cache;
 
-    Info *createInfo(Package *p) const;
+    /**
+     * package name => ID of the block where the package is being loaded on
+     * the background thread. The results for a package are only stored in
+     * the cache if the ID still matches.
+     */
+    mutable QHash<QString, int> loading;
+
+    /** ID for the next requested block */
+    mutable int nextBlockID;
+
+    /** one thread loading the blocks of rows one after another */
+    mutable QThreadPool threadPool;
+
+    /**
+     * @brief computes the information for one package
+     * @param rep repository
+     * @param installed installed packages
+     * @param p the package or 0 if it does not exist anymore
+     * @param pvs versions of the package
+     * @return information for the package
+     */
+    static Info createInfo(DBRepository* rep,
+            const InstalledPackagesSnapshot* installed, Package *p,
+            const QList<PackageVersion*>& pvs);
+
+    /**
+     * @brief loads the information for packages from the default database.
+     *     This method is executed on a background thread.
+     * @param block the block of rows. The packages should be set.
+     * @return the same block with the loaded information
+     */
+    static InfoBlock loadBlock(InfoBlock block);
+
+    /**
+     * @brief starts loading the rows around the specified row if necessary
+     * @param row index of a row without cached information
+     */
+    void requestBlock(int row) const;
+private slots:
+    void watcherFinished();
 public:
     /**
      * @param packages list of package names
@@ -23,6 +23,7 @@
 #include <QTemporaryDir>
 #include <QJsonArray>
 #include <QBuffer>
+#include <QDataStream>
 
 #include <zlib.h>
 
@@ -40,9 +41,10 @@
 #include "installedpackages.h"
 #include "installedpackageversion.h"
 #include "dbrepository.h"
+#include "dependencyresolver.h"
 #include "repositoryxmlhandler.h"
 
-QSemaphore PackageVersion::httpConnections(3);
+QSemaphore PackageVersion::httpConnections(HTTP_CONNECTIONS);
 QSemaphore PackageVersion::installationScripts(1);
 QSet<QString> PackageVersion::lockedPackageVersions;
 QMutex PackageVersion::lockedPackageVersionsMutex(QMutex::Recursive);
@@ -684,112 +686,36 @@ void PackageVersion::removeDirectory(Job* job, const QString& dir,
 QString PackageVersion::planInstallation(InstalledPackages &installed,
         QList<InstallOperation*>& ops, QList<PackageVersion*>& avoid,
         const QString& where)
+{
+    DependencyResolver resolver(DBRepository::getDefault(), &installed);
+    return resolver.planInstallation(this, ops, avoid, where);
+}
+
+QString PackageVersion::planUninstallation(InstalledPackages &installed,
+        QList<InstallOperation*>& ops)
 {
     QString res;
 
-    avoid.append(this->clone());
+    if (!installed.isInstalled(this->package, this->version))
+        return res;
 
-    DBRepository* rep = DBRepository::getDefault();
+    // the reverse dependencies are only computed once for the whole plan
+    QList<InstalledPackageVersion*> all = installed.getAll();
+    QMultiHash<QString, InstalledPackageVersion*> dependents =
+            DBRepository::getDefault()->findInstalledDependents(all, &res);
+    qDeleteAll(all);
 
-    for (int i = 0; i < this->dependencies.count(); i++) {
-        Dependency* d = this->dependencies.at(i);
-        bool depok = installed.isInstalled(*d);
-        if (!depok) {
-            // we cannot just use Dependency->findBestMatchToInstall here as
-            // it is possible that the highest match cannot be installed because
-            // of unsatisfied dependencies. Example: the newest version depends
-            // on Windows Vista, but the current operating system is XP.
-
-            /* old code:
-            QString err;
-            QScopedPointer<PackageVersion> pv(d->findBestMatchToInstall(avoid,
-                    &err));
-            if (!err.isEmpty()) {
-                res = QString(QObject::tr("Error searching for the best dependency match: %1")).
-                           arg(err);
-                break;
-            }
+    if (res.isEmpty())
+        res = planUninstallation(installed, ops, dependents);
 
-            if (!pv) {
-                res = QString(QObject::tr("Unsatisfied dependency: %1")).
-                           arg(d->toString());
-                break;
-            } else {
-                res = pv->planInstallation(installed, ops, avoid);
-                if (!res.isEmpty())
-                    break;
-            }
-            */
-
-            QString err;
-            QList<PackageVersion*> pvs = rep->findAllMatchesToInstall(
-                    *d, avoid, &err);
-            if (!err.isEmpty()) {
-                res = QString(QObject::tr("Error searching for the dependency matches: %1")).
-                           arg(err);
-                qDeleteAll(pvs);
-                break;
-            }
-            if (pvs.count() == 0) {
-                res = QString(QObject::tr("Unsatisfied dependency: %1")).
-                           arg(rep->toString(*d));
-                break;
-            } else {
-                bool found = false;
-                for (int j = 0; j < pvs.count(); j++) {
-                    PackageVersion* pv = pvs.at(j);
-                    InstalledPackages installed2(installed);
-                    int opsCount = ops.count();
-                    int avoidCount = avoid.count();
-
-                    res = pv->planInstallation(installed2, ops, avoid);
-                    if (!res.isEmpty()) {
-                        // rollback
-                        while (ops.count() > opsCount) {
-                            delete ops.takeLast();
-                        }
-                        while (avoid.count() > avoidCount) {
-                            delete avoid.takeLast();
-                        }
-                    } else {
-                        found = true;
-                        installed = installed2;
-                        break;
-                    }
-                }
-                if (!found) {
-                    res = QString(QObject::tr("Unsatisfied dependency: %1")).
-                               arg(rep->toString(*d));
-                }
-            }
-            qDeleteAll(pvs);
-        }
-    }
-
-    if (res.isEmpty()) {
-        if (!installed.isInstalled(this->package, this->version)) {
-            InstallOperation* io = new InstallOperation();
-            io->install = true;
-            io->package = this->package;
-            io->version = this->version;
-            io->where = where;
-            ops.append(io);
-
-            QString where2 = where;
-            if (where2.isEmpty()) {
-                where2 = this->getIdealInstallationDirectory();
-                where2 = WPMUtils::findNonExistingFile(where2, "");
-            }
-            installed.setPackageVersionPath(this->package, this->version,
-                    where2, false);
-        }
-    }
+    qDeleteAll(dependents);
 
     return res;
 }
 
 QString PackageVersion::planUninstallation(InstalledPackages &installed,
-        QList<InstallOperation*>& ops)
+        QList<InstallOperation*>& ops,
+        const QMultiHash<QString, InstalledPackageVersion*>& dependents)
 {
     // qDebug() << "PackageVersion::planUninstallation()" << this->toString();
     QString res;
@@ -802,23 +728,35 @@ QString PackageVersion::planUninstallation(InstalledPackages &installed,
 
     DBRepository* dbr = DBRepository::getDefault();
 
-    // this loop ensures that all the items in "installed" are processed
-    // even if changes in the list were done in nested calls to
-    // "planUninstallation"
-    while (true) {
-        QScopedPointer<InstalledPackageVersion> ipv(installed.
-                findFirstWithMissingDependency());
-        if (ipv.data()) {
-            QScopedPointer<PackageVersion> pv(dbr->findPackageVersion_(
-                    ipv.data()->package, ipv.data()->version, &res));
-            if (!res.isEmpty())
+    // only the package versions depending on this package can have missing
+    // dependencies now. The ones already removed in nested calls to
+    // "planUninstallation" are not installed anymore and are skipped.
+    QList<InstalledPackageVersion*> ds = dependents.values(this->package);
+    for (int i = 0; i < ds.count(); i++) {
+        InstalledPackageVersion* ipv = ds.at(i);
+        if (!installed.isInstalled(ipv->package, ipv->version))
+            continue;
+
+        QScopedPointer<PackageVersion> pv(dbr->findPackageVersion_(
+                ipv->package, ipv->version, &res));
+        if (!res.isEmpty())
+            break;
+
+        if (!pv.data())
+            continue;
+
+        bool missing = false;
+        for (int j = 0; j < pv->dependencies.size(); j++) {
+            if (!installed.isInstalled(*pv->dependencies.at(j))) {
+                missing = true;
                 break;
+            }
+        }
 
-            res = pv->planUninstallation(installed, ops);
+        if (missing) {
+            res = pv->planUninstallation(installed, ops, dependents);
             if (!res.isEmpty())
                 break;
-        } else {
-            break;
         }
     }
 
@@ -924,21 +862,18 @@ QString PackageVersion::downloadAndComputeSHA1(Job* job)
 
     QString r;
 
-    Job* djob = job->newSubJob(0.95, QObject::tr("Downloading"));
+    // the hash sum is computed during the download. The data is not stored.
+    Job* djob = job->newSubJob(1,
+            QObject::tr("Downloading & computing hash sum"));
     Downloader::Request request(this->download);
-    QTemporaryFile* f = Downloader::downloadToTemporary(djob, request);
+    request.hashSum = true;
+    request.alg = QCryptographicHash::Sha1;
+    Downloader::Response response = Downloader::download(djob, request);
     if (!djob->getErrorMessage().isEmpty())
         job->setErrorMessage(QString(QObject::tr("Download failed: %1")).
                 arg(djob->getErrorMessage()));
-
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.05, QObject::tr("Computing SHA1"));
-        r = WPMUtils::sha1(f->fileName());
-        sub->completeWithProgress();
-    }
-
-    if (f)
-        delete f;
+    else if (job->shouldProceed())
+        r = response.hashSum;
 
     job->complete();
 
@@ -1345,7 +1280,7 @@ bool PackageVersion::createShortcuts(const QString& dir, QString *errMsg)
     return errMsg->isEmpty();
 }
 
-QString PackageVersion::getIdealInstallationDirectory()
+QString PackageVersion::getIdealInstallationDirectory() const
 {
     return WPMUtils::normalizePath(
             WPMUtils::getInstallationDirectory() + "\\" +
@@ -1980,13 +1915,9 @@ PackageVersion *PackageVersion::parse(const QByteArray &xml, QString *err, bool
 
     Repository rep;
     RepositoryXMLHandler handler(&rep, QUrl());
-    QXmlSimpleReader reader;
-    reader.setContentHandler(&handler);
-    reader.setErrorHandler(&handler);
-    QXmlInputSource inputSource;
-    inputSource.setData(xml);
-    handler.enter("root");
-    if (!reader.parse(inputSource))
+    QXmlStreamReader reader(xml);
+    handler.enter();
+    if (!handler.parse(&reader))
         *err = handler.errorString();
     else {
         if (rep.packageVersions.size() == 1) {
@@ -1999,6 +1930,87 @@ PackageVersion *PackageVersion::parse(const QByteArray &xml, QString *err, bool
     return r;
 }
 
+PackageVersion *PackageVersion::fromBinary(const QByteArray &data,
+        QString *err)
+{
+    *err = "";
+
+    QDataStream s(data);
+    s.setVersion(QDataStream::Qt_5_0);
+
+    quint8 format = 0;
+    s >> format;
+    if (format != BINARY_FORMAT_VERSION) {
+        *err = QObject::tr("Unsupported binary format version for a package version: %1").
+                arg(static_cast<int>(format));
+        return 0;
+    }
+
+    QString package, version, sha1, download, msiGUID;
+    quint8 type = 0, hashSumType = 0;
+    s >> package >> version >> type >> hashSumType >> sha1 >> download >>
+            msiGUID;
+
+    Version v;
+    if (s.status() == QDataStream::Ok && !v.setVersion(version))
+        *err = QObject::tr("Not a valid version for %1: %2").
+                arg(package).arg(version);
+
+    PackageVersion* r = new PackageVersion(package, v);
+    r->type = type;
+    r->hashSumType = hashSumType == 0 ? QCryptographicHash::Sha1 :
+            QCryptographicHash::Sha256;
+    r->sha1 = sha1;
+    if (!download.isEmpty())
+        r->download = QUrl(download);
+    r->msiGUID = msiGUID;
+
+    s >> r->importantFiles >> r->importantFilesTitles >> r->cmdFiles;
+
+    quint32 n = 0;
+    s >> n;
+    for (quint32 i = 0; i < n && s.status() == QDataStream::Ok; i++) {
+        QString path, content;
+        s >> path >> content;
+        r->files.append(new PackageVersionFile(path, content));
+    }
+
+    n = 0;
+    s >> n;
+    for (quint32 i = 0; i < n && s.status() == QDataStream::Ok; i++) {
+        Dependency* d = new Dependency();
+        r->dependencies.append(d);
+        QString min, max;
+        quint8 minIncluded = 0, maxIncluded = 0;
+        s >> d->package >> minIncluded >> min >> maxIncluded >> max >>
+                d->var;
+        d->minIncluded = minIncluded != 0;
+        d->maxIncluded = maxIncluded != 0;
+        d->min.setVersion(min);
+        d->max.setVersion(max);
+    }
+
+    n = 0;
+    s >> n;
+    for (quint32 i = 0; i < n && s.status() == QDataStream::Ok; i++) {
+        DetectFile* df = new DetectFile();
+        r->detectFiles.append(df);
+        s >> df->path >> df->sha1;
+    }
+
+    if (err->isEmpty() && (s.status() != QDataStream::Ok ||
+            r->importantFiles.count() != r->importantFilesTitles.count()))
+        *err = QObject::tr("Invalid binary data for the package version %1").
+                arg(package);
+
+    if (!err->isEmpty()) {
+        delete r;
+        r = 0;
+    }
+
+    return r;
+}
+
 bool PackageVersion::contains(const QList<PackageVersion *> &list,
         PackageVersion *pv)
 {
@@ -2063,6 +2075,47 @@ void PackageVersion::toXML(QXmlStreamWriter *w) const
     w->writeEndElement();
 }
 
+void PackageVersion::toBinary(QByteArray *data) const
+{
+    QDataStream s(data, QIODevice::WriteOnly | QIODevice::Append);
+    s.setVersion(QDataStream::Qt_5_0);
+
+    s << BINARY_FORMAT_VERSION;
+    s << this->package << this->version.getVersionString() <<
+            static_cast<quint8>(this->type) <<
+            static_cast<quint8>(
+            this->hashSumType == QCryptographicHash::Sha1 ? 0 : 1) <<
+            this->sha1;
+    if (this->download.isValid())
+        s << this->download.toString(QUrl::FullyEncoded);
+    else
+        s << QString();
+    s << this->msiGUID;
+
+    s << this->importantFiles << this->importantFilesTitles << this->cmdFiles;
+
+    s << static_cast<quint32>(this->files.count());
+    for (int i = 0; i < this->files.count(); i++) {
+        PackageVersionFile* f = this->files.at(i);
+        s << f->path << f->content;
+    }
+
+    s << static_cast<quint32>(this->dependencies.count());
+    for (int i = 0; i < this->dependencies.count(); i++) {
+        Dependency* d = this->dependencies.at(i);
+        s << d->package << static_cast<quint8>(d->minIncluded ? 1 : 0) <<
+                d->min.getVersionString() <<
+                static_cast<quint8>(d->maxIncluded ? 1 : 0) <<
+                d->max.getVersionString() << d->var;
+    }
+
+    s << static_cast<quint32>(this->detectFiles.count());
+    for (int i = 0; i < this->detectFiles.count(); i++) {
+        DetectFile* df = this->detectFiles.at(i);
+        s << df->path << df->sha1;
+    }
+}
+
 void PackageVersion::toJSON(QJsonObject& w) const
 {
     w["name"] = this->version.getVersionString();
@@ -12,6 +12,7 @@
 #include <QXmlStreamWriter>
 #include <QCryptographicHash>
 #include <QJsonObject>
+#include <QMultiHash>
 
 #include "job.h"
 #include "packageversionfile.h"
@@ -26,6 +27,7 @@ DEFINE_GUID(UUID_ClientID,0x30ed381dL,0x59ea,0x4ca5,0xbd,0x1d,0x5e,0xe8,0xec,0x9
 
 class InstallOperation;
 class InstalledPackages;
+class InstalledPackageVersion;
 
 /**
  * One version of a package (installed or not).
@@ -35,6 +37,9 @@ class InstalledPackages;
  * - update toXML
  * - update toJSON
  * - update clone
+ * - update toBinary and fromBinary. Increment BINARY_FORMAT_VERSION.
+ * - update the PACKAGE_VERSION table or the tables for the details in
+ *     DBRepository
  */
 class PackageVersion
 {
@@ -112,7 +117,24 @@ private:
     bool createExecutableShims(const QString &dir, QString *errMsg);
 
     void installWith(Job *job);
+
+    /**
+     * Plans un-installation of this package and all the dependent recursively.
+     *
+     * @param installed list of installed packages
+     * @param op necessary operations will be added here
+     * @param dependents full package name => installed package versions that
+     *     depend on this package. See
+     *     DBRepository::findInstalledDependents()
+     * @return error message or ""
+     */
+    QString planUninstallation(InstalledPackages& installed,
+            QList<InstallOperation*>& ops,
+            const QMultiHash<QString, InstalledPackageVersion*>& dependents);
 public:
+    /** maximum number of parallel HTTP connections for downloads */
+    static const int HTTP_CONNECTIONS = 3;
+
     /**
      * @brief string ID for the specified package version
      * @param package full package name
@@ -145,6 +167,19 @@ public:
     static PackageVersion* parse(const QByteArray& xml, QString* err,
             bool validate=true);
 
+    /**
+     * @brief version of the format created by toBinary(). This is always
+     *     the first byte of the data.
+     */
+    static const quint8 BINARY_FORMAT_VERSION = 1;
+
+    /**
+     * @param data data created by toBinary()
+     * @param err error message will be stored here
+     * @return [ownership:caller] created object or 0
+     */
+    static PackageVersion* fromBinary(const QByteArray& data, QString* err);
+
     /**
      * @brief searches for a package version only using the package name and
      *     version number
@@ -379,7 +414,7 @@ public:
      * @return a maybe existing directory where this package would normally
      *     installed (e.g. C:\Program Files\My_Prog)
      */
-    QString getIdealInstallationDirectory();
+    QString getIdealInstallationDirectory() const;
 
     /**
      * @return a maybe existing directory where this package would normally
@@ -439,6 +474,15 @@ public:
      */
     void toXML(QXmlStreamWriter* w) const;
 
+    /**
+     * Stores this object in a compact binary format. The first byte is
+     * BINARY_FORMAT_VERSION followed by length-prefixed values.
+     * This is much faster to decode than toXML().
+     *
+     * @param data output. The data will be appended.
+     */
+    void toBinary(QByteArray* data) const;
+
     /**
      * Stores this object as JSON
      *
@@ -2,6 +2,7 @@
 
 #include <QList>
 #include <QTreeWidgetItem>
+#include <QTreeWidgetItemIterator>
 #include <QStringList>
 #include <QString>
 #include <QProgressBar>
@@ -53,7 +54,14 @@ ProgressTree2::ProgressTree2(QWidget *parent) :
 
 void ProgressTree2::timerTimeout()
 {
-
+    // the changes are reported by the jobs at a limited rate and not for
+    // every job => all items are updated here
+    QTreeWidgetItemIterator it(this);
+    while (*it) {
+        QTreeWidgetItem* item = *it;
+        updateItem(item, getJob(*item));
+        ++it;
+    }
 }
 
 QTreeWidgetItem* ProgressTree2::findItem(Job* job, bool create)
@@ -188,6 +196,15 @@ void ProgressTree2::monitoredJobChanged(Job* state)
     if (item)
         updateItem(item, state);
 
+    // the progress of the parent jobs is not always reported separately
+    Job* parent = state->parentJob;
+    while (parent) {
+        QTreeWidgetItem* parentItem = findItem(parent);
+        if (parentItem)
+            updateItem(parentItem, parent);
+        parent = parent->parentJob;
+    }
+
     if (state->isCompleted()) {
         if (item) {
             setItemWidget(item, 4, 0);
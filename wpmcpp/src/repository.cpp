@@ -4,8 +4,6 @@
 
 #include <QTemporaryFile>
 #include <QDebug>
-#include <QXmlSimpleReader>
-#include <QXmlInputSource>
 
 #include "downloader.h"
 #include "repository.h"
@@ -265,7 +263,7 @@ QString Repository::savePackage(Package *p, bool replace)
         }
         fp->title = p->title;
         fp->url = p->url;
-        fp->setIcon(p->getIcon());
+        fp->links = p->links;
         fp->description = p->description;
         fp->license = p->license;
         fp->categories = p->categories;
@@ -0,0 +1,160 @@
+#include "repositoryqueue.h"
+
+#include <QMutexLocker>
+
+RepositoryQueue::RepositoryQueue(int capacity): AbstractRepository(),
+        capacity(capacity), closed(false)
+{
+}
+
+RepositoryQueue::~RepositoryQueue()
+{
+    deleteEntries(entries);
+}
+
+void RepositoryQueue::deleteEntries(const QList<Entry>& entries)
+{
+    for (int i = 0; i < entries.count(); i++) {
+        const Entry& e = entries.at(i);
+        delete e.p;
+        delete e.pv;
+        delete e.lic;
+    }
+}
+
+QString RepositoryQueue::put(const Entry& e)
+{
+    QMutexLocker locker(&mutex);
+
+    while (error.isEmpty() && entries.count() >= capacity)
+        notFull.wait(&mutex);
+
+    QString err = error;
+    if (err.isEmpty()) {
+        entries.append(e);
+        notEmpty.wakeAll();
+    } else {
+        deleteEntries(QList<Entry>() << e);
+    }
+
+    return err;
+}
+
+void RepositoryQueue::close()
+{
+    QMutexLocker locker(&mutex);
+    closed = true;
+    notEmpty.wakeAll();
+}
+
+void RepositoryQueue::abort(const QString& error)
+{
+    QMutexLocker locker(&mutex);
+    if (this->error.isEmpty())
+        this->error = error;
+    closed = true;
+    notEmpty.wakeAll();
+    notFull.wakeAll();
+}
+
+QString RepositoryQueue::writeTo(AbstractRepository* to)
+{
+    QString err;
+
+    while (true) {
+        mutex.lock();
+        while (entries.isEmpty() && !closed)
+            notEmpty.wait(&mutex);
+        QList<Entry> batch = entries;
+        entries.clear();
+        bool aborted = !error.isEmpty();
+        notFull.wakeAll();
+        mutex.unlock();
+
+        if (batch.isEmpty())
+            break;
+
+        for (int i = 0; i < batch.count(); i++) {
+            if (!err.isEmpty() || aborted)
+                break;
+
+            const Entry& e = batch.at(i);
+            if (e.p)
+                err = to->savePackage(e.p, e.replace);
+            else if (e.pv)
+                err = to->savePackageVersion(e.pv, e.replace);
+            else
+                err = to->saveLicense(e.lic, e.replace);
+        }
+        deleteEntries(batch);
+
+        if (!err.isEmpty())
+            abort(err);
+    }
+
+    return err;
+}
+
+QString RepositoryQueue::saveLicense(License* p, bool replace)
+{
+    Entry e = {0, 0, p->clone(), replace};
+    return put(e);
+}
+
+QString RepositoryQueue::savePackageVersion(PackageVersion* p, bool replace)
+{
+    Entry e = {0, p->clone(), 0, replace};
+    return put(e);
+}
+
+QString RepositoryQueue::savePackage(Package* p, bool replace)
+{
+    Entry e = {p->clone(), 0, 0, replace};
+    return put(e);
+}
+
+QList<Package*> RepositoryQueue::findPackagesByShortName(const QString& name)
+{
+    return QList<Package*>();
+}
+
+Package* RepositoryQueue::findPackage_(const QString& name)
+{
+    return 0;
+}
+
+QList<PackageVersion*> RepositoryQueue::getPackageVersions_(
+        const QString& package, QString* err) const
+{
+    *err = "";
+    return QList<PackageVersion*>();
+}
+
+PackageVersion* RepositoryQueue::findPackageVersionByMSIGUID_(
+        const QString& guid, QString* err) const
+{
+    *err = "";
+    return 0;
+}
+
+PackageVersion* RepositoryQueue::findPackageVersion_(const QString& package,
+        const Version& version, QString* err) const
+{
+    *err = "";
+    return 0;
+}
+
+License* RepositoryQueue::findLicense_(const QString& name, QString* err)
+{
+    *err = "";
+    return 0;
+}
+
+QString RepositoryQueue::clear()
+{
+    QMutexLocker locker(&mutex);
+    deleteEntries(entries);
+    entries.clear();
+    notFull.wakeAll();
+    return "";
+}
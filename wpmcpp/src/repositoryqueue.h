@@ -0,0 +1,124 @@
+#ifndef REPOSITORYQUEUE_H
+#define REPOSITORYQUEUE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QString>
+
+#include "abstractrepository.h"
+#include "package.h"
+#include "packageversion.h"
+#include "license.h"
+
+/**
+ * @brief bounded queue between a thread that parses a repository and a
+ *     thread that writes the data to a database. The parser saves packages,
+ *     package versions and licenses here as in any other repository and
+ *     waits while the queue is full. The writer moves the objects in the same
+ *     order to the target repository.
+ */
+class RepositoryQueue: public AbstractRepository
+{
+    /** a saved object. Exactly one of the pointers is not 0. */
+    struct Entry {
+        Package* p;
+        PackageVersion* pv;
+        License* lic;
+        bool replace;
+    };
+
+    int capacity;
+
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+
+    QList<Entry> entries;
+    bool closed;
+    QString error;
+
+    QString put(const Entry& e);
+    static void deleteEntries(const QList<Entry>& entries);
+public:
+    /**
+     * @param capacity maximum number of objects in the queue. The parser is
+     *     blocked if the queue is full.
+     */
+    RepositoryQueue(int capacity=1000);
+
+    virtual ~RepositoryQueue();
+
+    /**
+     * @brief marks the end of the data. This method should be called by the
+     *     parser after the last object was saved.
+     */
+    void close();
+
+    /**
+     * @brief stops the processing. All following and currently blocked calls
+     *     to savePackage() etc. return the error. The objects that are still
+     *     in the queue will not be written.
+     * @param error error message
+     */
+    void abort(const QString& error);
+
+    /**
+     * @brief moves the objects from the queue to another repository. All
+     *     objects available at once are written as one batch. This method
+     *     returns after close() or abort() was called.
+     * @param to target repository. This method should be called from the
+     *     thread that owns this repository.
+     * @return error message from the target repository. The queue is aborted
+     *     with the same message in this case.
+     */
+    QString writeTo(AbstractRepository* to);
+
+    QString saveLicense(License* p, bool replace);
+
+    QString savePackageVersion(PackageVersion *p, bool replace);
+
+    QString savePackage(Package *p, bool replace);
+
+    /**
+     * @return always an empty list. The objects in the queue cannot be
+     *     searched.
+     */
+    QList<Package*> findPackagesByShortName(const QString& name);
+
+    /**
+     * @return always 0
+     */
+    Package* findPackage_(const QString& name);
+
+    /**
+     * @return always an empty list
+     */
+    QList<PackageVersion*> getPackageVersions_(
+            const QString& package, QString* err) const;
+
+    /**
+     * @return always 0
+     */
+    PackageVersion* findPackageVersionByMSIGUID_(
+            const QString& guid, QString* err) const;
+
+    /**
+     * @return always 0
+     */
+    PackageVersion* findPackageVersion_(const QString& package,
+            const Version& version, QString* err) const;
+
+    /**
+     * @return always 0
+     */
+    License* findLicense_(const QString& name, QString* err);
+
+    /**
+     * @brief removes all objects that are currently in the queue
+     * @return error message
+     */
+    QString clear();
+};
+
+#endif // REPOSITORYQUEUE_H
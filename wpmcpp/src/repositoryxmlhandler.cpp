@@ -7,83 +7,73 @@
 #include "wpmutils.h"
 #include "packageversionfile.h"
 
-int RepositoryXMLHandler::findWhere()
+int RepositoryXMLHandler::findWhere(const QStringRef& name) const
 {
     int r = -1;
-    QString tag1, tag2, tag3;
-    switch (tags.count()) {
-        case 2:
-            tag1 = tags.at(1);
-            if (tag1 == QStringLiteral("version"))
+    switch (tags.last()) {
+        case TAG_ROOT:
+            if (name == QLatin1String("version"))
                 r = TAG_VERSION;
-            else if (tag1 == QStringLiteral("package"))
+            else if (name == QLatin1String("package"))
                 r = TAG_PACKAGE;
-            else if (tag1 == QStringLiteral("license"))
+            else if (name == QLatin1String("license"))
                 r = TAG_LICENSE;
-            else if (tag1 == QStringLiteral("spec-version"))
+            else if (name == QLatin1String("spec-version"))
                 r = TAG_SPEC_VERSION;
             break;
-        case 3:
-            tag1 = tags.at(1);
-            tag2 = tags.at(2);
-            if (tag1 == QStringLiteral("version")) {
-                if (tag2 == QStringLiteral("important-file"))
-                    r = TAG_VERSION_IMPORTANT_FILE;
-                else if (tag2 == QStringLiteral("cmd-file"))
-                    r = TAG_VERSION_CMD_FILE;
-                else if (tag2 == QStringLiteral("file"))
-                    r = TAG_VERSION_FILE;
-                else if (tag2 == QStringLiteral("dependency"))
-                    r = TAG_VERSION_DEPENDENCY;
-                else if (tag2 == QStringLiteral("detect-file"))
-                    r = TAG_VERSION_DETECT_FILE;
-                else if (tag2 == QStringLiteral("url"))
-                    r = TAG_VERSION_URL;
-                else if (tag2 == QStringLiteral("sha1"))
-                    r = TAG_VERSION_SHA1;
-                else if (tag2 == QStringLiteral("hash-sum"))
-                    r = TAG_VERSION_HASH_SUM;
-                else if (tag2 == QStringLiteral("detect-msi"))
-                    r = TAG_VERSION_DETECT_MSI;
-            } else if (tag1 == QStringLiteral("package")) {
-                if (tag2 == QStringLiteral("title"))
-                    r = TAG_PACKAGE_TITLE;
-                else if (tag2 == QStringLiteral("url"))
-                    r = TAG_PACKAGE_URL;
-                else if (tag2 == QStringLiteral("description"))
-                    r = TAG_PACKAGE_DESCRIPTION;
-                else if (tag2 == QStringLiteral("icon"))
-                    r = TAG_PACKAGE_ICON;
-                else if (tag2 == QStringLiteral("license"))
-                    r = TAG_PACKAGE_LICENSE;
-                else if (tag2 == QStringLiteral("category"))
-                    r = TAG_PACKAGE_CATEGORY;
-                else if (tag2 == QStringLiteral("link"))
-                    r = TAG_PACKAGE_LINK;
-            } else if (tag1 == QStringLiteral("license")) {
-                if (tag2 == QStringLiteral("title"))
-                    r = TAG_LICENSE_TITLE;
-                else if (tag2 == QStringLiteral("url"))
-                    r = TAG_LICENSE_URL;
-                else if (tag2 == QStringLiteral("description"))
-                    r = TAG_LICENSE_DESCRIPTION;
-            }
+        case TAG_VERSION:
+            if (name == QLatin1String("important-file"))
+                r = TAG_VERSION_IMPORTANT_FILE;
+            else if (name == QLatin1String("cmd-file"))
+                r = TAG_VERSION_CMD_FILE;
+            else if (name == QLatin1String("file"))
+                r = TAG_VERSION_FILE;
+            else if (name == QLatin1String("dependency"))
+                r = TAG_VERSION_DEPENDENCY;
+            else if (name == QLatin1String("detect-file"))
+                r = TAG_VERSION_DETECT_FILE;
+            else if (name == QLatin1String("url"))
+                r = TAG_VERSION_URL;
+            else if (name == QLatin1String("sha1"))
+                r = TAG_VERSION_SHA1;
+            else if (name == QLatin1String("hash-sum"))
+                r = TAG_VERSION_HASH_SUM;
+            else if (name == QLatin1String("detect-msi"))
+                r = TAG_VERSION_DETECT_MSI;
             break;
-        case 4:
-            tag1 = tags.at(1);
-            tag2 = tags.at(2);
-            tag3 = tags.at(3);
-            if (tag1 == QStringLiteral("version")) {
-                if (tag2 == QStringLiteral("dependency")) {
-                    if (tag3 == QStringLiteral("variable"))
-                        r = TAG_VERSION_DEPENDENCY_VARIABLE;
-                } else if (tag2 == QStringLiteral("detect-file")) {
-                    if (tag3 == QStringLiteral("path"))
-                        r = TAG_VERSION_DETECT_FILE_PATH;
-                    else if (tag3 == QStringLiteral("sha1"))
-                        r = TAG_VERSION_DETECT_FILE_SHA1;
-                }
-            }
+        case TAG_PACKAGE:
+            if (name == QLatin1String("title"))
+                r = TAG_PACKAGE_TITLE;
+            else if (name == QLatin1String("url"))
+                r = TAG_PACKAGE_URL;
+            else if (name == QLatin1String("description"))
+                r = TAG_PACKAGE_DESCRIPTION;
+            else if (name == QLatin1String("icon"))
+                r = TAG_PACKAGE_ICON;
+            else if (name == QLatin1String("license"))
+                r = TAG_PACKAGE_LICENSE;
+            else if (name == QLatin1String("category"))
+                r = TAG_PACKAGE_CATEGORY;
+            else if (name == QLatin1String("link"))
+                r = TAG_PACKAGE_LINK;
+            break;
+        case TAG_LICENSE:
+            if (name == QLatin1String("title"))
+                r = TAG_LICENSE_TITLE;
+            else if (name == QLatin1String("url"))
+                r = TAG_LICENSE_URL;
+            else if (name == QLatin1String("description"))
+                r = TAG_LICENSE_DESCRIPTION;
+            break;
+        case TAG_VERSION_DEPENDENCY:
+            if (name == QLatin1String("variable"))
+                r = TAG_VERSION_DEPENDENCY_VARIABLE;
+            break;
+        case TAG_VERSION_DETECT_FILE:
+            if (name == QLatin1String("path"))
+                r = TAG_VERSION_DETECT_FILE_PATH;
+            else if (name == QLatin1String("sha1"))
+                r = TAG_VERSION_DETECT_FILE_SHA1;
             break;
     }
     return r;
@@ -102,27 +92,56 @@ RepositoryXMLHandler::~RepositoryXMLHandler()
     delete lic;
 }
 
-void RepositoryXMLHandler::enter(const QString &qName)
+void RepositoryXMLHandler::enter()
 {
-    tags.append(qName);
+    tags.append(TAG_ROOT);
 }
 
-bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
-    const QString &localName,
-    const QString &qName,
-    const QXmlAttributes &atts)
+bool RepositoryXMLHandler::parse(QXmlStreamReader* reader)
+{
+    while (error.isEmpty() && !reader->atEnd()) {
+        switch (reader->readNext()) {
+            case QXmlStreamReader::StartElement:
+                startElement(reader->name(), reader->attributes());
+                break;
+            case QXmlStreamReader::EndElement:
+                endElement();
+                break;
+            case QXmlStreamReader::Characters:
+                chars.append(reader->text());
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (error.isEmpty() && reader->hasError())
+        error = reader->errorString();
+
+    if (!error.isEmpty())
+        error = QObject::tr("XML parsing error at line %1, column %2: %3").
+                arg(reader->lineNumber()).arg(reader->columnNumber()).
+                arg(error);
+
+    return error.isEmpty();
+}
+
+void RepositoryXMLHandler::startElement(const QStringRef& name,
+        const QXmlStreamAttributes& atts)
 {
     chars.clear();
+
+    int where;
     if (tags.count() == 0)
-        tags.append(QStringLiteral("root"));
+        where = TAG_ROOT;
     else
-        tags.append(localName);
-
-    int where = findWhere();
+        where = findWhere(name);
+    tags.append(where);
 
     if (where == TAG_VERSION) {
         pv = new PackageVersion();
-        QString packageName = atts.value(QStringLiteral("package"));
+        QString packageName = atts.value(QLatin1String("package")).
+                toString();
         error = WPMUtils::validateFullPackageName(packageName);
         if (!error.isEmpty()) {
             error = QObject::tr("Error in the attribute 'package' in <version>: %1").
@@ -132,7 +151,7 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
         }
 
         if (error.isEmpty()) {
-            QString name = atts.value(QStringLiteral("name"));
+            QString name = atts.value(QLatin1String("name")).toString();
             if (name.isEmpty())
                 name = QStringLiteral("1.0");
 
@@ -145,22 +164,20 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
         }
 
         if (error.isEmpty()) {
-            QString type = atts.value(QStringLiteral("type"));
-            if (type.isEmpty())
-                type = QStringLiteral("zip");
-            if (type == QStringLiteral("one-file"))
+            QStringRef type = atts.value(QLatin1String("type"));
+            if (type == QLatin1String("one-file"))
                 pv->type = 1;
-            else if (type.isEmpty() || type == QStringLiteral("zip"))
+            else if (type.isEmpty() || type == QLatin1String("zip"))
                 pv->type = 0;
             else {
                 error = QObject::tr("Wrong value for the attribute 'type' for %1: %3").
-                        arg(pv->toString()).arg(type);
+                        arg(pv->toString()).arg(type.toString());
             }
         }
     } else if (where == TAG_VERSION_IMPORTANT_FILE) {
-        QString p = atts.value(QStringLiteral("path"));
+        QString p = atts.value(QLatin1String("path")).toString();
         if (p.isEmpty())
-            p = atts.value(QStringLiteral("name"));
+            p = atts.value(QLatin1String("name")).toString();
 
         if (p.isEmpty()) {
             error = QObject::tr("Empty 'path' attribute value for <important-file> for %1").
@@ -178,7 +195,7 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
             pv->importantFiles.append(p);
         }
 
-        QString title = atts.value(QStringLiteral("title"));
+        QString title = atts.value(QLatin1String("title")).toString();
         if (error.isEmpty()) {
             if (title.isEmpty()) {
                 error = QObject::tr("Empty 'title' attribute value for <important-file> for %1").
@@ -190,7 +207,7 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
             pv->importantFilesTitles.append(title);
         }
     } else if (where == TAG_VERSION_CMD_FILE) {
-        QString p = atts.value(QStringLiteral("path"));
+        QString p = atts.value(QLatin1String("path")).toString();
 
         if (p.isEmpty()) {
             error = QObject::tr("Empty 'path' attribute value for <cmd-file> for %1").
@@ -210,21 +227,21 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
             //        p << "??";
         }
     } else if (where == TAG_VERSION_FILE) {
-        QString path = atts.value(QStringLiteral("path"));
+        QString path = atts.value(QLatin1String("path")).toString();
         pvf = new PackageVersionFile(path, QStringLiteral(""));
         pv->files.append(pvf);
     } else if (where == TAG_VERSION_HASH_SUM) {
-        QString type = atts.value(QStringLiteral("type")).trimmed();
-        if (type.isEmpty() || type == QStringLiteral("SHA-256"))
+        QString type = atts.value(QLatin1String("type")).toString().trimmed();
+        if (type.isEmpty() || type == QLatin1String("SHA-256"))
             pv->hashSumType = QCryptographicHash::Sha256;
-        else if (type == QStringLiteral("SHA-1"))
+        else if (type == QLatin1String("SHA-1"))
             pv->hashSumType = QCryptographicHash::Sha1;
         else
             error = QObject::tr("Error in attribute 'type' in <hash-sum> in %1").
                     arg(pv->toString());
     } else if (where == TAG_VERSION_DEPENDENCY) {
-        QString package = atts.value(QStringLiteral("package"));
-        QString versions = atts.value(QStringLiteral("versions"));
+        QString package = atts.value(QLatin1String("package")).toString();
+        QString versions = atts.value(QLatin1String("versions")).toString();
         dep = new Dependency();
         pv->dependencies.append(dep);
         dep->package = package;
@@ -236,7 +253,7 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
         df = new DetectFile();
         pv->detectFiles.append(df);
     } else if (where == TAG_PACKAGE) {
-        QString name = atts.value(QStringLiteral("name"));
+        QString name = atts.value(QLatin1String("name")).toString();
         p = new Package(name, name);
 
         error = WPMUtils::validateFullPackageName(name);
@@ -244,8 +261,8 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
             error.prepend(QObject::tr("Error in attribute 'name' in <package>: "));
         }
     } else if (where == TAG_PACKAGE_LINK) {
-        QString rel = atts.value(QStringLiteral("rel")).trimmed();
-        QString href = atts.value(QStringLiteral("href")).trimmed();
+        QString rel = atts.value(QLatin1String("rel")).toString().trimmed();
+        QString href = atts.value(QLatin1String("href")).toString().trimmed();
 
         if (rel.isEmpty()) {
             error = QObject::tr("Empty 'rel' attribute value for <link> for %1").
@@ -259,7 +276,7 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
         if (error.isEmpty())
             p->links.insert(rel, href);
     } else if (where == TAG_LICENSE) {
-        QString name = atts.value(QStringLiteral("name"));
+        QString name = atts.value(QLatin1String("name")).toString();
         lic = new License(name, name);
 
         error = WPMUtils::validateFullPackageName(name);
@@ -267,14 +284,11 @@ bool RepositoryXMLHandler::startElement(const QString &namespaceURI,
             error.prepend(QObject::tr("Error in attribute 'name' in <package>: "));
         }
     }
-
-    return error.isEmpty();
 }
 
-bool RepositoryXMLHandler::endElement(const QString &namespaceURI,
-    const QString &localName, const QString &qName)
+void RepositoryXMLHandler::endElement()
 {
-    int where = findWhere();
+    int where = tags.last();
     if (where == TAG_VERSION) {
         error = rep->savePackageVersion(pv, false);
 
@@ -399,22 +413,6 @@ bool RepositoryXMLHandler::endElement(const QString &namespaceURI,
     }
     tags.removeLast();
     chars.clear();
-
-    return this->error.isEmpty();
-}
-
-bool RepositoryXMLHandler::characters(const QString &ch)
-{
-    chars.append(ch);
-    return true;
-}
-
-bool RepositoryXMLHandler::fatalError(const QXmlParseException &exception)
-{
-    this->error = QObject::tr("XML parsing error at line %1, column %2: %3").
-            arg(exception.lineNumber()).arg(exception.columnNumber()).
-            arg(exception.message());
-    return false;
 }
 
 QString RepositoryXMLHandler::errorString() const
@@ -1,9 +1,11 @@
 #ifndef REPOSITORYXMLHANDLER_H
 #define REPOSITORYXMLHANDLER_H
 
-#include <QXmlDefaultHandler>
 #include <QString>
-#include <QXmlAttributes>
+#include <QStringRef>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <QXmlStreamAttributes>
 
 #include "license.h"
 #include "package.h"
@@ -12,9 +14,10 @@
 #include "dbrepository.h"
 
 /**
- * @brief SAX handler for the repository XML.
+ * @brief parser for the repository XML. The XML is read using
+ * QXmlStreamReader and the attributes are accessed without copying.
  */
-class RepositoryXMLHandler: public QXmlDefaultHandler
+class RepositoryXMLHandler
 {
     enum WHERE {
         TAG_VERSION,
@@ -43,7 +46,8 @@ class RepositoryXMLHandler: public QXmlDefaultHandler
         TAG_LICENSE_TITLE,
         TAG_LICENSE_URL,
         TAG_LICENSE_DESCRIPTION,
-        TAG_SPEC_VERSION
+        TAG_SPEC_VERSION,
+        TAG_ROOT
     };
 
     AbstractRepository* rep;
@@ -57,11 +61,16 @@ class RepositoryXMLHandler: public QXmlDefaultHandler
 
     QString chars;
     QString error;
-    QStringList tags;
+
+    /** WHERE values for the currently open tags. -1 for unknown tags. */
+    QVector<int> tags;
 
     QUrl url;
 
-    int findWhere();
+    int findWhere(const QStringRef& name) const;
+    void startElement(const QStringRef& name,
+            const QXmlStreamAttributes& atts);
+    void endElement();
 public:
     /**
      * -
@@ -75,20 +84,23 @@ public:
     virtual ~RepositoryXMLHandler();
 
     /**
-     * @brief enters a tag without it being visible in the XML. This method
-     * can be used to parse top level <version> tags.
+     * @brief enters the root tag without it being visible in the XML. This
+     * method can be used to parse top level <version> tags.
+     */
+    void enter();
+
+    /**
+     * @brief parses the XML
      *
-     * @param qName the name of the tag
+     * @param reader XML source
+     * @return true if the XML was parsed successfully. See errorString() for
+     *     the error message otherwise.
      */
-    void enter(const QString& qName);
+    bool parse(QXmlStreamReader* reader);
 
-    bool startElement(const QString& namespaceURI,
-            const QString& localName, const QString& qName,
-            const QXmlAttributes& atts);
-    bool endElement(const QString& namespaceURI,
-            const QString& localName, const QString& qName);
-    bool characters(const QString& ch);
-    bool fatalError(const QXmlParseException& exception);
+    /**
+     * @return error message
+     */
     QString errorString() const;
 };
 
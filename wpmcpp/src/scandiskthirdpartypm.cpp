@@ -1,10 +1,399 @@
 #include "scandiskthirdpartypm.h"
 
 #include <QDebug>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
 
 #include "wpmutils.h"
 #include "dbrepository.h"
 
+/**
+ * @brief checks all detect files for a package version
+ * @param path directory
+ * @param pv package version
+ * @param path2sha1 cache for SHA1 of files in this directory:
+ *     relative path => SHA1
+ * @return true if all detect files are present in the directory
+ */
+static bool detect(const QString& path, PackageVersion* pv,
+        QMap<QString, QString>& path2sha1)
+{
+    bool ok = true;
+    for (int j = 0; j < pv->detectFiles.count(); j++) {
+        bool fileOK = false;
+        DetectFile* df = pv->detectFiles.at(j);
+        QString fullPath = path + "\\" + df->path;
+        QFileInfo f(fullPath);
+        if (f.isFile() && f.isReadable()) {
+            QString sha1 = path2sha1.value(df->path);
+            if (sha1.isEmpty()) {
+                sha1 = WPMUtils::sha1(fullPath);
+                path2sha1[df->path] = sha1;
+            }
+            if (df->sha1 == sha1) {
+                fileOK = true;
+            }
+        }
+        if (!fileOK) {
+            ok = false;
+            break;
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * @brief a task for the parallel scan
+ */
+class ScanDiskTask
+{
+public:
+    /** directory */
+    QString path;
+
+    /**
+     * position of the directory in the sequential scan: indexes of the
+     * sub-directories starting from the top directory
+     */
+    QVector<int> key;
+
+    /** part of the whole progress for this directory and its sub-directories */
+    double weight;
+};
+
+/**
+ * @brief package versions detected in one directory
+ */
+class ScanDiskResult
+{
+public:
+    /** directory */
+    QString path;
+
+    /** see ScanDiskTask::key */
+    QVector<int> key;
+
+    /**
+     * detected package versions in the order of the sequential scan. The
+     * sub-directories were not searched.
+     */
+    QList<PackageVersion*> detected;
+};
+
+/**
+ * @brief orders the results like the sequential scan visits the directories
+ */
+static bool scanDiskResultLessThan(const ScanDiskResult* a,
+        const ScanDiskResult* b)
+{
+    int n = qMin(a->key.count(), b->key.count());
+    for (int i = 0; i < n; i++) {
+        if (a->key.at(i) != b->key.at(i))
+            return a->key.at(i) < b->key.at(i);
+    }
+    return a->key.count() < b->key.count();
+}
+
+/**
+ * @brief tasks for one worker thread. The owner takes the tasks from the end,
+ *     other workers steal from the beginning.
+ */
+class ScanDiskQueue
+{
+public:
+    QMutex mutex;
+    QList<ScanDiskTask*> tasks;
+};
+
+/**
+ * @brief directory scan with a fixed number of workers and work stealing
+ */
+class ParallelScanDisk
+{
+    const QStringList& ignore;
+    const QMultiHash<QString, PackageVersion*>& index;
+    const QSet<PackageVersion*>& found;
+    Job* job;
+    QList<ScanDiskQueue*> queues;
+
+    /** number of created, but not yet processed tasks */
+    QAtomicInt pending;
+
+    /** guards "available" */
+    QMutex idleMutex;
+
+    /** number of tasks in the queues. Accessed under idleMutex. */
+    int available;
+
+    /**
+     * signalled if a task was queued, all tasks were processed or the job
+     * was cancelled
+     */
+    QWaitCondition idle;
+
+    /**
+     * @brief wakes up all waiting workers
+     */
+    void wakeAll();
+
+    /** guards results and progress */
+    QMutex resultsMutex;
+
+    /** sum of ScanDiskTask::weight for the finished directories */
+    double progress;
+
+    ScanDiskTask* take(int worker);
+    void list(int worker, ScanDiskTask* task);
+
+    /**
+     * @brief adds the progress for a finished directory
+     * @param weight see ScanDiskTask::weight
+     */
+    void addProgress(double weight);
+public:
+    /** number of listed directories */
+    QAtomicInt directories;
+
+    /** [owner] detected package versions in no particular order */
+    QList<ScanDiskResult*> results;
+
+    /**
+     * @param ignore ignored directories
+     * @param index candidates
+     * @param found package versions that were already found before this
+     *     scan. They are not checked.
+     * @param job job. Only Job::isCancelled() is called from the workers.
+     * @param workers number of workers
+     */
+    ParallelScanDisk(const QStringList& ignore,
+            const QMultiHash<QString, PackageVersion*>& index,
+            const QSet<PackageVersion*>& found, Job* job, int workers);
+
+    /**
+     * @return progress of the listing 0...1
+     */
+    double getProgress();
+
+    ~ParallelScanDisk();
+
+    /**
+     * @brief adds a task to the queue of a worker
+     * @param worker index of the worker
+     * @param task [ownership:this] the task
+     */
+    void push(int worker, ScanDiskTask* task);
+
+    /**
+     * @brief processes the tasks until all of them are finished or the job
+     *     is cancelled
+     * @param worker index of the worker
+     */
+    void work(int worker);
+};
+
+/**
+ * @brief runs ParallelScanDisk::work
+ */
+class ScanDiskWorker: public QRunnable
+{
+    ParallelScanDisk* scan;
+    int worker;
+public:
+    ScanDiskWorker(ParallelScanDisk* scan, int worker):
+            scan(scan), worker(worker)
+    {
+    }
+
+    void run()
+    {
+        scan->work(worker);
+    }
+};
+
+ParallelScanDisk::ParallelScanDisk(const QStringList& ignore,
+        const QMultiHash<QString, PackageVersion*>& index,
+        const QSet<PackageVersion*>& found, Job* job, int workers):
+        ignore(ignore), index(index), found(found), job(job), pending(0),
+        available(0), progress(0), directories(0)
+{
+    for (int i = 0; i < workers; i++)
+        queues.append(new ScanDiskQueue());
+}
+
+ParallelScanDisk::~ParallelScanDisk()
+{
+    // tasks are only left here if the job was cancelled
+    for (int i = 0; i < queues.count(); i++)
+        qDeleteAll(queues.at(i)->tasks);
+    qDeleteAll(queues);
+    qDeleteAll(results);
+}
+
+void ParallelScanDisk::push(int worker, ScanDiskTask* task)
+{
+    pending.ref();
+
+    ScanDiskQueue* q = queues.at(worker);
+    q->mutex.lock();
+    q->tasks.append(task);
+    q->mutex.unlock();
+
+    idleMutex.lock();
+    available++;
+    idle.wakeOne();
+    idleMutex.unlock();
+}
+
+void ParallelScanDisk::wakeAll()
+{
+    idleMutex.lock();
+    idle.wakeAll();
+    idleMutex.unlock();
+}
+
+ScanDiskTask* ParallelScanDisk::take(int worker)
+{
+    ScanDiskTask* r = 0;
+
+    ScanDiskQueue* own = queues.at(worker);
+    own->mutex.lock();
+    if (!own->tasks.isEmpty())
+        r = own->tasks.takeLast();
+    own->mutex.unlock();
+
+    for (int i = 1; !r && i < queues.count(); i++) {
+        ScanDiskQueue* q = queues.at((worker + i) % queues.count());
+        q->mutex.lock();
+        if (!q->tasks.isEmpty())
+            r = q->tasks.takeFirst();
+        q->mutex.unlock();
+    }
+
+    if (r) {
+        idleMutex.lock();
+        available--;
+        idleMutex.unlock();
+    }
+
+    return r;
+}
+
+void ParallelScanDisk::work(int worker)
+{
+    while (!job->isCancelled()) {
+        ScanDiskTask* task = take(worker);
+        if (!task) {
+            // other workers may still create new tasks
+            idleMutex.lock();
+            while (available == 0 && pending.load() != 0 &&
+                    !job->isCancelled())
+                idle.wait(&idleMutex);
+            idleMutex.unlock();
+
+            if (pending.load() == 0)
+                break;
+            continue;
+        }
+
+        list(worker, task);
+
+        delete task;
+
+        // the last task is finished
+        if (!pending.deref())
+            wakeAll();
+    }
+
+    // the waiting workers should also stop
+    if (job->isCancelled())
+        wakeAll();
+}
+
+void ParallelScanDisk::list(int worker, ScanDiskTask* task)
+{
+    if (ignore.contains(task->path)) {
+        addProgress(task->weight);
+        return;
+    }
+
+    QDir aDir(task->path);
+    QFileInfoList entries = aDir.entryInfoList(
+            QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files | QDir::Hidden);
+    directories.ref();
+
+    // the candidates are checked before the sub-directories are listed as
+    // there is no search below a directory where a package version was
+    // found. All candidates are checked here. Which of them are found first
+    // is only known after the whole scan.
+    QMap<QString, QString> path2sha1;
+    ScanDiskResult* r = 0;
+    QStringList dirs;
+    for (int i = 0; i < entries.count(); i++) {
+        if (job->isCancelled())
+            break;
+
+        const QFileInfo& entryInfo = entries.at(i);
+        QString name = entryInfo.fileName().toLower();
+        QList<PackageVersion*> candidates = index.values(name);
+        for (int j = 0; j < candidates.count(); j++) {
+            PackageVersion* pv = candidates.at(j);
+            if (!found.contains(pv) && detect(task->path, pv, path2sha1)) {
+                if (!r) {
+                    r = new ScanDiskResult();
+                    r->path = task->path;
+                    r->key = task->key;
+                }
+                r->detected.append(pv);
+            }
+        }
+
+        if (entryInfo.isDir() && !entryInfo.isHidden())
+            dirs.append(name);
+    }
+
+    if (r) {
+        resultsMutex.lock();
+        results.append(r);
+        resultsMutex.unlock();
+    }
+
+    if (r || dirs.isEmpty()) {
+        addProgress(task->weight);
+    } else {
+        // the sub-directories are pushed in the reverse order so that this
+        // worker continues with the first one
+        for (int i = dirs.count() - 1; i >= 0; i--) {
+            ScanDiskTask* t = new ScanDiskTask();
+            t->path = task->path + "\\" + dirs.at(i);
+            t->key = task->key;
+            t->key.append(i);
+            t->weight = task->weight / dirs.count();
+            push(worker, t);
+        }
+    }
+}
+
+void ParallelScanDisk::addProgress(double weight)
+{
+    resultsMutex.lock();
+    progress += weight;
+    resultsMutex.unlock();
+}
+
+double ParallelScanDisk::getProgress()
+{
+    resultsMutex.lock();
+    double r = progress;
+    resultsMutex.unlock();
+    return r;
+}
+
 ScanDiskThirdPartyPM::ScanDiskThirdPartyPM()
 {
 }
@@ -15,9 +404,29 @@ void ScanDiskThirdPartyPM::scan(Job *job,
     QStringList ignore;
     ignore.append(WPMUtils::normalizePath(WPMUtils::getWindowsDir()));
 
+    // the candidates are only loaded once for all directories
+    DBRepository* r = DBRepository::getDefault();
+    QString err;
+    QList<PackageVersion*> packageVersions =
+            r->getPackageVersionsWithDetectFiles(&err);
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+
+    QList<PackageVersion*> pvs;
+    for (int i = 0; i < packageVersions.count(); i++) {
+        PackageVersion* pv = packageVersions.at(i);
+        if (!pv->installed())
+            pvs.append(pv);
+    }
+
+    // qDebug() << "package versions with detect files: " << pvs.count();
+
+    // a package version is only reported once for all drives
+    QSet<PackageVersion*> found;
+
     QFileInfoList fil = QDir::drives();
     for (int i = 0; i < fil.count(); i++) {
-        if (job->isCancelled())
+        if (!job->shouldProceed())
             break;
 
         QFileInfo fi = fil.at(i);
@@ -27,92 +436,173 @@ void ScanDiskThirdPartyPM::scan(Job *job,
         QString path = WPMUtils::normalizePath(fi.absolutePath());
         UINT t = GetDriveType((WCHAR*) path.utf16());
         if (t == DRIVE_FIXED)
-            scan(path, djob, 0, ignore);
+            scanDirectory(djob, path, pvs, ignore, installed, found);
+        else
+            djob->completeWithProgress();
     }
 
+    qDeleteAll(packageVersions);
+
     job->complete();
 }
 
-void ScanDiskThirdPartyPM::scan(const QString& path, Job* job, int level,
-        QStringList& ignore) const
+void ScanDiskThirdPartyPM::scanDirectory(Job* job, const QString& dir,
+        const QList<PackageVersion*>& pvs, const QStringList& ignore,
+        QList<InstalledPackageVersion*>* installed,
+        QSet<PackageVersion*>& found, int threads) const
 {
-    if (ignore.contains(path))
-        return;
+    DetectFileIndex index;
+    for (int i = 0; i < pvs.count(); i++) {
+        PackageVersion* pv = pvs.at(i);
+        if (pv->detectFiles.count() > 0) {
+            QString p = pv->detectFiles.at(0)->path.toLower();
+            index.insert(p.section('\\', 0, 0), pv);
+        }
+    }
 
-    QDir aDir(path);
+    if (threads == 0)
+        threads = qMax(2, QThread::idealThreadCount());
 
-    QMap<QString, QString> path2sha1;
+    if (threads == 1)
+        scan(dir, job, job, 0, ignore, index, found, installed);
+    else
+        scanParallel(dir, job, threads, ignore, index, found, installed);
+}
 
-    DBRepository* r = DBRepository::getDefault();
-    QString err;
-    QList<PackageVersion*> packageVersions =
-            r->getPackageVersionsWithDetectFiles(&err);
+void ScanDiskThirdPartyPM::scanParallel(const QString& dir, Job* job,
+        int threads, const QStringList& ignore, const DetectFileIndex& index,
+        QSet<PackageVersion*>& found,
+        QList<InstalledPackageVersion*>* installed) const
+{
+    QString initialTitle = job->getTitle();
 
-    // qDebug() << "package versions with detect files: " << packageVersions.count();
+    ParallelScanDisk scan(ignore, index, found, job, threads);
+    ScanDiskTask* task = new ScanDiskTask();
+    task->path = dir;
+    task->weight = 1;
+    scan.push(0, task);
 
-    if (!err.isEmpty())
-        job->setErrorMessage(err);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; i++)
+        pool.start(new ScanDiskWorker(&scan, i));
 
-    for (int i = 0; i < packageVersions.count(); i++) {
-        if (!job->shouldProceed())
-            break;
+    // 90% for listing the directories
+    while (!pool.waitForDone(100)) {
+        job->setTitle(initialTitle + " / " +
+                QObject::tr("%L1 directories").arg(scan.directories.load()));
+        if (job->shouldProceed())
+            job->setProgress(0.9 * scan.getProgress());
+    }
+    job->setTitle(initialTitle);
 
-        PackageVersion* pv = packageVersions.at(i);
-        if (!pv->installed() && pv->detectFiles.count() > 0) {
-            boolean ok = true;
-            for (int j = 0; j < pv->detectFiles.count(); j++) {
-                bool fileOK = false;
-                DetectFile* df = pv->detectFiles.at(j);
-                if (aDir.exists(df->path)) {
-                    QString fullPath = path + "\\" + df->path;
-                    QFileInfo f(fullPath);
-                    if (f.isFile() && f.isReadable()) {
-                        QString sha1 = path2sha1.value(df->path);
-                        if (sha1.isEmpty()) {
-                            sha1 = WPMUtils::sha1(fullPath);
-                            path2sha1[df->path] = sha1;
-                        }
-                        if (df->sha1 == sha1) {
-                            fileOK = true;
-                        }
-                    }
-                }
-                if (!fileOK) {
-                    ok = false;
+    if (job->shouldProceed()) {
+        job->setProgress(0.9);
+
+        // the results are processed in the same order as the sequential scan
+        // visits the directories
+        QList<ScanDiskResult*> results = scan.results;
+        qSort(results.begin(), results.end(), scanDiskResultLessThan);
+
+        for (int i = 0; i < results.count(); i++) {
+            if (!job->shouldProceed())
+                break;
+
+            ScanDiskResult* r = results.at(i);
+
+            PackageVersion* pv = 0;
+            for (int j = 0; j < r->detected.count(); j++) {
+                if (!found.contains(r->detected.at(j))) {
+                    pv = r->detected.at(j);
                     break;
                 }
             }
 
-            if (ok) {
-                pv->setPath(path);
+            if (pv) {
+                found.insert(pv);
+                installed->append(new InstalledPackageVersion(pv->package,
+                        pv->version, r->path));
+            } else {
+                // all package versions detected here were found in a
+                // directory visited before. Like the sequential scan, the
+                // search continues in the sub-directories.
+                this->scan(r->path, 0, job, 1, ignore, index, found,
+                        installed);
+            }
+        }
+
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+void ScanDiskThirdPartyPM::scan(const QString& path, Job* job, Job* top,
+        int level, const QStringList& ignore, const DetectFileIndex& index,
+        QSet<PackageVersion*>& found,
+        QList<InstalledPackageVersion*>* installed) const
+{
+    if (ignore.contains(path)) {
+        if (job)
+            job->complete();
+        return;
+    }
+
+    QDir aDir(path);
+
+    // the directory is only read once. Detect files are only checked if the
+    // first path component of the first detect file is present here.
+    QFileInfoList entries = aDir.entryInfoList(
+            QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files | QDir::Hidden);
+
+    QMap<QString, QString> path2sha1;
+
+    for (int idx = 0; idx < entries.count(); idx++) {
+        if (!top->shouldProceed())
+            break;
+
+        QString name = entries.at(idx).fileName().toLower();
+        QList<PackageVersion*> candidates = index.values(name);
+        for (int i = 0; i < candidates.count(); i++) {
+            PackageVersion* pv = candidates.at(i);
+            if (!found.contains(pv) && detect(path, pv, path2sha1)) {
+                found.insert(pv);
+                installed->append(new InstalledPackageVersion(pv->package,
+                        pv->version, path));
+                if (job)
+                    job->complete();
                 return;
             }
         }
     }
 
-    if (job && !job->isCancelled()) {
-        QFileInfoList entries = aDir.entryInfoList(
-                QDir::NoDotAndDotDot | QDir::Dirs);
-        int count = entries.size();
+    // the sub-directories are searched on all levels, but the progress is
+    // only reported for the first 2
+    if (!top->isCancelled()) {
+        QFileInfoList dirs;
+        for (int idx = 0; idx < entries.count(); idx++) {
+            const QFileInfo& entryInfo = entries.at(idx);
+            if (entryInfo.isDir() && !entryInfo.isHidden())
+                dirs.append(entryInfo);
+        }
+
+        int count = dirs.size();
         for (int idx = 0; idx < count; idx++) {
-            if (job && job->isCancelled())
+            if (top->isCancelled())
                 break;
 
-            QFileInfo entryInfo = entries[idx];
-            QString name = entryInfo.fileName();
+            QString name = dirs.at(idx).fileName();
 
-            if (job) {
+            if (job)
                 job->setTitle(name);
-                if (job->isCancelled())
-                    break;
-            }
 
             Job* djob;
-            if (level < 2)
+            if (job && level < 2)
                 djob = job->newSubJob(1.0 / count);
             else
                 djob = 0;
-            scan(path + "\\" + name.toLower(), djob, level + 1, ignore);
+            scan(path + "\\" + name.toLower(), djob, top, level + 1,
+                    ignore, index, found, installed);
 
             if (job) {
                 job->setProgress(((double) idx) / count);
@@ -120,9 +610,6 @@ void ScanDiskThirdPartyPM::scan(const QString& path, Job* job, int level,
         }
     }
 
-    qDeleteAll(packageVersions);
-
     if (job)
         job->complete();
 }
-
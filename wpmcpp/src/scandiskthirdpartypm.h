@@ -1,27 +1,92 @@
 #ifndef SCANDISKTHIRDPARTYPM_H
 #define SCANDISKTHIRDPARTYPM_H
 
+#include <QMultiHash>
+#include <QSet>
+
 #include "abstractthirdpartypm.h"
 
+/**
+ * @brief detects package versions on the hard drives using <detect-file>
+ */
 class ScanDiskThirdPartyPM: public AbstractThirdPartyPM
 {
 private:
+    /**
+     * Package versions with detect files indexed by the first component of
+     * the path of the first detect file in lower case. Example:
+     * "bin\notepad.exe" is stored under the key "bin".
+     */
+    typedef QMultiHash<QString, PackageVersion*> DetectFileIndex;
+
     /**
      * All paths should be in lower case
      * and separated with \ and not / and cannot end with \.
      *
+     * All levels of sub-directories are searched. Progress is only reported
+     * for the first levels, cancellation is checked on all levels.
+     *
      * @param path directory
-     * @param job job
+     * @param job job or 0
+     * @param top top-level job. Used to check for cancellation.
+     * @param level recursion level. 0 = the top directory
      * @param ignore ignored directories
+     * @param index candidates
+     * @param found package versions that were already found
+     * @param installed found package versions will be appended here
      * @threadsafe
      */
-    void scan(const QString& path, Job* job, int level,
-            QStringList& ignore) const;
+    void scan(const QString& path, Job* job, Job* top, int level,
+            const QStringList& ignore, const DetectFileIndex& index,
+            QSet<PackageVersion*>& found,
+            QList<InstalledPackageVersion*>* installed) const;
+
+    /**
+     * @brief parallel version of scan(). The directories are listed by a
+     *     thread pool with work stealing. The detect files are checked while
+     *     a directory is listed and its sub-directories are only listed if
+     *     nothing was detected. The result is the same as for the sequential
+     *     scan.
+     * @param dir directory
+     * @param job job
+     * @param threads number of threads
+     * @param ignore ignored directories
+     * @param index candidates
+     * @param found package versions that were already found
+     * @param installed found package versions will be appended here
+     */
+    void scanParallel(const QString& dir, Job* job, int threads,
+            const QStringList& ignore, const DetectFileIndex& index,
+            QSet<PackageVersion*>& found,
+            QList<InstalledPackageVersion*>* installed) const;
 public:
     ScanDiskThirdPartyPM();
 
     void scan(Job *job, QList<InstalledPackageVersion *> *installed,
             Repository *rep) const;
+
+    /**
+     * @brief searches for package versions in a directory and all its
+     *     sub-directories. The search does not continue in a directory where
+     *     a package version was found.
+     * @param job job
+     * @param dir directory. The path should be in lower case, separated
+     *     with \ and not / and cannot end with \.
+     * @param pvs [ownership:caller] package versions with detect files
+     * @param ignore ignored directories
+     * @param installed [ownership:caller] found package versions will be
+     *     appended here
+     * @param found package versions that were already found, e.g. on
+     *     another drive. They are not reported again. The newly found
+     *     package versions will be added here.
+     * @param threads number of threads. 0 means
+     *     QThread::idealThreadCount(), 1 means a sequential scan in the
+     *     current thread.
+     */
+    void scanDirectory(Job* job, const QString& dir,
+            const QList<PackageVersion*>& pvs, const QStringList& ignore,
+            QList<InstalledPackageVersion*>* installed,
+            QSet<PackageVersion*>& found, int threads=0) const;
 };
 
 #endif // SCANDISKTHIRDPARTYPM_H
@@ -1,9 +1,53 @@
-#include "qstringlist.h"
+#include <limits.h>
+#include <string.h>
 
 #include "version.h"
 
 const Version Version::EMPTY(-1, -1);
 
+/**
+ * @brief parses one part of a version number. Spaces around the number
+ *     and a sign are allowed like in QString::toInt().
+ * @param c first character
+ * @param end end of the string
+ * @param value the parsed number will be stored here
+ * @return the first character after the part or 0 if the part is not valid
+ */
+static const QChar* parseVersionPart(const QChar* c, const QChar* end,
+        int* value)
+{
+    while (c != end && c->isSpace())
+        ++c;
+
+    bool negative = false;
+    if (c != end && (*c == QLatin1Char('-') || *c == QLatin1Char('+'))) {
+        negative = *c == QLatin1Char('-');
+        ++c;
+    }
+
+    const QChar* digits = c;
+    qint64 r = 0;
+    while (c != end && c->unicode() >= '0' && c->unicode() <= '9') {
+        r = r * 10 + (c->unicode() - '0');
+        if (r > Q_INT64_C(2147483648))
+            return 0;
+        ++c;
+    }
+    if (c == digits)
+        return 0;
+
+    while (c != end && c->isSpace())
+        ++c;
+
+    if (negative)
+        r = -r;
+    if (r > INT_MAX)
+        return 0;
+
+    *value = static_cast<int>(r);
+    return c;
+}
+
 Version::Version(): basic()
 {
     this->parts = &this->basic[0];
@@ -32,14 +76,16 @@ Version::Version(const Version &v): basic()
 Version& Version::operator =(const Version& v)
 {
     if (this != &v) {
-        if (this->parts != &basic[0])
-            delete[] this->parts;
-        if (v.nparts <= BASIC_PARTS)
-            this->parts = &basic[0];
-        else
+        if (v.parts == v.basic) {
+            useBasic();
+            memcpy(basic, v.basic, sizeof(basic));
+        } else {
+            if (this->parts != &basic[0])
+                delete[] this->parts;
             this->parts = new int[v.nparts];
+            memcpy(parts, v.parts, sizeof(parts[0]) * v.nparts);
+        }
         this->nparts = v.nparts;
-        memcpy(parts, v.parts, sizeof(parts[0]) * nparts);
     }
     return *this;
 }
@@ -75,11 +121,18 @@ Version::~Version()
         delete[] this->parts;
 }
 
-void Version::setVersion(int a, int b)
+void Version::useBasic()
 {
-    if (this->parts != this->basic)
+    if (this->parts != this->basic) {
         delete[] this->parts;
-    this->parts = basic;
+        this->parts = basic;
+    }
+    memset(basic, 0, sizeof(basic));
+}
+
+void Version::setVersion(int a, int b)
+{
+    useBasic();
     this->parts[0] = a;
     this->parts[1] = b;
     this->nparts = 2;
@@ -87,9 +140,7 @@ void Version::setVersion(int a, int b)
 
 void Version::setVersion(int a, int b, int c)
 {
-    if (this->parts != this->basic)
-        delete[] this->parts;
-    this->parts = basic;
+    useBasic();
     this->parts[0] = a;
     this->parts[1] = b;
     this->parts[2] = c;
@@ -98,9 +149,7 @@ void Version::setVersion(int a, int b, int c)
 
 void Version::setVersion(int a, int b, int c, int d)
 {
-    if (this->parts != this->basic)
-        delete[] this->parts;
-    this->parts = basic;
+    useBasic();
     this->parts[0] = a;
     this->parts[1] = b;
     this->parts[2] = c;
@@ -110,33 +159,49 @@ void Version::setVersion(int a, int b, int c, int d)
 
 bool Version::setVersion(const QString& v)
 {
-    bool result = false;
-    if (!v.trimmed().isEmpty()) {
-        QStringList sl = v.split(".", QString::KeepEmptyParts);
-
-        if (sl.count() > 0) {
-            bool ok = true;
-            for (int i = 0; i < sl.count(); i++) {
-                sl.at(i).toInt(&ok);
-                if (!ok)
-                    break;
-            }
-
-            if (ok) {
-                if (this->parts != basic)
-                    delete[] this->parts;
-                this->nparts = sl.count();
-                if (nparts <= BASIC_PARTS)
-                    this->parts = basic;
-                else
-                    this->parts = new int[nparts];
-                for (int i = 0; i < nparts; i++) {
-                    this->parts[i] = sl.at(i).toInt();
-                }
-                result = true;
-            }
+    const QChar* begin = v.constData();
+    const QChar* end = begin + v.length();
+
+    int n = 1;
+    for (const QChar* c = begin; c != end; ++c) {
+        if (*c == QLatin1Char('.'))
+            n++;
+    }
+
+    // the parts are parsed into a temporary buffer first so that this
+    // object is not changed for invalid versions
+    int tmp[BASIC_PARTS] = {};
+    int* target = n <= BASIC_PARTS ? tmp : new int[n];
+
+    bool result = true;
+    const QChar* c = begin;
+    for (int i = 0; i < n; i++) {
+        c = parseVersionPart(c, end, target + i);
+
+        // each part ends with "." or the end of the string
+        if (!c || (c != end && *c != QLatin1Char('.'))) {
+            result = false;
+            break;
+        }
+
+        if (c != end)
+            ++c;
+    }
+
+    if (result) {
+        if (target == tmp) {
+            useBasic();
+            memcpy(basic, tmp, sizeof(basic));
+        } else {
+            if (this->parts != basic)
+                delete[] this->parts;
+            this->parts = target;
         }
+        this->nparts = n;
+    } else if (target != tmp) {
+        delete[] target;
     }
+
     return result;
 }
 
@@ -196,16 +261,16 @@ void Version::normalize()
             break;
     }
 
+    // the removed parts in *basic* are already 0. Longer versions keep
+    // their buffer on the heap.
     if (n > 0) {
-        int* newParts;
-        if (this->nparts - n <= BASIC_PARTS)
-            newParts = basic;
-        else
-            newParts = new int[this->nparts - n];
-        memmove(newParts, this->parts, sizeof(parts[0]) * (this->nparts - n));
-        if (this->parts != basic)
-            delete[] this->parts;
-        this->parts = newParts;
+        if (this->parts != basic && this->nparts - n <= BASIC_PARTS) {
+            int* old = this->parts;
+            memset(basic, 0, sizeof(basic));
+            memcpy(basic, old, sizeof(parts[0]) * (this->nparts - n));
+            delete[] old;
+            this->parts = basic;
+        }
         this->nparts = this->nparts - n;
     }
 }
@@ -226,8 +291,38 @@ QString Version::toComparableString() const
     return r;
 }
 
+QByteArray Version::toSortKey() const
+{
+    int n = this->nparts;
+    while (n > 1 && this->parts[n - 1] == 0)
+        n--;
+
+    QByteArray r(n * 4, Qt::Uninitialized);
+    char* d = r.data();
+    for (int i = 0; i < n; i++) {
+        // flipping the sign bit makes the unsigned order match the signed one
+        quint32 v = static_cast<quint32>(this->parts[i]) ^ 0x80000000u;
+        d[i * 4] = static_cast<char>(v >> 24);
+        d[i * 4 + 1] = static_cast<char>(v >> 16);
+        d[i * 4 + 2] = static_cast<char>(v >> 8);
+        d[i * 4 + 3] = static_cast<char>(v);
+    }
+    return r;
+}
+
 int Version::compare(const Version &other) const
 {
+    // fast path for the common case: the unused parts in *basic* are 0
+    if (this->parts == this->basic && other.parts == other.basic) {
+        for (int i = 0; i < BASIC_PARTS; i++) {
+            int a = this->basic[i];
+            int b = other.basic[i];
+            if (a != b)
+                return a < b ? -1 : 1;
+        }
+        return 0;
+    }
+
     int nmax = nparts;
     if (other.nparts > nmax)
         nmax = other.nparts;
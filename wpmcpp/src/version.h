@@ -2,6 +2,7 @@
 #define VERSION_H
 
 #include "qstring.h"
+#include <QByteArray>
 
 class Version
 {
@@ -11,6 +12,7 @@ private:
     /**
      * this is used instead of allocating memory on the heap for performance.
      * Version numbers with more than 4 parts are still stored on the heap.
+     * The unused parts are always 0.
      */
     int basic[BASIC_PARTS];
 
@@ -18,6 +20,11 @@ private:
     int* parts;
 
     int nparts;
+
+    /**
+     * @brief frees the parts on the heap and resets *basic* to zeros
+     */
+    void useBasic();
 public:
     static const Version EMPTY;
 
@@ -133,6 +140,16 @@ public:
      *     will contain 10 characters.
      */
     QString toComparableString() const;
+
+    /**
+     * @brief converts to a binary key that can be compared with memcmp().
+     *     Trailing zeros are removed and each remaining part is stored as 4
+     *     bytes in big-endian order. Keys for non-negative version numbers
+     *     are ordered like compare() and equal versions ("1.2" and "1.2.0")
+     *     have equal keys.
+     * @return e.g. 80 00 00 01 80 00 00 02 for the version "1.2"
+     */
+    QByteArray toSortKey() const;
 };
 
 #endif // VERSION_H
@@ -10,12 +10,15 @@ SOURCES += main.cpp \
     repository.cpp \
     job.cpp \
     downloader.cpp \
+    hashsumwriter.cpp \
     wpmutils.cpp \
     package.cpp \
     packageversionfile.cpp \
     version.cpp \
     dependency.cpp \
+    dependencyresolver.cpp \
     fileloader.cpp \
+    filecache.cpp \
     installoperation.cpp \
     packageversionform.cpp \
     license.cpp \
@@ -33,6 +36,7 @@ SOURCES += main.cpp \
     mainframe.cpp \
     dbrepository.cpp \
     installedpackages.cpp \
+    installedpackagessnapshot.cpp \
     installedpackageversion.cpp \
     abstractrepository.cpp \
     packageitemmodel.cpp \
@@ -45,6 +49,7 @@ SOURCES += main.cpp \
     scandiskthirdpartypm.cpp \
     mysqlquery.cpp \
     repositoryxmlhandler.cpp \
+    repositoryqueue.cpp \
     cbsthirdpartypm.cpp \
     visiblejobs.cpp \
     progresstree2.cpp \
@@ -56,12 +61,15 @@ HEADERS += mainwindow.h \
     repository.h \
     job.h \
     downloader.h \
+    hashsumwriter.h \
     wpmutils.h \
     package.h \
     packageversionfile.h \
     version.h \
     dependency.h \
+    dependencyresolver.h \
     fileloader.h \
+    filecache.h \
     installoperation.h \
     packageversionform.h \
     license.h \
@@ -80,6 +88,7 @@ HEADERS += mainwindow.h \
     mainframe.h \
     dbrepository.h \
     installedpackages.h \
+    installedpackagessnapshot.h \
     installedpackageversion.h \
     abstractrepository.h \
     packageitemmodel.h \
@@ -92,6 +101,7 @@ HEADERS += mainwindow.h \
     scandiskthirdpartypm.h \
     mysqlquery.h \
     repositoryxmlhandler.h \
+    repositoryqueue.h \
     cbsthirdpartypm.h \
     msoav2.h \
     visiblejobs.h \
@@ -35,6 +35,10 @@
 #include <QBuffer>
 #include <QByteArray>
 #include <QUrl>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 
 #include <quazip.h>
 #include <quazipfile.h>
@@ -48,6 +52,7 @@
 #include "version.h"
 #include "windowsregistry.h"
 #include "mstask.h"
+#include "hashsumwriter.h"
 
 bool WPMUtils::debug = false;
 
@@ -1994,28 +1999,14 @@ QString WPMUtils::hashSum(const QString& filename,
     if (!file.open(QIODevice::ReadOnly))
          return "";
 
-    QCryptographicHash hash(alg);
-
-    const int SIZE = 512 * 1024;
-    char* buffer = new char[SIZE];
-
-    bool err = false;
-    while (!file.atEnd()) {
-        qint64 r = file.read(buffer, SIZE);
-        if (r < 0) {
-            err = true;
-            break;
-        }
-        hash.addData(buffer, r);
-    }
+    HashSumWriter writer(0, true, alg);
+    QString err = writer.writeAll(&file);
     file.close();
 
-    delete[] buffer;
-
-    if (err)
+    if (!err.isEmpty())
         return "";
     else
-        return hash.result().toHex().toLower();
+        return writer.getHashSum();
 }
 
 QString WPMUtils::getShellFileOperationErrorMessage(int res)
@@ -2515,7 +2506,7 @@ QString WPMUtils::fileCheckSum(Job* job,
     QString initialTitle = job->getTitle();
 
     // download/compute SHA1 loop
-    QCryptographicHash hash(alg);
+    HashSumWriter writer(0, true, alg);
     const int bufferSize = 512 * 1024;
     char* buffer = new char[bufferSize];
 
@@ -2534,8 +2525,7 @@ QString WPMUtils::fileCheckSum(Job* job,
             break;
         }
 
-        // update SHA1 if necessary
-        hash.addData((char*) buffer, bufferLength);
+        writer.write(buffer, bufferLength);
 
         alreadyRead += bufferLength;
         job->setProgress(0.5);
@@ -2544,7 +2534,7 @@ QString WPMUtils::fileCheckSum(Job* job,
     } while (bufferLength != 0 && !job->isCancelled());
 
     if (job->shouldProceed()) {
-        sha1 = hash.result().toHex().toLower();
+        sha1 = writer.getHashSum();
         job->setProgress(1);
     }
 
@@ -2555,30 +2545,62 @@ QString WPMUtils::fileCheckSum(Job* job,
     return sha1;
 }
 
-void WPMUtils::unzip(Job* job, const QString zipfile, const QString outputdir)
-{
-    QString initialTitle = job->getTitle();
+/**
+ * @brief extracts a part of the entries from a ZIP file. The entries are
+ *     distributed between the workers in blocks of
+ *     UNZIP_ENTRIES_PER_BLOCK entries. The directories should already exist.
+ */
+class UnzipWorker: public QRunnable
+{
+    Job* job;
+    QString zipfile;
+    QString odir;
+    int worker;
+    int workers;
+    QAtomicInt* extracted;
+    int total;
+    QString initialTitle;
+public:
+    static const int UNZIP_ENTRIES_PER_BLOCK = 64;
+
+    /**
+     * @param job job. Only thread-safe methods of the job are called.
+     * @param zipfile .zip file
+     * @param odir output directory ending with a backslash
+     * @param worker index of this worker
+     * @param workers number of workers
+     * @param extracted the number of processed entries will be added here
+     * @param total number of entries in the ZIP file
+     * @param initialTitle initial title of the job. The only worker updates
+     *     the progress and the title of the job if workers == 1.
+     */
+    UnzipWorker(Job* job, const QString& zipfile, const QString& odir,
+            int worker, int workers, QAtomicInt* extracted, int total,
+            const QString& initialTitle):
+            job(job), zipfile(zipfile), odir(odir), worker(worker),
+            workers(workers), extracted(extracted), total(total),
+            initialTitle(initialTitle)
+    {
+    }
+
+    void run();
+};
 
+void UnzipWorker::run()
+{
     QuaZip zip(zipfile);
     if (!zip.open(QuaZip::mdUnzip)) {
         job->setErrorMessage(QString(QObject::tr("Cannot open the ZIP file %1: %2")).
                        arg(zipfile).arg(zip.getZipError()));
-    } else {
-        job->setProgress(0.01);
+        return;
     }
 
-    if (job->shouldProceed()) {
-        QString odir = outputdir;
-        if (!odir.endsWith("\\") && !odir.endsWith("/"))
-            odir.append("\\");
-
-        job->setTitle(initialTitle + " / " + QObject::tr("Extracting"));
-        QuaZipFile file(&zip);
-        int n = zip.getEntriesCount();
-        int blockSize = 1024 * 1024;
-        char* block = new char[blockSize];
-        int i = 0;
-        for (bool more = zip.goToFirstFile(); more; more = zip.goToNextFile()) {
+    QuaZipFile file(&zip);
+    int blockSize = 1024 * 1024;
+    char* block = new char[blockSize];
+    int i = 0;
+    for (bool more = zip.goToFirstFile(); more; more = zip.goToNextFile()) {
+        if ((i / UNZIP_ENTRIES_PER_BLOCK) % workers == worker) {
             QString name = zip.getCurrentFileName();
             if (!file.open(QIODevice::ReadOnly)) {
                 job->setErrorMessage(QString(
@@ -2589,38 +2611,121 @@ void WPMUtils::unzip(Job* job, const QString zipfile, const QString outputdir)
             }
             name.prepend(odir);
             QFile meminfo(name);
-            QFileInfo infofile(meminfo);
-            QDir dira(infofile.absolutePath());
-            if (dira.mkpath(infofile.absolutePath())) {
-                if (meminfo.open(QIODevice::ReadWrite)) {
-                    while (true) {
-                        qint64 read = file.read(block, blockSize);
-                        if (read <= 0)
-                            break;
-                        meminfo.write(block, read);
-                    }
-                    meminfo.close();
+            if (meminfo.open(QIODevice::ReadWrite)) {
+                while (true) {
+                    qint64 read = file.read(block, blockSize);
+                    if (read <= 0)
+                        break;
+                    meminfo.write(block, read);
                 }
-            } else {
-                job->setErrorMessage(QString(QObject::tr("Cannot create directory %1")).arg(
-                        infofile.absolutePath()));
-                file.close();
+                meminfo.close();
             }
             file.close(); // do not forget to close!
-            i++;
-            job->setProgress(0.01 + 0.99 * i / n);
-            if (i % 100 == 0)
-                job->setTitle(initialTitle + " / " +
-                        QString(QObject::tr("%L1 files")).arg(i));
+            extracted->ref();
+
+            if (workers == 1) {
+                int n = extracted->load();
+                job->setProgress(0.02 + 0.98 * n / total);
+                if (n % 100 == 0)
+                    job->setTitle(initialTitle + " / " +
+                            QString(QObject::tr("%L1 files")).arg(n));
+            }
 
             if (!job->shouldProceed())
                 break;
         }
+        i++;
+    }
+    zip.close();
+
+    delete[] block;
+}
+
+void WPMUtils::unzip(Job* job, const QString zipfile, const QString outputdir,
+        int threads)
+{
+    QString initialTitle = job->getTitle();
+
+    QStringList names;
+    QuaZip zip(zipfile);
+    if (!zip.open(QuaZip::mdUnzip)) {
+        job->setErrorMessage(QString(QObject::tr("Cannot open the ZIP file %1: %2")).
+                       arg(zipfile).arg(zip.getZipError()));
+    } else {
+        names = zip.getFileNameList();
         zip.close();
+        job->setProgress(0.01);
+    }
+
+    QString odir = outputdir;
+    if (!odir.endsWith("\\") && !odir.endsWith("/"))
+        odir.append("\\");
+
+    // the directory tree is created only once and not for every file
+    if (job->shouldProceed()) {
+        job->setTitle(initialTitle + " / " +
+                QObject::tr("Creating directories"));
+        QSet<QString> dirs;
+        dirs.insert("");
+        for (int i = 0; i < names.count(); i++) {
+            const QString& name = names.at(i);
+            int pos = qMax(name.lastIndexOf('/'), name.lastIndexOf('\\'));
+            if (pos > 0)
+                dirs.insert(name.left(pos));
+        }
+
+        QDir d;
+        QStringList sorted = dirs.toList();
+        qSort(sorted);
+        for (int i = 0; i < sorted.count(); i++) {
+            QString dir = odir + sorted.at(i);
+            if (!d.mkpath(dir)) {
+                job->setErrorMessage(QString(QObject::tr("Cannot create directory %1")).arg(
+                        dir));
+                break;
+            }
+        }
+
+        if (job->shouldProceed())
+            job->setProgress(0.02);
+    }
+
+    if (job->shouldProceed()) {
+        job->setTitle(initialTitle + " / " + QObject::tr("Extracting"));
 
-        delete[] block;
+        int n = names.count();
+        if (threads <= 0)
+            threads = QThread::idealThreadCount();
+        int workers = qMax(1, qMin(threads,
+                (n + UnzipWorker::UNZIP_ENTRIES_PER_BLOCK - 1) /
+                UnzipWorker::UNZIP_ENTRIES_PER_BLOCK));
+
+        QAtomicInt extracted;
+        if (workers == 1) {
+            UnzipWorker w(job, zipfile, odir, 0, 1, &extracted, n,
+                    initialTitle);
+            w.run();
+        } else {
+            QThreadPool pool;
+            pool.setMaxThreadCount(workers);
+            for (int i = 0; i < workers; i++)
+                pool.start(new UnzipWorker(job, zipfile, odir, i, workers,
+                        &extracted, n, initialTitle));
+
+            while (!pool.waitForDone(100)) {
+                int i = extracted.load();
+                job->setProgress(0.02 + 0.98 * i / n);
+                job->setTitle(initialTitle + " / " +
+                        QString(QObject::tr("%L1 files")).arg(i));
+            }
+        }
+
+        if (job->shouldProceed())
+            job->setProgress(1);
     }
 
+    job->setTitle(initialTitle);
+
     job->complete();
 }
 
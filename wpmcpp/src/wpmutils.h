@@ -618,12 +618,17 @@ public:
             QCryptographicHash::Algorithm alg);
 
     /**
-     * @brief unzips a file
+     * @brief unzips a file. The directories are created first. The files are
+     *     extracted by several threads. Each thread opens the ZIP file
+     *     separately.
      * @param job job
      * @param zipfile .zip file
      * @param outputdir output directory
+     * @param threads number of threads. 0 means QThread::idealThreadCount(),
+     *     1 means that all files are extracted in the current thread.
      */
-    static void unzip(Job* job, const QString zipfile, const QString outputdir);
+    static void unzip(Job* job, const QString zipfile, const QString outputdir,
+            int threads=0);
 
     /**
      * @param job job to monitor the progress. The error message will be set